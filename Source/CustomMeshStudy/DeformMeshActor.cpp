@@ -4,9 +4,10 @@
 // Sets default values
 ADeformMeshActor::ADeformMeshActor()
 {
-	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = true;
+	// The actor doesn't need to tick, the deform driver wakes up when the controller moves
+	PrimaryActorTick.bCanEverTick = false;
 	DeformMeshComp = CreateDefaultSubobject<UDeformMeshComponent>(TEXT("Deform Mesh Component"));
+	DeformDriver = CreateDefaultSubobject<UDeformMeshDriverComponent>(TEXT("Deform Driver"));
 	Controller = CreateDefaultSubobject<AActor>(TEXT("Controller"));
 }
 
@@ -15,20 +16,21 @@ void ADeformMeshActor::BeginPlay()
 {
 	Super::BeginPlay();
 
-	const auto Transform = Controller->GetTransform();
-	//We create a new deform mesh section using the static mesh and the transform of the actor
-	DeformMeshComp->CreateMeshSection(0, TestMesh, Transform);
-}
+	//Without a root component the controller has no transform to follow, the section then stays at the origin of the component
+	USceneComponent* ControllerRoot = Controller->GetRootComponent();
+	if (ControllerRoot == nullptr)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("%s: the controller has no root component, the deform mesh section won't follow it"), *GetName());
+	}
 
-// Called every frame
-void ADeformMeshActor::Tick(float DeltaTime)
-{
-	Super::Tick(DeltaTime);
-
-	const auto Transform = Controller->GetTransform();// TestTransform1->GetComponentTransform();
-	//We update the deform transform of the previously created deform mesh section
-	DeformMeshComp->UpdateMeshSectionTransform(0, Transform);
-	//We finalize all the deform transforms updates, in our case, just one
-	DeformMeshComp->FinishTransformsUpdate();
+	const FTransform Transform = ControllerRoot ? ControllerRoot->GetComponentTransform() : FTransform::Identity;
+	//We create a new deform mesh section using the static mesh and the transform of the controller
+	DeformMeshComp->CreateMeshSection(0, TestMesh, Transform);
 
+	//The driver updates the deform transform of the section we just created, only when the controller moves
+	DeformDriver->SetTarget(DeformMeshComp, 0);
+	if (ControllerRoot)
+	{
+		DeformDriver->SetSource(ControllerRoot);
+	}
 }
@@ -3,6 +3,7 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
 #include "DeformMesh/DeformMeshComponent.h"
+#include "DeformMesh/DeformMeshDriverComponent.h"
 #include "Components/SceneComponent.h"
 #include "DeformMeshActor.generated.h"
 
@@ -13,7 +14,8 @@ class CUSTOMMESHSTUDY_API ADeformMeshActor : public AActor
 
 /*
  * This is a simple actor that has a DeformMeshComponent
- * It uses the DeformMeshComponent API to create mesh sections and update their deform transforms
+ * It uses the DeformMeshComponent API to create mesh sections, and a DeformMeshDriverComponent to update their deform transforms
+ * The actor doesn't tick, the driver only updates the section when the controller moves
 */
 public:
 	// Sets default values for this actor's properties
@@ -24,12 +26,13 @@ protected:
 	virtual void BeginPlay() override;
 
 public:
-	// Called every frame
-	virtual void Tick(float DeltaTime) override;
-
 	UPROPERTY(EditAnywhere)
 	UDeformMeshComponent* DeformMeshComp;
 
+	//Updates the deform transform of the section when the controller moves
+	UPROPERTY(EditAnywhere)
+	UDeformMeshDriverComponent* DeformDriver;
+
 	//We're creating a mesh section from this static mesh
 	UPROPERTY(EditAnywhere)
 	UStaticMesh* TestMesh;
@@ -7,6 +7,10 @@
 
 IMPLEMENT_GAME_MODULE( FDeformMeshModule, DeformMesh);
 
+DEFINE_LOG_CATEGORY(LogDeformMesh);
+
+UE_TRACE_CHANNEL_DEFINE(DeformMeshChannel);
+
 
 void FDeformMeshModule::StartupModule()
 {
@@ -6,8 +6,13 @@
 
 #include "Modules/ModuleInterface.h"
 #include "Modules/ModuleManager.h"
+#include "Trace/Trace.h"
 
 
+DECLARE_LOG_CATEGORY_EXTERN(LogDeformMesh, Log, All);
+
+/** Trace channel of the DeformMesh CPU events, enable it in Unreal Insights with -trace=cpu,DeformMesh */
+UE_TRACE_CHANNEL_EXTERN(DeformMeshChannel, DEFORMMESH_API);
 
 class DEFORMMESH_API FDeformMeshModule : public IModuleInterface
 {
@@ -0,0 +1,441 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "DeformMeshBVH.h"
+#include "DeformMesh.h"
+#include "Engine/StaticMesh.h"
+#include "HAL/IConsoleManager.h"
+#include "StaticMeshResources.h"
+#include "UObject/ObjectKey.h"
+
+/* Maximum number of triangles in a leaf, testing a few triangles is cheaper than going down more nodes*/
+static constexpr int32 DeformMeshBVHMaxLeafTriangles = 4;
+
+const FBox FDeformMeshBVH::EmptyBounds(ForceInit);
+
+
+///////////////////////////////////////////////////////////////////////
+// The BVH cache
+/*
+ * The sections sharing a static mesh share its BVH, since the queries are done in the undeformed space of the mesh
+ * The render data pointer is kept to detect when the mesh was rebuilt (In the editor), the BVH is then built again
+*/
+///////////////////////////////////////////////////////////////////////
+struct FDeformMeshBVHCacheEntry
+{
+	const FStaticMeshRenderData* RenderData;
+	TSharedPtr<const FDeformMeshBVH> BVH;
+};
+
+static TMap<TObjectKey<UStaticMesh>, FDeformMeshBVHCacheEntry> GDeformMeshBVHCache;
+
+TSharedPtr<const FDeformMeshBVH> FDeformMeshBVH::GetOrBuild(const UStaticMesh* StaticMesh)
+{
+	check(IsInGameThread());
+
+	if (StaticMesh == nullptr || StaticMesh->RenderData == nullptr || StaticMesh->RenderData->LODResources.Num() == 0)
+	{
+		return nullptr;
+	}
+	const FStaticMeshRenderData* RenderData = StaticMesh->RenderData.Get();
+
+	const TObjectKey<UStaticMesh> Key(StaticMesh);
+	if (const FDeformMeshBVHCacheEntry* Entry = GDeformMeshBVHCache.Find(Key))
+	{
+		if (Entry->RenderData == RenderData)
+		{
+			return Entry->BVH;
+		}
+	}
+
+	//Read the vertices and the indices of the first LOD, they're only there if the mesh keeps its CPU data
+	const FStaticMeshLODResources& LODResource = RenderData->LODResources[0];
+	const FPositionVertexBuffer& PositionBuffer = LODResource.VertexBuffers.PositionVertexBuffer;
+	const FVector* Positions = (const FVector*)PositionBuffer.GetVertexData();
+	TArray<uint32> Indices;
+	LODResource.IndexBuffer.GetCopy(Indices);
+	if (Positions == nullptr || Indices.Num() < 3)
+	{
+		return nullptr;
+	}
+
+	TArray<FVector> Vertices(Positions, PositionBuffer.GetNumVertices());
+	TSharedPtr<const FDeformMeshBVH> BVH = MakeShared<FDeformMeshBVH>(MoveTemp(Vertices), Indices);
+
+	//Drop the entries of the meshes that were destroyed, before adding a new one
+	for (auto It = GDeformMeshBVHCache.CreateIterator(); It; ++It)
+	{
+		if (It.Key().ResolveObjectPtr() == nullptr)
+		{
+			It.RemoveCurrent();
+		}
+	}
+	GDeformMeshBVHCache.Add(Key, FDeformMeshBVHCacheEntry{ RenderData, BVH });
+
+	return BVH;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////
+// Building the BVH
+/*
+ * Top down build, each node is split at the median of its triangles' centroids along the longest axis of the centroids bounds
+ * The nodes are stored depth first, so the left child of a node is the next node
+*/
+///////////////////////////////////////////////////////////////////////
+FDeformMeshBVH::FDeformMeshBVH(TArray<FVector>&& InVertices, const TArray<uint32>& Indices)
+	: Vertices(MoveTemp(InVertices))
+{
+	const int32 NumTriangles = Indices.Num() / 3;
+	Triangles.SetNumUninitialized(NumTriangles);
+	TArray<FVector> Centroids;
+	Centroids.SetNumUninitialized(NumTriangles);
+
+	for (int32 TriangleIdx = 0; TriangleIdx < NumTriangles; TriangleIdx++)
+	{
+		FTriangle& Triangle = Triangles[TriangleIdx];
+		for (int32 Corner = 0; Corner < 3; Corner++)
+		{
+			Triangle.Index[Corner] = Indices[TriangleIdx * 3 + Corner];
+		}
+		Triangle.FaceIndex = TriangleIdx;
+		Centroids[TriangleIdx] = (Vertices[Triangle.Index[0]] + Vertices[Triangle.Index[1]] + Vertices[Triangle.Index[2]]) / 3.f;
+	}
+
+	//The leaves have at least 2 triangles (Unless the mesh has only one), so the tree has less nodes than triangles
+	Nodes.Reserve(NumTriangles);
+	if (NumTriangles > 0)
+	{
+		BuildNode(Centroids, 0, NumTriangles);
+	}
+	Nodes.Shrink();
+}
+
+int32 FDeformMeshBVH::BuildNode(TArray<FVector>& Centroids, int32 First, int32 Num)
+{
+	const int32 NodeIndex = Nodes.AddUninitialized();
+
+	FBox Bounds(ForceInit);
+	FBox CentroidBounds(ForceInit);
+	for (int32 TriangleIdx = First; TriangleIdx < First + Num; TriangleIdx++)
+	{
+		const FTriangle& Triangle = Triangles[TriangleIdx];
+		Bounds += Vertices[Triangle.Index[0]];
+		Bounds += Vertices[Triangle.Index[1]];
+		Bounds += Vertices[Triangle.Index[2]];
+		CentroidBounds += Centroids[TriangleIdx];
+	}
+	Nodes[NodeIndex].Bounds = Bounds;
+
+	if (Num <= DeformMeshBVHMaxLeafTriangles)
+	{
+		Nodes[NodeIndex].FirstTriangleOrRightChild = First;
+		Nodes[NodeIndex].NumTriangles = Num;
+		return NodeIndex;
+	}
+
+	//Sort the triangles of the node along the longest axis, and split them in two halves
+	const FVector CentroidExtent = CentroidBounds.GetExtent();
+	const int32 Axis = CentroidExtent.X >= CentroidExtent.Y ? (CentroidExtent.X >= CentroidExtent.Z ? 0 : 2) : (CentroidExtent.Y >= CentroidExtent.Z ? 1 : 2);
+
+	TArray<int32> Order;
+	Order.SetNumUninitialized(Num);
+	for (int32 Idx = 0; Idx < Num; Idx++)
+	{
+		Order[Idx] = First + Idx;
+	}
+	Order.Sort([&Centroids, Axis](int32 A, int32 B) { return Centroids[A][Axis] < Centroids[B][Axis]; });
+
+	TArray<FTriangle> SortedTriangles;
+	TArray<FVector> SortedCentroids;
+	SortedTriangles.Reserve(Num);
+	SortedCentroids.Reserve(Num);
+	for (int32 Idx : Order)
+	{
+		SortedTriangles.Add(Triangles[Idx]);
+		SortedCentroids.Add(Centroids[Idx]);
+	}
+	FMemory::Memcpy(&Triangles[First], SortedTriangles.GetData(), Num * sizeof(FTriangle));
+	FMemory::Memcpy(&Centroids[First], SortedCentroids.GetData(), Num * sizeof(FVector));
+
+	const int32 NumLeft = Num / 2;
+	BuildNode(Centroids, First, NumLeft);
+	const int32 RightChild = BuildNode(Centroids, First + NumLeft, Num - NumLeft);
+
+	Nodes[NodeIndex].FirstTriangleOrRightChild = RightChild;
+	Nodes[NodeIndex].NumTriangles = 0;
+	return NodeIndex;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////
+// Queries
+///////////////////////////////////////////////////////////////////////
+
+/* Slab test of the segment Start + t * Dir, for t in [0, MaxTime], against a box. InvDir is 1 / Dir, with a large value for the null components*/
+static FORCEINLINE bool SegmentIntersectsBox(const FBox& Box, const FVector& Start, const FVector& InvDir, float MaxTime)
+{
+	float TMin = 0.f;
+	float TMax = MaxTime;
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		const float T1 = (Box.Min[Axis] - Start[Axis]) * InvDir[Axis];
+		const float T2 = (Box.Max[Axis] - Start[Axis]) * InvDir[Axis];
+		TMin = FMath::Max(TMin, FMath::Min(T1, T2));
+		TMax = FMath::Min(TMax, FMath::Max(T1, T2));
+	}
+	return TMin <= TMax;
+}
+
+/* Moller-Trumbore intersection, the hit is kept if it's closer than the current one*/
+bool FDeformMeshBVH::IntersectTriangle(const FVector* InVertices, const FTriangle& Triangle, const FVector& Start, const FVector& Dir, FDeformMeshBVHHit& InOutHit)
+{
+	const FVector& A = InVertices[Triangle.Index[0]];
+	const FVector Edge1 = InVertices[Triangle.Index[1]] - A;
+	const FVector Edge2 = InVertices[Triangle.Index[2]] - A;
+
+	const FVector P = Dir ^ Edge2;
+	const float Det = Edge1 | P;
+	if (FMath::Abs(Det) < SMALL_NUMBER)
+	{
+		return false;
+	}
+	const float InvDet = 1.f / Det;
+
+	const FVector T = Start - A;
+	const float U = (T | P) * InvDet;
+	if (U < 0.f || U > 1.f)
+	{
+		return false;
+	}
+
+	const FVector Q = T ^ Edge1;
+	const float V = (Dir | Q) * InvDet;
+	if (V < 0.f || U + V > 1.f)
+	{
+		return false;
+	}
+
+	const float Time = (Edge2 | Q) * InvDet;
+	if (Time < 0.f || Time >= InOutHit.Time)
+	{
+		return false;
+	}
+
+	InOutHit.Time = Time;
+	InOutHit.FaceIndex = Triangle.FaceIndex;
+	InOutHit.Normal = Edge1 ^ Edge2;
+	return true;
+}
+
+/* The triangle is moved instead of the sphere, so the test stays exact under a non uniform scale*/
+bool FDeformMeshBVH::OverlapTriangle(const FVector* InVertices, const FTriangle& Triangle, const FVector& Center, float RadiusSquared, const FMatrix& MeshToQuery)
+{
+	const FVector A = MeshToQuery.TransformPosition(InVertices[Triangle.Index[0]]);
+	const FVector B = MeshToQuery.TransformPosition(InVertices[Triangle.Index[1]]);
+	const FVector C = MeshToQuery.TransformPosition(InVertices[Triangle.Index[2]]);
+	const FVector Closest = FMath::ClosestPointOnTriangleToPoint(Center, A, B, C);
+	return FVector::DistSquared(Closest, Center) <= RadiusSquared;
+}
+
+bool FDeformMeshBVH::LineTrace(const FVector& Start, const FVector& End, FDeformMeshBVHHit& OutHit) const
+{
+	OutHit = FDeformMeshBVHHit();
+	if (Nodes.Num() == 0)
+	{
+		return false;
+	}
+
+	const FVector Dir = End - Start;
+	const FVector InvDir(
+		Dir.X != 0.f ? 1.f / Dir.X : BIG_NUMBER,
+		Dir.Y != 0.f ? 1.f / Dir.Y : BIG_NUMBER,
+		Dir.Z != 0.f ? 1.f / Dir.Z : BIG_NUMBER);
+
+	bool bHit = false;
+	TArray<int32, TInlineAllocator<64>> Stack;
+	Stack.Add(0);
+	while (Stack.Num() > 0)
+	{
+		const FNode& Node = Nodes[Stack.Pop(false)];
+		//The segment is shortened to the closest hit so far, so the farther nodes are skipped
+		if (!SegmentIntersectsBox(Node.Bounds, Start, InvDir, OutHit.Time))
+		{
+			continue;
+		}
+
+		if (Node.NumTriangles > 0)
+		{
+			for (int32 TriangleIdx = Node.FirstTriangleOrRightChild; TriangleIdx < Node.FirstTriangleOrRightChild + Node.NumTriangles; TriangleIdx++)
+			{
+				bHit |= IntersectTriangle(Vertices.GetData(), Triangles[TriangleIdx], Start, Dir, OutHit);
+			}
+		}
+		else
+		{
+			const int32 NodeIndex = &Node - Nodes.GetData();
+			Stack.Add(Node.FirstTriangleOrRightChild);
+			Stack.Add(NodeIndex + 1);
+		}
+	}
+	return bHit;
+}
+
+bool FDeformMeshBVH::LineTraceBruteForce(const FVector& Start, const FVector& End, FDeformMeshBVHHit& OutHit) const
+{
+	OutHit = FDeformMeshBVHHit();
+	const FVector Dir = End - Start;
+	bool bHit = false;
+	for (const FTriangle& Triangle : Triangles)
+	{
+		bHit |= IntersectTriangle(Vertices.GetData(), Triangle, Start, Dir, OutHit);
+	}
+	return bHit;
+}
+
+bool FDeformMeshBVH::LineTraceDeformed(TArrayView<const FVector> DeformedVertices, const FVector& Start, const FVector& End, FDeformMeshBVHHit& OutHit) const
+{
+	OutHit = FDeformMeshBVHHit();
+	if (DeformedVertices.Num() != Vertices.Num())
+	{
+		return false;
+	}
+
+	const FVector Dir = End - Start;
+	bool bHit = false;
+	for (const FTriangle& Triangle : Triangles)
+	{
+		bHit |= IntersectTriangle(DeformedVertices.GetData(), Triangle, Start, Dir, OutHit);
+	}
+	return bHit;
+}
+
+bool FDeformMeshBVH::SphereOverlapDeformed(TArrayView<const FVector> DeformedVertices, const FVector& Center, float Radius, const FMatrix& MeshToQuery) const
+{
+	if (DeformedVertices.Num() != Vertices.Num())
+	{
+		return false;
+	}
+
+	const float RadiusSquared = FMath::Square(Radius);
+	for (const FTriangle& Triangle : Triangles)
+	{
+		if (OverlapTriangle(DeformedVertices.GetData(), Triangle, Center, RadiusSquared, MeshToQuery))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool FDeformMeshBVH::SphereOverlap(const FVector& Center, float Radius, const FMatrix& MeshToQuery) const
+{
+	if (Nodes.Num() == 0)
+	{
+		return false;
+	}
+
+	const float RadiusSquared = FMath::Square(Radius);
+	TArray<int32, TInlineAllocator<64>> Stack;
+	Stack.Add(0);
+	while (Stack.Num() > 0)
+	{
+		const int32 NodeIndex = Stack.Pop(false);
+		const FNode& Node = Nodes[NodeIndex];
+		//The transformed box contains the transformed node, it only culls
+		if (!FMath::SphereAABBIntersection(Center, RadiusSquared, Node.Bounds.TransformBy(MeshToQuery)))
+		{
+			continue;
+		}
+
+		if (Node.NumTriangles > 0)
+		{
+			for (int32 TriangleIdx = Node.FirstTriangleOrRightChild; TriangleIdx < Node.FirstTriangleOrRightChild + Node.NumTriangles; TriangleIdx++)
+			{
+				if (OverlapTriangle(Vertices.GetData(), Triangles[TriangleIdx], Center, RadiusSquared, MeshToQuery))
+				{
+					return true;
+				}
+			}
+		}
+		else
+		{
+			Stack.Add(Node.FirstTriangleOrRightChild);
+			Stack.Add(NodeIndex + 1);
+		}
+	}
+	return false;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////
+// Benchmark
+/*
+ * Compare the BVH line traces with a scan of all the triangles, run "DeformMesh.BenchmarkBVH /Game/Path/To/Mesh.Mesh [NumRays]" in the console
+ * The rays go through random points of the mesh bounds, the hit counts of the two methods are reported so they can be checked against each other
+*/
+///////////////////////////////////////////////////////////////////////
+static void BenchmarkDeformMeshBVH(const TArray<FString>& Args)
+{
+	if (Args.Num() < 1)
+	{
+		UE_LOG(LogDeformMesh, Warning, TEXT("Usage: DeformMesh.BenchmarkBVH <StaticMeshPath> [NumRays]"));
+		return;
+	}
+
+	const UStaticMesh* StaticMesh = LoadObject<UStaticMesh>(nullptr, *Args[0]);
+	const int32 NumRays = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 10000;
+
+	const double BuildStartTime = FPlatformTime::Seconds();
+	TSharedPtr<const FDeformMeshBVH> BVH = FDeformMeshBVH::GetOrBuild(StaticMesh);
+	const double BuildDuration = FPlatformTime::Seconds() - BuildStartTime;
+	if (!BVH.IsValid())
+	{
+		UE_LOG(LogDeformMesh, Warning, TEXT("Can't build the BVH of %s, the mesh must exist and keep its CPU data"), *Args[0]);
+		return;
+	}
+
+	//Each ray goes from a point outside of the bounds to a random point inside
+	const FBox& Bounds = BVH->GetBounds();
+	const float RayLength = Bounds.GetExtent().Size() * 4.f;
+	FRandomStream Random(NumRays);
+	TArray<FVector> Starts;
+	TArray<FVector> Ends;
+	Starts.SetNumUninitialized(NumRays);
+	Ends.SetNumUninitialized(NumRays);
+	for (int32 RayIdx = 0; RayIdx < NumRays; RayIdx++)
+	{
+		const FVector Target = Random.RandPointInBox(Bounds);
+		const FVector Dir = Random.GetUnitVector();
+		Starts[RayIdx] = Target - Dir * RayLength * 0.5f;
+		Ends[RayIdx] = Target + Dir * RayLength * 0.5f;
+	}
+
+	FDeformMeshBVHHit Hit;
+	int32 NumBVHHits = 0;
+	const double BVHStartTime = FPlatformTime::Seconds();
+	for (int32 RayIdx = 0; RayIdx < NumRays; RayIdx++)
+	{
+		NumBVHHits += BVH->LineTrace(Starts[RayIdx], Ends[RayIdx], Hit) ? 1 : 0;
+	}
+	const double BVHDuration = FPlatformTime::Seconds() - BVHStartTime;
+
+	int32 NumBruteForceHits = 0;
+	const double BruteForceStartTime = FPlatformTime::Seconds();
+	for (int32 RayIdx = 0; RayIdx < NumRays; RayIdx++)
+	{
+		NumBruteForceHits += BVH->LineTraceBruteForce(Starts[RayIdx], Ends[RayIdx], Hit) ? 1 : 0;
+	}
+	const double BruteForceDuration = FPlatformTime::Seconds() - BruteForceStartTime;
+
+	UE_LOG(LogDeformMesh, Display, TEXT("BVH of %s: %d triangles, %.2f KB, built in %.2f ms"), *Args[0], BVH->GetNumTriangles(), BVH->GetAllocatedSize() / 1024.f, BuildDuration * 1000.0);
+	UE_LOG(LogDeformMesh, Display, TEXT("%d rays, BVH: %.3f us/ray (%d hits), brute force: %.3f us/ray (%d hits)"),
+		NumRays, BVHDuration * 1e6 / NumRays, NumBVHHits, BruteForceDuration * 1e6 / NumRays, NumBruteForceHits);
+}
+
+static FAutoConsoleCommand BenchmarkDeformMeshBVHCommand(
+	TEXT("DeformMesh.BenchmarkBVH"),
+	TEXT("Compare the line traces against the BVH of a static mesh with a brute force scan of its triangles. Arguments: StaticMeshPath [NumRays]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&BenchmarkDeformMeshBVH));
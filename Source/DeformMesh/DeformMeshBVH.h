@@ -0,0 +1,101 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//Forward declarations
+class UStaticMesh;
+
+
+/** Result of a line trace against a BVH, in the space of the BVH's mesh */
+struct FDeformMeshBVHHit
+{
+	/** Fraction of the segment where the hit happened, 0 at the start and 1 at the end */
+	float Time = 1.f;
+
+	/** Index of the hit triangle in the index buffer of the mesh (First index / 3) */
+	int32 FaceIndex = INDEX_NONE;
+
+	/** Unnormalized normal of the hit triangle, following the winding of the triangle */
+	FVector Normal = FVector::ZeroVector;
+};
+
+/**
+ *	Bounding volume hierarchy over the triangles of the first LOD of a static mesh.
+ *	It's built once per static mesh and shared by all the deform mesh sections using that mesh, the queries are done in the undeformed space of the mesh.
+ */
+class DEFORMMESH_API FDeformMeshBVH
+{
+public:
+
+	/**
+	 *	Get the BVH of a static mesh, it's built on the first call and cached until the mesh render data changes or the mesh is destroyed.
+	 *	Returns null when the mesh doesn't keep its vertices and indices on the CPU (Allow CPU Access is needed in cooked builds). Game thread only.
+	 */
+	static TSharedPtr<const FDeformMeshBVH> GetOrBuild(const UStaticMesh* StaticMesh);
+
+	/** Build the hierarchy from a triangle list */
+	FDeformMeshBVH(TArray<FVector>&& InVertices, const TArray<uint32>& Indices);
+
+	/** Find the closest triangle hit by the segment from Start to End, triangles are hit from both sides */
+	bool LineTrace(const FVector& Start, const FVector& End, FDeformMeshBVHHit& OutHit) const;
+
+	/**
+	 *	Returns whether any triangle, transformed by MeshToQuery, is closer than Radius to Center. Center is in the space of the query.
+	 *	The triangles are moved instead of the sphere, so the test stays exact when MeshToQuery has a non uniform scale.
+	 */
+	bool SphereOverlap(const FVector& Center, float Radius, const FMatrix& MeshToQuery = FMatrix::Identity) const;
+
+	/** Same as LineTrace(), testing all the triangles. Used as a reference by the benchmark */
+	bool LineTraceBruteForce(const FVector& Start, const FVector& End, FDeformMeshBVHHit& OutHit) const;
+
+	/**
+	 *	Same as LineTraceBruteForce(), with the triangles built on DeformedVertices instead of the vertices of the mesh, one position per vertex of the first LOD.
+	 *	The hierarchy only bounds the undeformed triangles, so all the triangles are tested.
+	 */
+	bool LineTraceDeformed(TArrayView<const FVector> DeformedVertices, const FVector& Start, const FVector& End, FDeformMeshBVHHit& OutHit) const;
+
+	/** Same as SphereOverlap(), with the triangles built on DeformedVertices, all the triangles are tested */
+	bool SphereOverlapDeformed(TArrayView<const FVector> DeformedVertices, const FVector& Center, float Radius, const FMatrix& MeshToQuery = FMatrix::Identity) const;
+
+	/** Bounds of all the triangles */
+	const FBox& GetBounds() const { return Nodes.Num() > 0 ? Nodes[0].Bounds : EmptyBounds; }
+
+	int32 GetNumTriangles() const { return Triangles.Num(); }
+
+	int32 GetNumVertices() const { return Vertices.Num(); }
+
+	SIZE_T GetAllocatedSize() const { return Vertices.GetAllocatedSize() + Triangles.GetAllocatedSize() + Nodes.GetAllocatedSize(); }
+
+private:
+
+	/* A triangle, with its index in the mesh since the triangles are reordered by the build*/
+	struct FTriangle
+	{
+		int32 Index[3];
+		int32 FaceIndex;
+	};
+
+	/* A node of the tree, the left child of an inner node is the next node, so only the right child is stored*/
+	struct FNode
+	{
+		FBox Bounds;
+		/* Leaves: First triangle. Inner nodes: Index of the right child*/
+		int32 FirstTriangleOrRightChild;
+		/* Number of triangles of a leaf, 0 for inner nodes*/
+		int32 NumTriangles;
+	};
+
+	int32 BuildNode(TArray<FVector>& Centroids, int32 First, int32 Num);
+
+	static bool IntersectTriangle(const FVector* InVertices, const FTriangle& Triangle, const FVector& Start, const FVector& Dir, FDeformMeshBVHHit& InOutHit);
+
+	static bool OverlapTriangle(const FVector* InVertices, const FTriangle& Triangle, const FVector& Center, float RadiusSquared, const FMatrix& MeshToQuery);
+
+	TArray<FVector> Vertices;
+	TArray<FTriangle> Triangles;
+	TArray<FNode> Nodes;
+
+	static const FBox EmptyBounds;
+};
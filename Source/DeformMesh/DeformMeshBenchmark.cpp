@@ -0,0 +1,354 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "DeformMeshBenchmark.h"
+#include "DeformMeshBenchmarkCommandlet.h"
+#include "DeformMesh.h"
+#include "DeformMeshComponent.h"
+#include "DeformMeshSubsystem.h"
+#include "Components/SceneCaptureComponent2D.h"
+#include "Engine/Engine.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "Engine/World.h"
+#include "GameFramework/Actor.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/App.h"
+#include "Misc/AutomationTest.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "RenderingThread.h"
+
+
+///////////////////////////////////////////////////////////////////////
+// DeformMesh benchmark
+/*
+ * Times the main costs of a DeformMeshComponent for different section counts, and writes them to a CSV report that can be compared between builds
+ * It runs headless in three ways:
+ * - The DeformMesh.Benchmark console command, in the current world: UE4Editor.exe Project.uproject Map -game -nullrhi -ExecCmds="DeformMesh.Benchmark"
+ *   Arguments (all optional): StaticMeshPath NumFrames SectionCount1 SectionCount2 ...
+ * - The DeformMeshBenchmark commandlet, in its own world: UE4Editor-Cmd.exe Project.uproject -run=DeformMeshBenchmark -nullrhi
+ * - The DeformMesh.Benchmark automation test, with small section counts: -nullrhi -ExecCmds="Automation RunTests DeformMesh"
+ * For each section count, we measure:
+ * - The proxy creation, on the game thread and then the render commands it enqueued
+ *   Then again with DeformMesh.ParallelProxyCreation at 0, the sections are prepared one after the other on the game thread
+ *   The serial recreation also releases the previous proxy, that's part of its render thread timing
+ * - The update of all the transforms with UpdateMeshSectionTransform() + FinishTransformsUpdate(), and with the batched UpdateMeshSectionTransforms()
+ *   The flush of the world subsystem that sends the queued transforms is part of the game thread timing
+ * - The processing of the render commands sent by the updates
+ * - GetDynamicMeshElements(), while a scene capture renders the component after each update. It needs an RHI, so it's 0 with -nullrhi
+*/
+///////////////////////////////////////////////////////////////////////
+
+/* Time the render commands that are waiting, the flush waits until the render thread processed them all*/
+static double FlushRenderingCommandsMs()
+{
+	const double StartTime = FPlatformTime::Seconds();
+	FlushRenderingCommands();
+	return (FPlatformTime::Seconds() - StartTime) * 1000.0;
+}
+
+FDeformMeshBenchmarkResult FDeformMeshBenchmark::Run(UWorld* World, UStaticMesh* StaticMesh, int32 NumSections, int32 NumFrames)
+{
+	FDeformMeshBenchmarkResult Result;
+	Result.NumSections = NumSections;
+
+	AActor* Actor = World->SpawnActor<AActor>();
+	UDeformMeshComponent* Component = NewObject<UDeformMeshComponent>(Actor);
+	Actor->SetRootComponent(Component);
+
+	//Randomized, but the same for each run so the reports can be compared
+	FRandomStream Random(NumSections);
+	auto RandomTransform = [&Random]()
+	{
+		return FTransform(FRotator(Random.FRandRange(-180.f, 180.f), Random.FRandRange(-180.f, 180.f), 0.f), Random.GetUnitVector() * 500.f, FVector(Random.FRandRange(0.5f, 2.f)));
+	};
+
+	for (int32 SectionIdx = 0; SectionIdx < NumSections; SectionIdx++)
+	{
+		Component->CreateMeshSection(SectionIdx, StaticMesh, RandomTransform());
+	}
+
+	//Proxy creation, the sections are all there so the proxy is created once
+	FlushRenderingCommands();
+	double StartTime = FPlatformTime::Seconds();
+	Component->RegisterComponent();
+	Result.ProxyCreationGameThreadMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+	Result.ProxyCreationRenderThreadMs = FlushRenderingCommandsMs();
+
+	//The same proxy, with its sections prepared on the game thread
+	IConsoleVariable* ParallelProxyCreation = IConsoleManager::Get().FindConsoleVariable(TEXT("DeformMesh.ParallelProxyCreation"));
+	if (ParallelProxyCreation)
+	{
+		const int32 PreviousValue = ParallelProxyCreation->GetInt();
+		ParallelProxyCreation->Set(0, ECVF_SetByCode);
+		StartTime = FPlatformTime::Seconds();
+		Component->RecreateRenderState_Concurrent();
+		Result.SerialProxyCreationGameThreadMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+		Result.SerialProxyCreationRenderThreadMs = FlushRenderingCommandsMs();
+		ParallelProxyCreation->Set(PreviousValue, ECVF_SetByCode);
+	}
+
+	//A capture of the whole component from outside its sections, so GetDynamicMeshElements() is called without a viewport
+	USceneCaptureComponent2D* Capture = nullptr;
+	if (FApp::CanEverRender())
+	{
+		UTextureRenderTarget2D* RenderTarget = NewObject<UTextureRenderTarget2D>(Actor);
+		RenderTarget->InitAutoFormat(256, 256);
+		Capture = NewObject<USceneCaptureComponent2D>(Actor);
+		Capture->bCaptureEveryFrame = false;
+		Capture->bCaptureOnMovement = false;
+		Capture->TextureTarget = RenderTarget;
+		Capture->SetupAttachment(Component);
+		Capture->SetRelativeLocation(FVector(-2000.f, 0.f, 0.f));
+		Capture->RegisterComponent();
+	}
+
+	//The transforms are queued until the end of the world tick, we flush them after each update so they're measured
+	UDeformMeshSubsystem* Subsystem = World->GetSubsystem<UDeformMeshSubsystem>();
+	auto FlushSubsystem = [Subsystem]()
+	{
+		if (Subsystem)
+		{
+			Subsystem->Flush();
+		}
+	};
+
+	TArray<FTransform> Transforms;
+	Transforms.SetNum(NumSections);
+	for (int32 Frame = 0; Frame < NumFrames; Frame++)
+	{
+		for (FTransform& Transform : Transforms)
+		{
+			Transform = RandomTransform();
+		}
+
+		//One update per section
+		StartTime = FPlatformTime::Seconds();
+		for (int32 SectionIdx = 0; SectionIdx < NumSections; SectionIdx++)
+		{
+			Component->UpdateMeshSectionTransform(SectionIdx, Transforms[SectionIdx]);
+		}
+		Component->FinishTransformsUpdate();
+		FlushSubsystem();
+		Result.UpdateGameThreadMs += (FPlatformTime::Seconds() - StartTime) * 1000.0;
+		Result.UpdateRenderThreadMs += FlushRenderingCommandsMs();
+
+		//All the sections at once
+		StartTime = FPlatformTime::Seconds();
+		Component->UpdateMeshSectionTransforms(Transforms);
+		FlushSubsystem();
+		Result.BatchedUpdateGameThreadMs += (FPlatformTime::Seconds() - StartTime) * 1000.0;
+		Result.BatchedUpdateRenderThreadMs += FlushRenderingCommandsMs();
+
+		//Render the updated sections, the counter is only incremented by the render thread so it's stable once the commands are flushed
+		if (Capture)
+		{
+			const uint64 StartCycles = GDeformMeshGetDynamicMeshElementsCycles.Load();
+			Capture->CaptureScene();
+			FlushRenderingCommands();
+			Result.GetDynamicMeshElementsMs += FPlatformTime::ToMilliseconds64(GDeformMeshGetDynamicMeshElementsCycles.Load() - StartCycles);
+		}
+	}
+
+	Result.UpdateGameThreadMs /= NumFrames;
+	Result.UpdateRenderThreadMs /= NumFrames;
+	Result.BatchedUpdateGameThreadMs /= NumFrames;
+	Result.BatchedUpdateRenderThreadMs /= NumFrames;
+	Result.GetDynamicMeshElementsMs /= NumFrames;
+
+	Actor->Destroy();
+	FlushRenderingCommands();
+	return Result;
+}
+
+bool FDeformMeshBenchmark::RunAll(UWorld* World, const FDeformMeshBenchmarkSettings& Settings, TArray<FDeformMeshBenchmarkResult>& OutResults)
+{
+	OutResults.Reset();
+
+	UStaticMesh* StaticMesh = LoadObject<UStaticMesh>(nullptr, *Settings.MeshPath);
+	if (StaticMesh == nullptr)
+	{
+		UE_LOG(LogDeformMesh, Warning, TEXT("DeformMesh benchmark can't load the static mesh %s"), *Settings.MeshPath);
+		return false;
+	}
+
+	if (!FApp::CanEverRender())
+	{
+		UE_LOG(LogDeformMesh, Display, TEXT("DeformMesh benchmark runs without an RHI, GetDynamicMeshElements() isn't measured"));
+	}
+
+	const int32 NumFrames = FMath::Max(Settings.NumFrames, 1);
+	for (int32 NumSections : Settings.SectionCounts)
+	{
+		OutResults.Add(Run(World, StaticMesh, FMath::Max(NumSections, 1), NumFrames));
+	}
+	return true;
+}
+
+FString FDeformMeshBenchmark::WriteReport(const TArray<FDeformMeshBenchmarkResult>& Results)
+{
+	FString Report = TEXT("NumSections,ProxyCreationGameThreadMs,ProxyCreationRenderThreadMs,SerialProxyCreationGameThreadMs,SerialProxyCreationRenderThreadMs,UpdateGameThreadMs,UpdateRenderThreadMs,BatchedUpdateGameThreadMs,BatchedUpdateRenderThreadMs,GetDynamicMeshElementsMs\n");
+	for (const FDeformMeshBenchmarkResult& Result : Results)
+	{
+		const FString Line = FString::Printf(TEXT("%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f"), Result.NumSections,
+			Result.ProxyCreationGameThreadMs, Result.ProxyCreationRenderThreadMs,
+			Result.SerialProxyCreationGameThreadMs, Result.SerialProxyCreationRenderThreadMs,
+			Result.UpdateGameThreadMs, Result.UpdateRenderThreadMs,
+			Result.BatchedUpdateGameThreadMs, Result.BatchedUpdateRenderThreadMs,
+			Result.GetDynamicMeshElementsMs);
+		UE_LOG(LogDeformMesh, Display, TEXT("%s"), *Line);
+		Report += Line + TEXT("\n");
+	}
+
+	const FString ReportPath = FPaths::Combine(FPaths::ProfilingDir(), TEXT("DeformMesh"), FString::Printf(TEXT("DeformMeshBenchmark-%s.csv"), *FDateTime::Now().ToString()));
+	if (!FFileHelper::SaveStringToFile(Report, *ReportPath))
+	{
+		return FString();
+	}
+	UE_LOG(LogDeformMesh, Display, TEXT("DeformMesh benchmark report written to %s"), *ReportPath);
+	return ReportPath;
+}
+
+UWorld* FDeformMeshBenchmark::CreateWorld()
+{
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false, TEXT("DeformMeshBenchmark"));
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+	World->InitializeActorsForPlay(FURL());
+	return World;
+}
+
+void FDeformMeshBenchmark::DestroyWorld(UWorld* World)
+{
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+	FlushRenderingCommands();
+}
+
+static void DeformMeshBenchmark(const TArray<FString>& Args, UWorld* World)
+{
+	if (World == nullptr)
+	{
+		UE_LOG(LogDeformMesh, Warning, TEXT("DeformMesh.Benchmark needs a world"));
+		return;
+	}
+
+	FDeformMeshBenchmarkSettings Settings;
+	if (Args.Num() > 0)
+	{
+		Settings.MeshPath = Args[0];
+	}
+	if (Args.Num() > 1)
+	{
+		Settings.NumFrames = FCString::Atoi(*Args[1]);
+	}
+	if (Args.Num() > 2)
+	{
+		Settings.SectionCounts.Reset();
+		for (int32 ArgIdx = 2; ArgIdx < Args.Num(); ArgIdx++)
+		{
+			Settings.SectionCounts.Add(FCString::Atoi(*Args[ArgIdx]));
+		}
+	}
+
+	TArray<FDeformMeshBenchmarkResult> Results;
+	if (FDeformMeshBenchmark::RunAll(World, Settings, Results))
+	{
+		FDeformMeshBenchmark::WriteReport(Results);
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs DeformMeshBenchmarkCommand(
+	TEXT("DeformMesh.Benchmark"),
+	TEXT("Time the proxy creation, the transform updates and GetDynamicMeshElements() of DeformMesh components with different section counts, and write a CSV report to Saved/Profiling/DeformMesh. Arguments: [StaticMeshPath] [NumFrames] [SectionCount...]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&DeformMeshBenchmark));
+
+
+///////////////////////////////////////////////////////////////////////
+// The benchmark commandlet
+///////////////////////////////////////////////////////////////////////
+
+UDeformMeshBenchmarkCommandlet::UDeformMeshBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UDeformMeshBenchmarkCommandlet::Main(const FString& Params)
+{
+	FDeformMeshBenchmarkSettings Settings;
+	FParse::Value(*Params, TEXT("Mesh="), Settings.MeshPath);
+	FParse::Value(*Params, TEXT("Frames="), Settings.NumFrames);
+
+	FString SectionCounts;
+	if (FParse::Value(*Params, TEXT("Sections="), SectionCounts, false))
+	{
+		TArray<FString> Counts;
+		SectionCounts.ParseIntoArray(Counts, TEXT(","));
+		Settings.SectionCounts.Reset();
+		for (const FString& Count : Counts)
+		{
+			Settings.SectionCounts.Add(FCString::Atoi(*Count));
+		}
+	}
+
+	UWorld* World = FDeformMeshBenchmark::CreateWorld();
+	TArray<FDeformMeshBenchmarkResult> Results;
+	const bool bRan = FDeformMeshBenchmark::RunAll(World, Settings, Results);
+	FDeformMeshBenchmark::DestroyWorld(World);
+
+	return bRan && !FDeformMeshBenchmark::WriteReport(Results).IsEmpty() ? 0 : 1;
+}
+
+
+///////////////////////////////////////////////////////////////////////
+// Automation tests
+///////////////////////////////////////////////////////////////////////
+#if WITH_DEV_AUTOMATION_TESTS
+
+/* Run the benchmark with a few frames up to 1000 sections, in its own world, and check the shape of the results: one row per section count, with valid timings*/
+/* The timings are never compared to a value, a fast machine can time a step at 0. The CSV report is left to the console command and the commandlet*/
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDeformMeshBenchmarkTest, "DeformMesh.Benchmark", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FDeformMeshBenchmarkTest::RunTest(const FString& Parameters)
+{
+	FDeformMeshBenchmarkSettings Settings;
+	Settings.NumFrames = 4;
+	Settings.SectionCounts = { 1, 10, 100, 1000 };
+
+	UWorld* World = FDeformMeshBenchmark::CreateWorld();
+	TArray<FDeformMeshBenchmarkResult> Results;
+	const bool bRan = FDeformMeshBenchmark::RunAll(World, Settings, Results);
+	FDeformMeshBenchmark::DestroyWorld(World);
+
+	if (!TestTrue(TEXT("The benchmark ran"), bRan) ||
+		!TestEqual(TEXT("Number of results"), Results.Num(), Settings.SectionCounts.Num()))
+	{
+		return false;
+	}
+
+	for (int32 ResultIdx = 0; ResultIdx < Results.Num(); ResultIdx++)
+	{
+		const FDeformMeshBenchmarkResult& Result = Results[ResultIdx];
+		TestEqual(TEXT("Number of sections"), Result.NumSections, Settings.SectionCounts[ResultIdx]);
+
+		const double Timings[] = {
+			Result.ProxyCreationGameThreadMs, Result.ProxyCreationRenderThreadMs,
+			Result.SerialProxyCreationGameThreadMs, Result.SerialProxyCreationRenderThreadMs,
+			Result.UpdateGameThreadMs, Result.UpdateRenderThreadMs,
+			Result.BatchedUpdateGameThreadMs, Result.BatchedUpdateRenderThreadMs,
+			Result.GetDynamicMeshElementsMs };
+		for (int32 TimingIdx = 0; TimingIdx < UE_ARRAY_COUNT(Timings); TimingIdx++)
+		{
+			TestTrue(FString::Printf(TEXT("%d sections: timing %d is finite and not negative"), Result.NumSections, TimingIdx), FMath::IsFinite(Timings[TimingIdx]) && Timings[TimingIdx] >= 0.0);
+		}
+	}
+
+	return true;
+}
+
+#endif //WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,58 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Templates/Atomic.h"
+
+//Forward declarations
+class UStaticMesh;
+class UWorld;
+
+
+/** The timings of one section count, in milliseconds, the update and rendering timings are averaged over the frames */
+struct FDeformMeshBenchmarkResult
+{
+	int32 NumSections = 0;
+	double ProxyCreationGameThreadMs = 0.0;
+	double ProxyCreationRenderThreadMs = 0.0;
+	double SerialProxyCreationGameThreadMs = 0.0;
+	double SerialProxyCreationRenderThreadMs = 0.0;
+	double UpdateGameThreadMs = 0.0;
+	double UpdateRenderThreadMs = 0.0;
+	double BatchedUpdateGameThreadMs = 0.0;
+	double BatchedUpdateRenderThreadMs = 0.0;
+	/** Time spent in GetDynamicMeshElements() while rendering the component once, 0 without an RHI to render with (-nullrhi) */
+	double GetDynamicMeshElementsMs = 0.0;
+};
+
+/** Arguments of the benchmark, shared by the console command, the commandlet and the automation test */
+struct FDeformMeshBenchmarkSettings
+{
+	FString MeshPath = TEXT("/Engine/BasicShapes/Cube.Cube");
+	int32 NumFrames = 60;
+	TArray<int32> SectionCounts = { 1, 10, 100, 1000, 10000 };
+};
+
+class DEFORMMESH_API FDeformMeshBenchmark
+{
+public:
+
+	/** Create a component with NumSections sections in World, time its proxy creation and NumFrames frames of randomized transform updates, then destroy it */
+	static FDeformMeshBenchmarkResult Run(UWorld* World, UStaticMesh* StaticMesh, int32 NumSections, int32 NumFrames);
+
+	/** Run the benchmark for each section count of the settings. Returns false if the static mesh can't be loaded */
+	static bool RunAll(UWorld* World, const FDeformMeshBenchmarkSettings& Settings, TArray<FDeformMeshBenchmarkResult>& OutResults);
+
+	/** Write the results to a CSV file in Saved/Profiling/DeformMesh, returns its path or an empty string on failure */
+	static FString WriteReport(const TArray<FDeformMeshBenchmarkResult>& Results);
+
+	/** Create a game world that isn't shown in any viewport, to run the benchmark without a map (commandlet, automation test) */
+	static UWorld* CreateWorld();
+
+	/** Destroy a world created by CreateWorld() */
+	static void DestroyWorld(UWorld* World);
+};
+
+/** Cycles spent in GetDynamicMeshElements() by all the DeformMesh scene proxies, the benchmark reads it before and after rendering */
+extern TAtomic<uint64> GDeformMeshGetDynamicMeshElementsCycles;
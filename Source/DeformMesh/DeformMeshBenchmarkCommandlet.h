@@ -0,0 +1,25 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "DeformMeshBenchmarkCommandlet.generated.h"
+
+/**
+ *	Runs the DeformMesh benchmark in its own world and writes the CSV report to Saved/Profiling/DeformMesh, see DeformMeshBenchmark.cpp.
+ *	UE4Editor-Cmd.exe Project.uproject -run=DeformMeshBenchmark -nullrhi [-Mesh=/Game/Path/To/Mesh.Mesh] [-Frames=60] [-Sections=1,10,100,1000,10000]
+ *	Returns 1 when the benchmark can't run, so it can fail a build step.
+ */
+UCLASS()
+class UDeformMeshBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+public:
+
+	UDeformMeshBenchmarkCommandlet();
+
+	//~ Begin UCommandlet Interface.
+	virtual int32 Main(const FString& Params) override;
+	//~ End UCommandlet Interface.
+};
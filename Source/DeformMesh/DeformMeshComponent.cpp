@@ -1,4 +1,11 @@
 #include "DeformMeshComponent.h"
+#include "DeformMesh.h"
+#include "DeformMeshBVH.h"
+#include "DeformMeshSkinning.h"
+#include "DeformMeshLattice.h"
+#include "DeformMeshDeformers.h"
+#include "DeformMeshSubsystem.h"
+#include "DeformMeshBenchmark.h"
 #include "PrimitiveViewRelevance.h"
 #include "RenderResource.h"
 #include "RenderingThread.h"
@@ -10,16 +17,114 @@
 #include "Materials/Material.h"
 #include "LocalVertexFactory.h"
 #include "Engine/Engine.h"
+#include "Engine/World.h"
 #include "SceneManagement.h"
 #include "DynamicMeshBuilder.h"
 #include "StaticMeshResources.h"
 #include "MeshMaterialShader.h"
 #include "ShaderParameters.h"
 #include "RHIUtilities.h"
+#include "Stats/Stats.h"
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "Misc/AutomationTest.h"
 
 #include "MeshMaterialShader.h"
 
 
+DECLARE_STATS_GROUP(TEXT("DeformMesh"), STATGROUP_DeformMesh, STATCAT_Advanced);
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Transform Bytes Uploaded"), STAT_DeformMesh_TransformBytesUploaded, STATGROUP_DeformMesh);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Transform Buffer Locks"), STAT_DeformMesh_TransformBufferLocks, STATGROUP_DeformMesh);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Transform Update Commands"), STAT_DeformMesh_TransformUpdateCommands, STATGROUP_DeformMesh);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Previous Transforms Copies"), STAT_DeformMesh_PrevTransformsCopies, STATGROUP_DeformMesh);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Lattice Bytes Uploaded"), STAT_DeformMesh_LatticeBytesUploaded, STATGROUP_DeformMesh);
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Sections Frustum Tested"), STAT_DeformMesh_SectionsTested, STATGROUP_DeformMesh);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Sections Frustum Culled"), STAT_DeformMesh_SectionsCulled, STATGROUP_DeformMesh);
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Sections Drawn"), STAT_DeformMesh_SectionsDrawn, STATGROUP_DeformMesh);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Scene Proxy Rebuilds"), STAT_DeformMesh_ProxyRebuilds, STATGROUP_DeformMesh);
+
+DECLARE_CYCLE_STAT(TEXT("Get Dynamic Mesh Elements"), STAT_DeformMesh_GetDynamicMeshElements, STATGROUP_DeformMesh);
+DECLARE_CYCLE_STAT(TEXT("Create Scene Proxy"), STAT_DeformMesh_CreateSceneProxy, STATGROUP_DeformMesh);
+DECLARE_CYCLE_STAT(TEXT("Update Section Transform"), STAT_DeformMesh_UpdateSectionTransform, STATGROUP_DeformMesh);
+DECLARE_CYCLE_STAT(TEXT("Update Section Transforms (Batched)"), STAT_DeformMesh_UpdateSectionTransforms, STATGROUP_DeformMesh);
+DECLARE_CYCLE_STAT(TEXT("Finish Transforms Update"), STAT_DeformMesh_FinishTransformsUpdate, STATGROUP_DeformMesh);
+DECLARE_CYCLE_STAT(TEXT("Flush Pending Transforms"), STAT_DeformMesh_FlushPendingTransforms, STATGROUP_DeformMesh);
+DECLARE_CYCLE_STAT(TEXT("Update Transforms Buffer RT"), STAT_DeformMesh_UpdateTransformsBuffer, STATGROUP_DeformMesh);
+DECLARE_CYCLE_STAT(TEXT("CPU Deformation RT"), STAT_DeformMesh_CPUDeformation, STATGROUP_DeformMesh);
+DECLARE_CYCLE_STAT(TEXT("Interpolate Transforms RT"), STAT_DeformMesh_InterpolateTransforms, STATGROUP_DeformMesh);
+DECLARE_CYCLE_STAT(TEXT("Evaluate Section Hierarchy"), STAT_DeformMesh_EvaluateHierarchy, STATGROUP_DeformMesh);
+
+DECLARE_MEMORY_STAT(TEXT("Shared Index Buffers Memory Saved"), STAT_DeformMesh_SharedIndexBufferMemorySaved, STATGROUP_DeformMesh);
+DECLARE_MEMORY_STAT(TEXT("Transform Buffers Memory"), STAT_DeformMesh_TransformBufferMemory, STATGROUP_DeformMesh);
+DECLARE_MEMORY_STAT(TEXT("Section Proxies Memory"), STAT_DeformMesh_SectionProxyMemory, STATGROUP_DeformMesh);
+DECLARE_MEMORY_STAT(TEXT("CPU Deformed Positions Memory"), STAT_DeformMesh_CPUDeformBufferMemory, STATGROUP_DeformMesh);
+DECLARE_MEMORY_STAT(TEXT("Lattice Buffers Memory"), STAT_DeformMesh_LatticeBufferMemory, STATGROUP_DeformMesh);
+
+/* Time a scope with its cycle stat for "stat DeformMesh", and with a CPU event on the DeformMesh trace channel for Unreal Insights*/
+#define DEFORMMESH_SCOPE_CYCLE_COUNTER(Stat) \
+	SCOPE_CYCLE_COUNTER(Stat); \
+	TRACE_CPUPROFILER_EVENT_SCOPE_ON_CHANNEL(Stat, DeformMeshChannel)
+
+/* Cycles spent in GetDynamicMeshElements() by all the scene proxies, the benchmark reads it around the frames it renders*/
+TAtomic<uint64> GDeformMeshGetDynamicMeshElementsCycles(0);
+
+/* Add the cycles of a scope to a counter, on whatever thread it runs*/
+struct FDeformMeshScopeCycleAccumulator
+{
+	TAtomic<uint64>& Counter;
+	const uint64 StartCycles;
+
+	FDeformMeshScopeCycleAccumulator(TAtomic<uint64>& InCounter)
+		: Counter(InCounter)
+		, StartCycles(FPlatformTime::Cycles64())
+	{
+	}
+
+	~FDeformMeshScopeCycleAccumulator()
+	{
+		Counter += FPlatformTime::Cycles64() - StartCycles;
+	}
+};
+
+/* When two dirty ranges of the transforms buffer are separated by this many clean entries or less, we upload them with one lock instead of two*/
+static constexpr int32 DeformTransformsMaxMergedGap = 4;
+
+/* Below this many sections, the scene proxy prepares its sections on the game thread, the tasks would cost more than they save*/
+static constexpr int32 DeformMeshMinParallelProxySections = 64;
+
+
+static TAutoConsoleVariable<int32> CVarDeformMeshLitMaterials(
+	TEXT("DeformMesh.LitMaterials"),
+	0,
+	TEXT("Whether the deform mesh vertex factories compile the lit materials. The lit sections read the tangents of their static mesh and the normal matrices of the deform transforms.\n")
+	TEXT("0 only compiles the unlit materials, that's the cheapest path, the lit ones are drawn with the default material. Set it in the ini files, it is read when the shaders are compiled.\n")
+	TEXT("It is only read by ShouldCompilePermutation(), the vertex factories that compile a material are part of its shader map id. DEFORM_MESH_LIT comes from the shading model of each material."),
+	ECVF_ReadOnly | ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarDeformMeshParallelProxyCreation(
+	TEXT("DeformMesh.ParallelProxyCreation"),
+	1,
+	TEXT("Whether the scene proxies of the components with many sections prepare their sections on the task graph workers.\n")
+	TEXT("0 prepares them one after the other on the game thread. Their render resources are initialized by one render command either way."),
+	ECVF_Default);
+
+static inline bool IsDeformMeshLitShadingEnabled()
+{
+	return CVarDeformMeshLitMaterials.GetValueOnAnyThread() != 0;
+}
+
+/* Whether a section drawn with this material needs the tangents and the normal matrices, like DEFORM_MESH_LIT in its shaders*/
+/* The materials that can't be compiled for the vertex factory (the lit ones without DeformMesh.LitMaterials) fall back to the default material, which is lit*/
+static bool UsesDeformMeshLitShading(UMaterialInterface* Material)
+{
+	const UMaterial* BaseMaterial = Material ? Material->GetMaterial() : nullptr;
+	return BaseMaterial == nullptr || BaseMaterial->MaterialDomain != MD_Surface || !Material->GetShadingModels().IsUnlit();
+}
+
 
 //Forward Declarations
 class FDeformMeshSceneProxy;
@@ -51,16 +156,16 @@ public:
 
 	/* Should we cache the material's shadertype on this platform with this vertex factory? */
 	/* Given these parameters, we can decide which permutations should be compiled for this vertex factory*/
-	/* For example, we're only intersted in unlit materials, so we only return true when
+	/* By default we're only intersted in unlit materials, so we only return true when
 	1 Material Domain is Surface
-	2 Shading Model is Unlit
+	2 Shading Model is Unlit, or any lit shading model when DeformMesh.LitMaterials is set
 	* We also add the permutation for the default material, because if that's not found, the engine would crash
 	* That's because the default material is the fallback for all other materials, so it needs to be compiled for all vertex factories
 	*/
 	static bool ShouldCompilePermutation(const FVertexFactoryShaderPermutationParameters& Parameters)
 	{
 		if ((Parameters.MaterialParameters.MaterialDomain == MD_Surface &&
-			Parameters.MaterialParameters.ShadingModels == MSM_Unlit) ||
+			(Parameters.MaterialParameters.ShadingModels == MSM_Unlit || (IsDeformMeshLitShadingEnabled() && Parameters.MaterialParameters.ShadingModels.IsLit()))) ||
 			Parameters.MaterialParameters.bIsDefaultMaterial)
 		{
 			return true;
@@ -80,13 +185,23 @@ public:
 		}
 
 		OutEnvironment.SetDefine(TEXT("DEFORM_MESH"), TEXT("1"));
+		//No analytic deformer, the deformer vertex factories below set their own
+		OutEnvironment.SetDefine(TEXT("DEFORM_MESH_DEFORMER"), TEXT("0"));
+		//The lit materials read the tangents and deform them with the normal matrices, the unlit ones have neither
+		//This only depends on the material, the console variable can't be read here since the defines aren't part of the shader map id
+		const bool bLit = !Parameters.MaterialParameters.ShadingModels.IsUnlit();
+		OutEnvironment.SetDefine(TEXT("DEFORM_MESH_LIT"), bLit ? TEXT("1") : TEXT("0"));
 	}
 
+	/* Our copy of LocalVertexFactory.ush doesn't have the tessellation part of the engine one, the tessellated materials are drawn without it*/
+	static bool SupportsTessellationShaders() { return false; }
+
 
 	/* This is the main method that we're interested in*/
 	/* Here we can initialize our RHI resources, so we can decide what would be in the final streams and the vertex declaration*/
 	/* In the LocalVertexFactory, 3 vertex declarations are initialized; PositionOnly, PositionAndNormalOnly, and the default, which is the one that will be used in the main rendering*/
-	/* PositionOnly is mandatory if you're enabling depth passes, however we can get rid of the PositionAndNormal since we're not interested in shading and we're only supporting unlit materials*/
+	/* PositionOnly is used by the depth passes, and PositionAndNormalOnly by the shadow depth passes (the normal is needed for the normal offset bias)*/
+	/* The default declaration only has the tangents for the lit sections, the unlit ones keep the cheaper positions + texcoords stream*/
 	virtual void InitRHI() override
 	{
 
@@ -97,18 +212,52 @@ public:
 		//The vertex declaration element lists (Nothing but an array of FVertexElement)
 		FVertexDeclarationElementList Elements; //Used for the Default vertex stream
 		FVertexDeclarationElementList PosOnlyElements; // Used for the PositionOnly vertex stream
+		FVertexDeclarationElementList PosNormalElements; // Used for the PositionAndNormalOnly vertex stream
 
 		if (Data.PositionComponent.VertexBuffer != NULL)
 		{
-			//We add the position stream component to both elemnt lists
+			//We add the position stream component to all the elemnt lists
 			Elements.Add(AccessStreamComponent(Data.PositionComponent, 0));
 			PosOnlyElements.Add(AccessStreamComponent(Data.PositionComponent, 0, EVertexInputStreamType::PositionOnly));
+			PosNormalElements.Add(AccessStreamComponent(Data.PositionComponent, 0, EVertexInputStreamType::PositionAndNormalOnly));
+		}
+
+		//The normal (TangentZ) is only read by the shadow depth passes of the unlit sections, the lit ones also read it with TangentX in the main declaration
+		const bool bHasTangents = Data.TangentBasisComponents[0].VertexBuffer != NULL && Data.TangentBasisComponents[1].VertexBuffer != NULL;
+		if (bHasTangents)
+		{
+			PosNormalElements.Add(AccessStreamComponent(Data.TangentBasisComponents[1], 2, EVertexInputStreamType::PositionAndNormalOnly));
+			if (bLitShading)
+			{
+				Elements.Add(AccessStreamComponent(Data.TangentBasisComponents[0], 1));
+				Elements.Add(AccessStreamComponent(Data.TangentBasisComponents[1], 2));
+			}
+		}
+
+		//The influences of the skinned sections are needed to compute the positions, so they're part of both declarations
+		//The other sections read one zeroed influence with a stride of 0, the shader ignores it when DMSkinningMode is 0
+		if (SkinWeightBuffer != nullptr)
+		{
+			const uint32 Stride = SkinningMode == EDeformMeshSkinningMode::Rigid ? 0 : sizeof(FDeformMeshSkinInfluence);
+			const FVertexStreamComponent IndicesComponent(SkinWeightBuffer, STRUCT_OFFSET(FDeformMeshSkinInfluence, TransformIndices), Stride, VET_UShort4);
+			const FVertexStreamComponent WeightsComponent(SkinWeightBuffer, STRUCT_OFFSET(FDeformMeshSkinInfluence, Weights), Stride, VET_UByte4N);
+			Elements.Add(AccessStreamComponent(IndicesComponent, SkinIndicesAttribute));
+			Elements.Add(AccessStreamComponent(WeightsComponent, SkinWeightsAttribute));
+			PosOnlyElements.Add(AccessStreamComponent(IndicesComponent, SkinIndicesAttribute, EVertexInputStreamType::PositionOnly));
+			PosOnlyElements.Add(AccessStreamComponent(WeightsComponent, SkinWeightsAttribute, EVertexInputStreamType::PositionOnly));
+			PosNormalElements.Add(AccessStreamComponent(IndicesComponent, SkinIndicesAttribute, EVertexInputStreamType::PositionAndNormalOnly));
+			PosNormalElements.Add(AccessStreamComponent(WeightsComponent, SkinWeightsAttribute, EVertexInputStreamType::PositionAndNormalOnly));
 		}
 
 		//Initialize the Position Only vertex declaration which will be used in the depth pass
 		InitDeclaration(PosOnlyElements, EVertexInputStreamType::PositionOnly);
+		//And the Position And Normal Only one for the shadow depth passes, the renderer only uses it when the vertex factory has that stream
+		if (bHasTangents)
+		{
+			InitDeclaration(PosNormalElements, EVertexInputStreamType::PositionAndNormalOnly);
+		}
 
-		//We add all the available texcoords to the default element list, that's all what we'll need for unlit shading
+		//We add all the available texcoords to the default element list, that's all what we'll need for unlit shading (and the tangents above for lit shading)
 		if (Data.TextureCoordinates.Num())
 		{
 			const int32 BaseTexCoordAttribute = 4;
@@ -142,11 +291,39 @@ public:
 	//Setters
 	inline void SetTransformIndex(uint16 Index) { TransformIndex = Index; }
 	inline void SetSceneProxy(FDeformMeshSceneProxy* Proxy) { SceneProxy = Proxy; }
+	inline void SetSkinning(EDeformMeshSkinningMode Mode, const FVertexBuffer* Buffer) { SkinningMode = Mode; SkinWeightBuffer = Buffer; }
+	inline void SetLitShading(bool bLit) { bLitShading = bLit; }
+	inline void SetLattice(EDeformMeshLatticeMode Mode, const FIntVector& Resolution, const FBox& Box)
+	{
+		LatticeMode = Mode;
+		LatticeResolution = Resolution;
+		LatticeMin = Box.Min;
+		LatticeInvSize = FDeformMeshLattice::GetInvSize(Box);
+	}
+	inline void SetLatticeOffset(uint32 Offset) { LatticeOffset = Offset; }
+
+	//The vertex attributes of the influences (ATTRIBUTE14 : uint4 transform indices, ATTRIBUTE15 : float4 weights), after the texture coordinates
+	static constexpr uint8 SkinIndicesAttribute = 14;
+	static constexpr uint8 SkinWeightsAttribute = 15;
 private:
 	//We need to pass this as a shader parameter, so we store it in the vertex factory and we use in the vertex factory shader parameters
 	uint16 TransformIndex;
 	//All the mesh sections proxies keep a pointer to the scene proxy of the component so they can access the unified SRV
 	FDeformMeshSceneProxy* SceneProxy;
+	//How the vertices are deformed, passed as DMSkinningMode (0 = rigid, 1 = linear blend, 2 = dual quaternion)
+	EDeformMeshSkinningMode SkinningMode = EDeformMeshSkinningMode::Rigid;
+	//The influences of the vertices, or the null buffer for the rigid sections
+	const FVertexBuffer* SkinWeightBuffer = nullptr;
+	//Whether the material of the section is lit, the default declaration then has the tangents
+	bool bLitShading = false;
+	//The lattice that moves the vertices before the deformation, passed as DMLatticeMode (0 = none, 1 = trilinear, 2 = Bernstein)
+	EDeformMeshLatticeMode LatticeMode = EDeformMeshLatticeMode::None;
+	//First control point of the section in the lattice points buffer of the scene proxy, set on the render thread when the lattices are laid out
+	uint32 LatticeOffset = 0;
+	FIntVector LatticeResolution = FIntVector::ZeroValue;
+	//The box covered by the lattice, as its min corner and the inverse of its size
+	FVector LatticeMin = FVector::ZeroVector;
+	FVector LatticeInvSize = FVector::ZeroVector;
 
 	friend class FDeformMeshVertexFactoryShaderParameters;
 };
@@ -156,580 +333,4405 @@ private:
 
 
 ///////////////////////////////////////////////////////////////////////
-// The Deform Mesh Component Mesh Section Proxy
+// The analytic deformer vertex factories
 /*
- * Stores the render thread data that it is needed to render one mesh section
- 1 Vertex Data: Each mesh section creates an instance of the vertex factory(vertex streams and declarations), also each mesh section owns an index buffer
- 2 Material : Contains a pointer to the material that will be used to render this section
- 3 Other Data: Visibility, and the maximum vertex index.
+ * Each deformer is a vertex factory type of its own, so the material shaders are compiled once more per deformer, with DEFORM_MESH_DEFORMER set to its value
+ * The shader only has the math of one deformer, and the sections without a deformer keep using FDeformMeshVertexFactory which has none
+ * The parameters of the deformer are the float4 after the deform transform of the section, DMTransforms[DMTransformIndex * DMTransformStride + format stride]
+ * The deformers disabled in DeformMesh.Deformers aren't compiled at all, ShouldCompilePermutation() drops them
+ * The console variable must only be read there: the vertex factory types that compile a material are listed in its shader map id, the defines of ModifyCompilationEnvironment() aren't
+ * So changing it adds or removes a dependency of the shader maps and they are rebuilt, a define read from it would keep the shaders cached with the old value
+ * On the CPU deformation path, FDeformMeshDeformers::DeformPositions() does the same math
 */
 ///////////////////////////////////////////////////////////////////////
-class FDeformMeshSectionProxy
+template<EDeformMeshDeformer Deformer>
+struct TDeformMeshDeformerVertexFactory : FDeformMeshVertexFactory
 {
-public:
-	////////////////////////////////////////////////////////
-	/* Material applied to this section */
-	UMaterialInterface* Material;
-	/* Index buffer for this section */
-	FRawStaticIndexBuffer IndexBuffer;
-	/* Vertex factory instance for this section */
-	FDeformMeshVertexFactory VertexFactory;
-	/* Whether this section is currently visible */
-	bool bSectionVisible;
-	/* Max vertix index is an info that is needed when rendering the mesh, so we cache it here so we don't have to pointer chase it later*/
-	uint32 MaxVertexIndex;
-
-	/* For each section, we'll create a vertex factory to store the per-instance mesh data*/
-	FDeformMeshSectionProxy(ERHIFeatureLevel::Type InFeatureLevel)
-		: Material(NULL)
-		, VertexFactory(InFeatureLevel)
-		, bSectionVisible(true)
+	TDeformMeshDeformerVertexFactory(ERHIFeatureLevel::Type InFeatureLevel)
+		: FDeformMeshVertexFactory(InFeatureLevel)
 	{}
+
+	static bool ShouldCompilePermutation(const FVertexFactoryShaderPermutationParameters& Parameters)
+	{
+		return FDeformMeshDeformers::IsDeformerCompiled(Deformer) && FDeformMeshVertexFactory::ShouldCompilePermutation(Parameters);
+	}
+
+	static void ModifyCompilationEnvironment(const FVertexFactoryShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+	{
+		FDeformMeshVertexFactory::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+		OutEnvironment.SetDefine(TEXT("DEFORM_MESH_DEFORMER"), (uint32)Deformer);
+	}
 };
 
+/* The vertex factory types need a concrete class each, for their StaticType*/
+#define DECLARE_DEFORMMESH_DEFORMER_VERTEX_FACTORY(FactoryClass, Deformer) \
+	struct FactoryClass : TDeformMeshDeformerVertexFactory<Deformer> \
+	{ \
+		DECLARE_VERTEX_FACTORY_TYPE(FactoryClass); \
+	public: \
+		FactoryClass(ERHIFeatureLevel::Type InFeatureLevel) : TDeformMeshDeformerVertexFactory<Deformer>(InFeatureLevel) {} \
+	}
 
-///////////////////////////////////////////////////////////////////////
+DECLARE_DEFORMMESH_DEFORMER_VERTEX_FACTORY(FDeformMeshBendVertexFactory, EDeformMeshDeformer::Bend);
+DECLARE_DEFORMMESH_DEFORMER_VERTEX_FACTORY(FDeformMeshTwistVertexFactory, EDeformMeshDeformer::Twist);
+DECLARE_DEFORMMESH_DEFORMER_VERTEX_FACTORY(FDeformMeshTaperVertexFactory, EDeformMeshDeformer::Taper);
+DECLARE_DEFORMMESH_DEFORMER_VERTEX_FACTORY(FDeformMeshWaveVertexFactory, EDeformMeshDeformer::Wave);
 
-/* Helper function that initializes a render resource if it's not initialized, or updates it otherwise*/
-static inline void InitOrUpdateResource(FRenderResource* Resource)
+/* Create the vertex factory of a section, with the shader permutation of its deformer*/
+static FDeformMeshVertexFactory* CreateDeformMeshVertexFactory(EDeformMeshDeformer Deformer, ERHIFeatureLevel::Type FeatureLevel)
 {
-	if (!Resource->IsInitialized())
-	{
-		Resource->InitResource();
-	}
-	else
+	switch (Deformer)
 	{
-		Resource->UpdateRHI();
+	case EDeformMeshDeformer::Bend:
+		return new FDeformMeshBendVertexFactory(FeatureLevel);
+	case EDeformMeshDeformer::Twist:
+		return new FDeformMeshTwistVertexFactory(FeatureLevel);
+	case EDeformMeshDeformer::Taper:
+		return new FDeformMeshTaperVertexFactory(FeatureLevel);
+	case EDeformMeshDeformer::Wave:
+		return new FDeformMeshWaveVertexFactory(FeatureLevel);
+	default:
+		return new FDeformMeshVertexFactory(FeatureLevel);
 	}
 }
 
+///////////////////////////////////////////////////////////////////////
+
+
+
+///////////////////////////////////////////////////////////////////////
+// CPU deformation resources
 /*
- * Helper function that initializes the vertex buffers of the vertex factory's Data member from the static mesh vertex buffers
- * We're using this so we can initialize only the data that we're interested in.
+ * When the deformation is done on the CPU, each section deforms the positions of its static mesh into its own dynamic vertex buffer
+ * The deformed positions are then rendered with a regular local vertex factory, so there's no need for the transforms structured buffer
+ * This is used as a fallback on the feature levels that can't read a structured buffer in the vertex shader
 */
-static void InitVertexFactoryData(FDeformMeshVertexFactory* VertexFactory, FStaticMeshVertexBuffers* VertexBuffers)
+///////////////////////////////////////////////////////////////////////
+
+/* A dynamic vertex buffer holding the deformed positions of one section*/
+class FDeformMeshDynamicPositionBuffer : public FVertexBuffer
 {
-	ENQUEUE_RENDER_COMMAND(StaticMeshVertexBuffersLegacyInit)(
-		[VertexFactory, VertexBuffers](FRHICommandListImmediate& RHICmdList)
+public:
+	/* Number of positions in the buffer, it's the vertex count of the static mesh LOD*/
+	uint32 NumVertices = 0;
+	/* SRV of the buffer, the local vertex factory needs it for the manual vertex fetch*/
+	FShaderResourceViewRHIRef PositionSRV;
+
+	virtual void InitRHI() override
+	{
+		FRHIResourceCreateInfo CreateInfo;
+		CreateInfo.DebugName = TEXT("DeformMesh_CPUDeformedPositions");
+		VertexBufferRHI = RHICreateVertexBuffer(NumVertices * sizeof(FVector), BUF_Dynamic | BUF_ShaderResource, CreateInfo);
+		if (RHISupportsManualVertexFetch(GMaxRHIShaderPlatform))
 		{
-			//Initialize or update the RHI vertex buffers
-			InitOrUpdateResource(&VertexBuffers->PositionVertexBuffer);
-			InitOrUpdateResource(&VertexBuffers->StaticMeshVertexBuffer);
+			PositionSRV = RHICreateShaderResourceView(VertexBufferRHI, sizeof(float), PF_R32_FLOAT);
+		}
+	}
 
-			//Use the RHI vertex buffers to create the needed Vertex stream components in an FDataType instance, and then set it as the data of the vertex factory
-			FLocalVertexFactory::FDataType Data;
-			VertexBuffers->PositionVertexBuffer.BindPositionVertexBuffer(VertexFactory, Data);
-			VertexBuffers->StaticMeshVertexBuffer.BindPackedTexCoordVertexBuffer(VertexFactory, Data);
-			VertexFactory->SetData(Data);
+	virtual void ReleaseRHI() override
+	{
+		PositionSRV.SafeRelease();
+		FVertexBuffer::ReleaseRHI();
+	}
+};
 
-			//Initalize the vertex factory using the data that we just set, this will call the InitRHI() method that we implemented in out vertex factory
-			InitOrUpdateResource(VertexFactory);
-		});
-}
+/* The render data of a section that is deformed on the CPU*/
+struct FDeformMeshCPUDeformData
+{
+	/* The LOD that is deformed and drawn, only one LOD is deformed to keep the CPU cost down*/
+	int32 LODIndex;
+	/* Positions of the static mesh LOD, read on the CPU. They're owned by the static mesh, which needs to keep them with bAllowCPUAccess in cooked builds*/
+	const FPositionVertexBuffer* SourcePositions;
+	/* The deformed positions*/
+	FDeformMeshDynamicPositionBuffer PositionBuffer;
+	/* Vertex factory reading the deformed positions, and the other attributes from the static mesh*/
+	FLocalVertexFactory VertexFactory;
+
+	FDeformMeshCPUDeformData(ERHIFeatureLevel::Type InFeatureLevel)
+		: LODIndex(0)
+		, SourcePositions(nullptr)
+		, VertexFactory(InFeatureLevel, "FDeformMeshCPUDeformVertexFactory")
+	{}
+};
 
 
 
 ///////////////////////////////////////////////////////////////////////
-// The Deform Mesh Component Scene Proxy
+// Skinning resources
 /*
- * Encapsulates the render thread data of the Deform Mesh Component
- * Read more about scene proxies: https://docs.unrealengine.com/en-US/API/Runtime/Engine/FPrimitiveSceneProxy/index.html
+ * A skinned section blends the deform transforms of other sections for each vertex, with up to 4 influences per vertex
+ * The influences are a vertex buffer of FDeformMeshSkinInfluence read as two streams, the transform indices are section indices
+ * The shader reads DMTransforms[(DMTransformIndexBase + Index) * DMTransformStride] for each influence, and blends them depending on DMSkinningMode
+ * On the CPU deformation path, FDeformMeshSkinWeights::SkinPositions() does the same blending
 */
 ///////////////////////////////////////////////////////////////////////
-class FDeformMeshSceneProxy final : public FPrimitiveSceneProxy
+
+/* The influences of the vertices of one skinned section, the data is shared with the game thread section*/
+class FDeformMeshSkinWeightBuffer : public FVertexBuffer
 {
 public:
-	SIZE_T GetTypeHash() const override
+	TSharedPtr<const FDeformMeshSkinWeights, ESPMode::ThreadSafe> SkinWeights;
+
+	virtual void InitRHI() override
 	{
-		static size_t UniquePointer;
-		return reinterpret_cast<size_t>(&UniquePointer);
+		TResourceArray<FDeformMeshSkinInfluence, VERTEXBUFFER_ALIGNMENT> ResourceArray;
+		ResourceArray.Append(SkinWeights->GetInfluences());
+		FRHIResourceCreateInfo CreateInfo(&ResourceArray);
+		CreateInfo.DebugName = TEXT("DeformMesh_SkinWeights");
+		VertexBufferRHI = RHICreateVertexBuffer(ResourceArray.GetResourceDataSize(), BUF_Static, CreateInfo);
 	}
 
-	/* On construction of the Scene proxy, we'll copy all the needed data from the game thread mesh sections to create the needed render thread mesh sections' proxies*/
-	/* We'll also create the structured buffer that will contain the deform transforms of all the sections*/
-	FDeformMeshSceneProxy(UDeformMeshComponent* Component)
-		: FPrimitiveSceneProxy(Component)
-		, MaterialRelevance(Component->GetMaterialRelevance(GetScene().GetFeatureLevel()))
+	SIZE_T GetBufferBytes() const { return SkinWeights->GetNumVertices() * sizeof(FDeformMeshSkinInfluence); }
+};
+
+/* One zeroed influence, read with a stride of 0 by the rigid sections so all the vertex factories have the same inputs*/
+class FDeformMeshNullSkinWeightBuffer : public FVertexBuffer
+{
+public:
+	virtual void InitRHI() override
 	{
-		// Copy each section
-		const uint16 NumSections = Component->DeformMeshSections.Num();
+		TResourceArray<FDeformMeshSkinInfluence, VERTEXBUFFER_ALIGNMENT> ResourceArray;
+		ResourceArray.AddZeroed(1);
+		FRHIResourceCreateInfo CreateInfo(&ResourceArray);
+		CreateInfo.DebugName = TEXT("DeformMesh_NullSkinWeights");
+		VertexBufferRHI = RHICreateVertexBuffer(ResourceArray.GetResourceDataSize(), BUF_Static, CreateInfo);
+	}
+};
 
-		//Initialize the array of trnasforms and the array of mesh sections proxies
-		DeformTransforms.AddZeroed(NumSections);
-		Sections.AddZeroed(NumSections);
+static TGlobalResource<FDeformMeshNullSkinWeightBuffer> GDeformMeshNullSkinWeightBuffer;
 
-		for (uint16 SectionIdx = 0; SectionIdx < NumSections; SectionIdx++)
-		{
-			const FDeformMeshSection& SrcSection = Component->DeformMeshSections[SectionIdx];
-			{
-				//Create a new mesh section proxy
-				FDeformMeshSectionProxy* NewSection = new FDeformMeshSectionProxy(GetScene().GetFeatureLevel());
 
-				//Get the needed data from the static mesh of the mesh section
-				//We're assuming that there's only one LOD
-				auto& LODResource = SrcSection.StaticMesh->RenderData->LODResources[0];
 
-				FDeformMeshVertexFactory* VertexFactory = &NewSection->VertexFactory;
-				//Initialize the vertex factory with the vertex data from the static mesh using the helper function defined above
-				InitVertexFactoryData(VertexFactory, &(LODResource.VertexBuffers));
+///////////////////////////////////////////////////////////////////////
+// Lattice resources
+/*
+ * A section with a lattice moves its vertices by interpolating control points in the space of the static mesh, before its deform transform or its skinning
+ * The control points of all the lattices of a scene proxy are float4 elements of one structured buffer, next to the transforms, each lattice owns a contiguous range
+ * The shader reads DMLatticePoints[DMLatticeOffset + X + DMLatticeResolution.x * (Y + DMLatticeResolution.y * Z)], after bringing the vertex to the [0, 1] lattice space with DMLatticeMin and DMLatticeInvSize
+ * On the CPU deformation path, FDeformMeshLattice::DeformPositions() does the same interpolation
+*/
+///////////////////////////////////////////////////////////////////////
 
-				//Initialize the additional data using setters (Transform Index and pointer to this scene proxy that holds reference to the structured buffer and its SRV
-				VertexFactory->SetTransformIndex(SectionIdx);
-				VertexFactory->SetSceneProxy(this);
+/* One zeroed control point, bound by the proxies without lattices so the shader parameter is always valid*/
+class FDeformMeshNullLatticeBuffer : public FRenderResource
+{
+public:
+	FStructuredBufferRHIRef Buffer;
+	FShaderResourceViewRHIRef SRV;
 
-				//Copy the indices from the static mesh index buffer and use it to initialize the mesh section proxy's index buffer
-				{
-					TArray<uint32> tmp_indices;
-					LODResource.IndexBuffer.GetCopy(tmp_indices);
-					NewSection->IndexBuffer.AppendIndices(tmp_indices.GetData(), tmp_indices.Num());
-					//Initialize the render resource
-					BeginInitResource(&NewSection->IndexBuffer);
-				}
+	virtual void InitRHI() override
+	{
+		TResourceArray<FVector4>* ResourceArray = new TResourceArray<FVector4>(true);
+		ResourceArray->AddZeroed(1);
+		FRHIResourceCreateInfo CreateInfo;
+		CreateInfo.ResourceArray = ResourceArray;
+		CreateInfo.DebugName = TEXT("DeformMesh_NullLatticePointsSB");
+		Buffer = RHICreateStructuredBuffer(sizeof(FVector4), sizeof(FVector4), BUF_ShaderResource, CreateInfo);
+		SRV = RHICreateShaderResourceView(Buffer);
+	}
 
-				//Fill the array of transforms with the transform matrix from each section
-				DeformTransforms[SectionIdx] = SrcSection.DeformTransform;
+	virtual void ReleaseRHI() override
+	{
+		Buffer.SafeRelease();
+		SRV.SafeRelease();
+	}
+};
 
-				//Set the max vertex index for this mesh section
-				NewSection->MaxVertexIndex = LODResource.VertexBuffers.PositionVertexBuffer.GetNumVertices() - 1;
+static TGlobalResource<FDeformMeshNullLatticeBuffer> GDeformMeshNullLatticeBuffer;
 
-				//Get the material of this section
-				NewSection->Material = Component->GetMaterial(SectionIdx);
 
-				if (NewSection->Material == NULL)
-				{
-					NewSection->Material = UMaterial::GetDefaultMaterial(MD_Surface);
-				}
 
-				// Copy visibility info
-				NewSection->bSectionVisible = SrcSection.bSectionVisible;
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Component Mesh Section Proxy
+/*
+ * Stores the render thread data that it is needed to render one mesh section
+ 1 Vertex Data: Each mesh section creates an instance of the vertex factory(vertex streams and declarations) for each LOD of its static mesh, the index buffers are the ones of the static mesh, shared by all the sections using that mesh
+ 2 Material : Contains a pointer to the material that will be used to render this section
+ 3 Other Data: Visibility, the screen sizes used to pick the LOD, and the maximum vertex index of each LOD.
+*/
+///////////////////////////////////////////////////////////////////////
 
-				// Save ref to new section
-				Sections[SectionIdx] = NewSection;
-			}
-		}
+/* Render data of one LOD of a mesh section*/
+struct FDeformMeshSectionLOD
+{
+	/* Index buffer of this LOD, owned by the static mesh render data just like the vertex buffers, so we don't keep a copy per section*/
+	/* It also keeps the 16 bit indices of the static mesh when the vertex count allows it*/
+	const FRawStaticIndexBuffer* IndexBuffer;
+	/* Number of triangles to draw, cached from the index buffer*/
+	uint32 NumPrimitives;
+	/* Max vertix index is an info that is needed when rendering the mesh, so we cache it here so we don't have to pointer chase it later*/
+	uint32 MaxVertexIndex;
+	/* Vertex factory instance for this LOD, bound to the vertex buffers of the LOD. Its type is the shader permutation of the section's deformer*/
+	TUniquePtr<FDeformMeshVertexFactory> VertexFactory;
+	/* Vertex buffers of the static mesh LOD, owned by the static mesh. They're only kept to initialize the vertex factories on the render thread*/
+	FStaticMeshVertexBuffers* VertexBuffers;
+
+	FDeformMeshSectionLOD(ERHIFeatureLevel::Type InFeatureLevel, EDeformMeshDeformer Deformer)
+		: IndexBuffer(nullptr)
+		, NumPrimitives(0)
+		, MaxVertexIndex(0)
+		, VertexFactory(CreateDeformMeshVertexFactory(Deformer, InFeatureLevel))
+		, VertexBuffers(nullptr)
+	{}
+};
 
-		//Create the structured buffer only if we have at least one section
-		if (NumSections > 0)
-		{
-			///////////////////////////////////////////////////////////////
-			//// CREATING THE STRUCTURED BUFFER FOR THE DEFORM TRANSFORMS OF ALL THE SECTIONS
-			//We'll use one structured buffer for all the mesh sections of the component
+class FDeformMeshSectionProxy
+{
+public:
+	////////////////////////////////////////////////////////
+	/* Material applied to this section */
+	UMaterialInterface* Material;
+	/* Render data of each LOD of the static mesh, LOD 0 is the most detailed one*/
+	TIndirectArray<FDeformMeshSectionLOD> LODs;
+	/* Screen size under which each LOD stops being used, copied from the static mesh render data*/
+	float LODScreenSizes[MAX_STATIC_MESH_LODS];
+	/* Whether this section is currently visible */
+	bool bSectionVisible;
+	/* The static mesh that this section renders, only used as a key to find the sections that can be drawn with instancing, never dereferenced on the render thread*/
+	const UStaticMesh* StaticMesh;
+	/* Local space bounding box of the deformed section, sent by the game thread with each transform update. The world space bounds used for culling are computed from it*/
+	FBox LocalBox;
+	/* Only set when the section is deformed on the CPU, it's then drawn with this data instead of its LODs' vertex factories*/
+	TUniquePtr<FDeformMeshCPUDeformData> CPUDeform;
+	/* How the vertices are deformed, the skinned sections only have LOD 0*/
+	EDeformMeshSkinningMode SkinningMode;
+	/* Only set for the skinned sections, the influences of the vertices of LOD 0*/
+	TUniquePtr<FDeformMeshSkinWeightBuffer> SkinWeightBuffer;
+	/* The lattice that moves the vertices before the deformation, None without a lattice*/
+	EDeformMeshLatticeMode LatticeMode;
+	FIntVector LatticeResolution;
+	FBox LatticeBox;
+	/* First control point of this section in the lattice points of the scene proxy, INDEX_NONE until the lattices are laid out*/
+	int32 LatticeOffset;
+	/* The control points copied from the game thread, they move to the scene proxy's array when the lattices are laid out*/
+	TArray<FVector4> PendingLatticePoints;
+	/* The analytic deformer of the section, its parameters are stored after the deform transform in the scene proxy's array*/
+	EDeformMeshDeformer Deformer;
+	/* The parameters copied from the game thread, they're written in the scene proxy's array when the section is added*/
+	FVector4 DeformerParams;
+	/* Whether the material of the section is lit, its vertex factories then read the tangents and the shader uses the normal matrix of the section*/
+	bool bLitShading;
+	/* Relevance of the material, resolved on the game thread. The scene proxy's relevance is the union of its sections' relevances*/
+	FMaterialRelevance MaterialRelevance;
 
-			//We first create a resource array to use it in the create info for initializing the structured buffer on creation
-			TResourceArray<FMatrix>* ResourceArray = new TResourceArray<FMatrix>(true);
-			FRHIResourceCreateInfo CreateInfo;
-			ResourceArray->Append(DeformTransforms);
-			CreateInfo.ResourceArray = ResourceArray;
-			//Set the debug name so we can find the resource when debugging in RenderDoc
-			CreateInfo.DebugName = TEXT("DeformMesh_TransformsSB");
+	FDeformMeshSectionProxy()
+		: Material(NULL)
+		, bSectionVisible(true)
+		, StaticMesh(nullptr)
+		, LocalBox(ForceInit)
+		, SkinningMode(EDeformMeshSkinningMode::Rigid)
+		, LatticeMode(EDeformMeshLatticeMode::None)
+		, LatticeResolution(ForceInit)
+		, LatticeBox(ForceInit)
+		, LatticeOffset(INDEX_NONE)
+		, Deformer(EDeformMeshDeformer::None)
+		, DeformerParams(ForceInitToZero)
+		, bLitShading(false)
+	{
+		FMemory::Memzero(LODScreenSizes);
+	}
 
-			DeformTransformsSB = RHICreateStructuredBuffer(sizeof(FMatrix), NumSections * sizeof(FMatrix), BUF_ShaderResource, CreateInfo);
-			bDeformTransformsDirty = false;
-			///////////////////////////////////////////////////////////////
-			//// CREATING AN SRV FOR THE STRUCTUED BUFFER SO WA CAN USE IT AS A SHADER RESOURCE PARAMETER AND BIND IT TO THE VERTEX FACTORY
-			DeformTransformsSRV = RHICreateShaderResourceView(DeformTransformsSB);
+	bool HasLattice() const { return LatticeMode != EDeformMeshLatticeMode::None; }
 
-			///////////////////////////////////////////////////////////////
-		}
-	}
+	int32 GetNumLatticePoints() const { return LatticeResolution.X * LatticeResolution.Y * LatticeResolution.Z; }
 
-	virtual ~FDeformMeshSceneProxy()
+	/* Size of the 32 bit copies of the index buffers of all the LODs, that we don't make since they're shared with the static mesh*/
+	SIZE_T GetSharedIndexBufferBytes() const
 	{
-		//For each section , release the render resources
-		for (FDeformMeshSectionProxy* Section : Sections)
+		SIZE_T Bytes = 0;
+		for (const FDeformMeshSectionLOD& LOD : LODs)
 		{
-			if (Section != nullptr)
-			{
-				Section->IndexBuffer.ReleaseResource();
-				Section->VertexFactory.ReleaseResource();
-				delete Section;
-			}
+			Bytes += LOD.IndexBuffer->GetNumIndices() * sizeof(uint32);
 		}
-
-		//Release the structured buffer and the SRV
-		DeformTransformsSB.SafeRelease();
-		DeformTransformsSRV.SafeRelease();
+		return Bytes;
 	}
 
+	/* Memory used by the section proxy and its LODs on the CPU*/
+	SIZE_T GetAllocatedSize() const
+	{
+		return sizeof(*this) + LODs.GetAllocatedSize() + LODs.Num() * (sizeof(FDeformMeshSectionLOD) + sizeof(FDeformMeshVertexFactory)) + (CPUDeform.IsValid() ? sizeof(FDeformMeshCPUDeformData) : 0)
+			+ (SkinWeightBuffer.IsValid() ? sizeof(FDeformMeshSkinWeightBuffer) : 0) + PendingLatticePoints.GetAllocatedSize();
+	}
 
-	/* Update the transforms structured buffer using the array of deform transform, this will update the array on the GPU*/
-	void UpdateDeformTransformsSB_RenderThread()
+	/* Size of the dynamic buffer of the deformed positions, when the section is deformed on the CPU*/
+	SIZE_T GetCPUDeformBufferBytes() const
 	{
-		check(IsInRenderingThread());
-		//Update the structured buffer only if it needs update
-		if (bDeformTransformsDirty && DeformTransformsSB)
-		{
-			void* StructuredBufferData = RHILockStructuredBuffer(DeformTransformsSB, 0, DeformTransforms.Num() * sizeof(FMatrix), RLM_WriteOnly);
-			FMemory::Memcpy(StructuredBufferData, DeformTransforms.GetData(), DeformTransforms.Num() * sizeof(FMatrix));
-			RHIUnlockStructuredBuffer(DeformTransformsSB);
-			bDeformTransformsDirty = false;
-		}
+		return CPUDeform.IsValid() ? CPUDeform->PositionBuffer.NumVertices * sizeof(FVector) : 0;
 	}
+};
 
-	/* Update the deform transform that is being used to deform this mesh section, this will just update this section's entry in the CPU array*/
-	void UpdateDeformTransform_RenderThread(int32 SectionIndex, FMatrix Transform)
+/* Pick the LOD to draw from the screen size of the section, the same way the static meshes do it*/
+/* The first LOD (starting from the coarsest one) whose screen size threshold is bigger than the section's screen size is used, and it can't be finer than MinLOD*/
+static int32 SelectDeformMeshSectionLOD(const float* LODScreenSizes, int32 NumLODs, float ScreenSize, int32 MinLOD)
+{
+	for (int32 LODIndex = NumLODs - 1; LODIndex >= 0; LODIndex--)
 	{
-		check(IsInRenderingThread());
-		if (SectionIndex < Sections.Num() &&
-			Sections[SectionIndex] != nullptr)
+		if (ScreenSize < LODScreenSizes[LODIndex])
 		{
-			DeformTransforms[SectionIndex] = Transform;
-			//Mark as dirty
-			bDeformTransformsDirty = true;
+			return FMath::Max(LODIndex, MinLOD);
 		}
 	}
+	return MinLOD;
+}
 
-	/* Update the mesh section's visibility*/
-	void SetSectionVisibility_RenderThread(int32 SectionIndex, bool bNewVisibility)
+
+///////////////////////////////////////////////////////////////////////
+// Per section frustum culling
+/*
+ * The world space bounds of the sections are stored as a structure of arrays, so we can test 4 sections at a time against each plane of the frustum
+ * The arrays are padded to a multiple of 4 so we can always load full vector registers
+*/
+///////////////////////////////////////////////////////////////////////
+struct FDeformMeshSectionBoundsSoA
+{
+	TArray<float> CenterX;
+	TArray<float> CenterY;
+	TArray<float> CenterZ;
+	TArray<float> ExtentX;
+	TArray<float> ExtentY;
+	TArray<float> ExtentZ;
+
+	void SetNum(int32 NumSections)
 	{
-		check(IsInRenderingThread());
+		const int32 NumPadded = Align(NumSections, 4);
+		CenterX.SetNumZeroed(NumPadded);
+		CenterY.SetNumZeroed(NumPadded);
+		CenterZ.SetNumZeroed(NumPadded);
+		ExtentX.SetNumZeroed(NumPadded);
+		ExtentY.SetNumZeroed(NumPadded);
+		ExtentZ.SetNumZeroed(NumPadded);
+	}
 
-		if (SectionIndex < Sections.Num() &&
-			Sections[SectionIndex] != nullptr)
-		{
-			Sections[SectionIndex]->bSectionVisible = bNewVisibility;
-		}
+	void Set(int32 SectionIndex, const FBox& Box)
+	{
+		FVector Center, Extent;
+		Box.GetCenterAndExtents(Center, Extent);
+		CenterX[SectionIndex] = Center.X;
+		CenterY[SectionIndex] = Center.Y;
+		CenterZ[SectionIndex] = Center.Z;
+		ExtentX[SectionIndex] = Extent.X;
+		ExtentY[SectionIndex] = Extent.Y;
+		ExtentZ[SectionIndex] = Extent.Z;
 	}
 
-	/* Given the scene views and the visibility map, we add to the collector the relevant dynamic meshes that need to be rendered by this component*/
-	virtual void GetDynamicMeshElements(const TArray<const FSceneView*>& Views, const FSceneViewFamily& ViewFamily, uint32 VisibilityMap, FMeshElementCollector& Collector) const override
+	SIZE_T GetAllocatedSize() const
 	{
-		// Set up wireframe material (if needed)
-		const bool bWireframe = AllowDebugViewmodes() && ViewFamily.EngineShowFlags.Wireframe;
+		return CenterX.GetAllocatedSize() * 6;
+	}
+};
 
-		FColoredMaterialRenderProxy* WireframeMaterialInstance = NULL;
-		if (bWireframe)
+/*
+ * Test the bounds of NumSections sections against the planes of the frustum, OutVisible[i] is set to 0 when the section i is fully outside of one of the planes
+ * The planes of the frustum point outside, a box is outside of a plane when its center is farther than its projected extent (Same test as FConvexVolume::IntersectBox)
+ * Translation is added to the centers, it's the pre shadow translation when culling against a shadow frustum
+*/
+static void CullSectionBounds(const FConvexVolume& Frustum, const FVector& Translation, const FDeformMeshSectionBoundsSoA& Bounds, int32 NumSections, uint8* OutVisible)
+{
+	const VectorRegister TranslationX = VectorSetFloat1(Translation.X);
+	const VectorRegister TranslationY = VectorSetFloat1(Translation.Y);
+	const VectorRegister TranslationZ = VectorSetFloat1(Translation.Z);
+
+	for (int32 FirstSection = 0; FirstSection < NumSections; FirstSection += 4)
+	{
+		const VectorRegister CenterX = VectorAdd(VectorLoad(&Bounds.CenterX[FirstSection]), TranslationX);
+		const VectorRegister CenterY = VectorAdd(VectorLoad(&Bounds.CenterY[FirstSection]), TranslationY);
+		const VectorRegister CenterZ = VectorAdd(VectorLoad(&Bounds.CenterZ[FirstSection]), TranslationZ);
+		const VectorRegister ExtentX = VectorLoad(&Bounds.ExtentX[FirstSection]);
+		const VectorRegister ExtentY = VectorLoad(&Bounds.ExtentY[FirstSection]);
+		const VectorRegister ExtentZ = VectorLoad(&Bounds.ExtentZ[FirstSection]);
+
+		VectorRegister Outside = VectorZero();
+		for (const FPlane& Plane : Frustum.Planes)
 		{
-			WireframeMaterialInstance = new FColoredMaterialRenderProxy(
-				GEngine->WireframeMaterial ? GEngine->WireframeMaterial->GetRenderProxy() : NULL,
-				FLinearColor(0, 0.5f, 1.f)
-			);
+			const VectorRegister PlaneX = VectorSetFloat1(Plane.X);
+			const VectorRegister PlaneY = VectorSetFloat1(Plane.Y);
+			const VectorRegister PlaneZ = VectorSetFloat1(Plane.Z);
+
+			//Signed distance from the plane to the centers, and the extents projected on the normal of the plane
+			const VectorRegister Distance = VectorSubtract(VectorMultiplyAdd(PlaneX, CenterX, VectorMultiplyAdd(PlaneY, CenterY, VectorMultiply(PlaneZ, CenterZ))), VectorSetFloat1(Plane.W));
+			const VectorRegister PushOut = VectorMultiplyAdd(VectorAbs(PlaneX), ExtentX, VectorMultiplyAdd(VectorAbs(PlaneY), ExtentY, VectorMultiply(VectorAbs(PlaneZ), ExtentZ)));
+			Outside = VectorBitwiseOr(Outside, VectorCompareGT(Distance, PushOut));
+		}
 
-			Collector.RegisterOneFrameMaterialProxy(WireframeMaterialInstance);
+		const int32 OutsideMask = VectorMaskBits(Outside);
+		const int32 NumInBatch = FMath::Min(4, NumSections - FirstSection);
+		for (int32 BatchIdx = 0; BatchIdx < NumInBatch; BatchIdx++)
+		{
+			OutVisible[FirstSection + BatchIdx] = (OutsideMask & (1 << BatchIdx)) ? 0 : 1;
 		}
+	}
+}
 
-		// Iterate over sections
-		for (const FDeformMeshSectionProxy* Section : Sections)
+
+///////////////////////////////////////////////////////////////////////
+// Instanced rendering groups
+/*
+ * When instanced rendering is enabled, the visible sections that use the same static mesh and material are drawn with one mesh batch
+ * The transform indices of the sections of all the groups are stored in one array (then in a structured buffer), each group owns a contiguous range of it
+ * The vertex shader uses DMInstanceTransformIndices[DMInstanceOffset + InstanceId] as the transform index instead of DMTransformIndex
+*/
+///////////////////////////////////////////////////////////////////////
+struct FDeformMeshInstanceGroup
+{
+	/* The first section of the group, its vertex factory, index buffer and material are used to draw the whole group*/
+	const FDeformMeshSectionProxy* Section;
+	/* Where the transform indices of this group start in the instance transform indices array*/
+	uint32 FirstInstance;
+	/* Number of sections drawn by this group*/
+	uint32 NumInstances;
+};
+
+/* The sections with the same key are drawn by the same group*/
+/* The skinned sections have their own influences and the sections with a lattice have their own control points, so their key is unique to them*/
+/* The sections with a deformer are only grouped with sections using the same deformer, the vertex factory of the group has its shader permutation*/
+typedef TTuple<const UStaticMesh*, const UMaterialInterface*, EDeformMeshDeformer, const FDeformMeshSectionProxy*> FDeformMeshInstanceGroupKey;
+
+static inline FDeformMeshInstanceGroupKey GetDeformMeshInstanceGroupKey(const FDeformMeshSectionProxy* Section)
+{
+	return FDeformMeshInstanceGroupKey(Section->StaticMesh, Section->Material, Section->Deformer, (Section->SkinWeightBuffer.IsValid() || Section->HasLattice()) ? Section : nullptr);
+}
+
+/* Group the visible sections by their key, the groups are sorted by the index of their first section*/
+/* OutGroupIndices maps each key to its group, AddDeformMeshInstance() uses it to add a section without building the groups again*/
+static void BuildDeformMeshInstanceGroups(const TArray<FDeformMeshSectionProxy*>& Sections, uint32 TransformIndexBase, TArray<FDeformMeshInstanceGroup>& OutGroups, TMap<FDeformMeshInstanceGroupKey, int32>& OutGroupIndices, TArray<uint32>& OutInstanceTransformIndices)
+{
+	OutGroups.Reset();
+	OutGroupIndices.Reset();
+	OutInstanceTransformIndices.Reset();
+
+	//First pass, find the group of each visible section and count the instances of each group
+	TArray<int32> SectionGroups;
+	SectionGroups.Init(INDEX_NONE, Sections.Num());
+
+	for (int32 SectionIdx = 0; SectionIdx < Sections.Num(); SectionIdx++)
+	{
+		const FDeformMeshSectionProxy* Section = Sections[SectionIdx];
+		if (Section != nullptr && Section->bSectionVisible)
 		{
-			if (Section != nullptr && Section->bSectionVisible)
+			const FDeformMeshInstanceGroupKey Key = GetDeformMeshInstanceGroupKey(Section);
+			int32* GroupIndex = OutGroupIndices.Find(Key);
+			if (GroupIndex == nullptr)
 			{
-				//Get the section's materil, or the wireframe material if we're rendering in wireframe mode
-				FMaterialRenderProxy* MaterialProxy = bWireframe ? WireframeMaterialInstance : Section->Material->GetRenderProxy();
-
-				// For each view..
-				for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
-				{
-					//Check if our mesh is visible from this view
-					if (VisibilityMap & (1 << ViewIndex))
-					{
-						const FSceneView* View = Views[ViewIndex];
-						// Allocate a mesh batch and get a ref to the first element
-						FMeshBatch& Mesh = Collector.AllocateMesh();
-						FMeshBatchElement& BatchElement = Mesh.Elements[0];
-						//Fill this batch element with the mesh section's render data
-						BatchElement.IndexBuffer = &Section->IndexBuffer;
-						Mesh.bWireframe = bWireframe;
-						Mesh.VertexFactory = &Section->VertexFactory;
-						Mesh.MaterialRenderProxy = MaterialProxy;
-
-						//The LocalVertexFactory uses a uniform buffer to pass primitve data like the local to world transform for this frame and for the previous one
-						//Most of this data can be fetched using the helper function below
-						bool bHasPrecomputedVolumetricLightmap;
-						FMatrix PreviousLocalToWorld;
-						int32 SingleCaptureIndex;
-						bool bOutputVelocity;
-						GetScene().GetPrimitiveUniformShaderParameters_RenderThread(GetPrimitiveSceneInfo(), bHasPrecomputedVolumetricLightmap, PreviousLocalToWorld, SingleCaptureIndex, bOutputVelocity);
-						//Alloate a temporary primitive uniform buffer, fill it with the data and set it in the batch element
-						FDynamicPrimitiveUniformBuffer& DynamicPrimitiveUniformBuffer = Collector.AllocateOneFrameResource<FDynamicPrimitiveUniformBuffer>();
-						DynamicPrimitiveUniformBuffer.Set(GetLocalToWorld(), PreviousLocalToWorld, GetBounds(), GetLocalBounds(), true, bHasPrecomputedVolumetricLightmap, DrawsVelocity(), bOutputVelocity);
-						BatchElement.PrimitiveUniformBufferResource = &DynamicPrimitiveUniformBuffer.UniformBuffer;
-						BatchElement.PrimitiveIdMode = PrimID_DynamicPrimitiveShaderData;
-
-						//Additional data 
-						BatchElement.FirstIndex = 0;
-						BatchElement.NumPrimitives = Section->IndexBuffer.GetNumIndices() / 3;
-						BatchElement.MinVertexIndex = 0;
-						BatchElement.MaxVertexIndex = Section->MaxVertexIndex;
-						Mesh.ReverseCulling = IsLocalToWorldDeterminantNegative();
-						Mesh.Type = PT_TriangleList;
-						Mesh.DepthPriorityGroup = SDPG_World;
-						Mesh.bCanApplyViewModeOverrides = false;
-
-						//Add the batch to the collector
-						Collector.AddMesh(ViewIndex, Mesh);
-					}
-				}
+				GroupIndex = &OutGroupIndices.Add(Key, OutGroups.Add({ Section, 0, 0 }));
 			}
+			OutGroups[*GroupIndex].NumInstances++;
+			SectionGroups[SectionIdx] = *GroupIndex;
 		}
 	}
 
-	virtual FPrimitiveViewRelevance GetViewRelevance(const FSceneView* View) const
+	//Give each group its range, then fill the ranges with the transform indices
+	uint32 NumInstances = 0;
+	for (FDeformMeshInstanceGroup& Group : OutGroups)
 	{
-		FPrimitiveViewRelevance Result;
-		Result.bDrawRelevance = IsShown(View);
-		Result.bShadowRelevance = IsShadowCast(View);
-		Result.bDynamicRelevance = true;
-		Result.bRenderInMainPass = ShouldRenderInMainPass();
-		Result.bUsesLightingChannels = GetLightingChannelMask() != GetDefaultLightingChannelMask();
-		Result.bRenderCustomDepth = ShouldRenderCustomDepth();
-		Result.bTranslucentSelfShadow = bCastVolumetricTranslucentShadow;
-		MaterialRelevance.SetPrimitiveViewRelevance(Result);
-		Result.bVelocityRelevance = IsMovable() && Result.bOpaque && Result.bRenderInMainPass;
-		return Result;
+		Group.FirstInstance = NumInstances;
+		NumInstances += Group.NumInstances;
+		Group.NumInstances = 0;
 	}
 
-	virtual bool CanBeOccluded() const override
+	OutInstanceTransformIndices.SetNumUninitialized(NumInstances);
+	for (int32 SectionIdx = 0; SectionIdx < Sections.Num(); SectionIdx++)
 	{
-		return !MaterialRelevance.bDisableDepthTest;
+		if (SectionGroups[SectionIdx] != INDEX_NONE)
+		{
+			FDeformMeshInstanceGroup& Group = OutGroups[SectionGroups[SectionIdx]];
+			OutInstanceTransformIndices[Group.FirstInstance + Group.NumInstances++] = TransformIndexBase + SectionIdx;
+		}
 	}
+}
 
-	virtual uint32 GetMemoryFootprint(void) const
+/* Add a visible section to the groups built by BuildDeformMeshInstanceGroups(), it must come after all the sections that are already grouped*/
+/* It goes at the end of the range of its group, or starts a new last group, so the groups are the same as if they were built again*/
+/* Returns the first instance whose transform index changed, the ones before it don't need to be uploaded again*/
+static int32 AddDeformMeshInstance(const FDeformMeshSectionProxy* Section, uint32 TransformIndex, TArray<FDeformMeshInstanceGroup>& Groups, TMap<FDeformMeshInstanceGroupKey, int32>& GroupIndices, TArray<uint32>& InstanceTransformIndices)
+{
+	const FDeformMeshInstanceGroupKey Key = GetDeformMeshInstanceGroupKey(Section);
+	const int32* GroupIndex = GroupIndices.Find(Key);
+	if (GroupIndex == nullptr)
 	{
-		return(sizeof(*this) + GetAllocatedSize());
+		GroupIndices.Add(Key, Groups.Add({ Section, (uint32)InstanceTransformIndices.Num(), 1 }));
+		return InstanceTransformIndices.Add(TransformIndex);
 	}
 
-	uint32 GetAllocatedSize(void) const
+	//The ranges of the groups after this one move by one instance, they're usually few since the sections are mostly added in order
+	FDeformMeshInstanceGroup& Group = Groups[*GroupIndex];
+	const int32 NewInstance = Group.FirstInstance + Group.NumInstances++;
+	InstanceTransformIndices.Insert(TransformIndex, NewInstance);
+	for (int32 NextGroupIdx = *GroupIndex + 1; NextGroupIdx < Groups.Num(); NextGroupIdx++)
 	{
-		return(FPrimitiveSceneProxy::GetAllocatedSize());
+		Groups[NextGroupIdx].FirstInstance++;
 	}
+	return NewInstance;
+}
 
-	//Getter to the SRV of the transforms structured buffer
-	inline FShaderResourceViewRHIRef& GetDeformTransformsSRV() { return DeformTransformsSRV; }
 
-private:
-	/** Array of sections */
-	TArray<FDeformMeshSectionProxy*> Sections;
+///////////////////////////////////////////////////////////////////////
 
-	FMaterialRelevance MaterialRelevance;
+/* Helper function that initializes a render resource if it's not initialized, or updates it otherwise*/
+static inline void InitOrUpdateResource(FRenderResource* Resource)
+{
+	if (!Resource->IsInitialized())
+	{
+		Resource->InitResource();
+	}
+	else
+	{
+		Resource->UpdateRHI();
+	}
+}
 
-	//The render thread array of transforms of all the sections
-	//Individual updates of each section's deform transform will just update the entry in this array
-	//Before binding the SRV, we update the content of the structured buffer with this updated array
-	TArray<FMatrix> DeformTransforms;
+/*
+ * Helper function that initializes the vertex buffers of the vertex factory's Data member from the static mesh vertex buffers
+ * We're using this so we can initialize only the data that we're interested in.
+ * It runs on the render thread, the scene proxy initializes all the LODs of its sections with one render command
+*/
+static void InitVertexFactoryData(FDeformMeshVertexFactory* VertexFactory, FStaticMeshVertexBuffers* VertexBuffers, EDeformMeshSkinningMode SkinningMode, FDeformMeshSkinWeightBuffer* SkinWeightBuffer, bool bLitShading)
+{
+	check(IsInRenderingThread());
+
+	//Initialize or update the RHI vertex buffers
+	InitOrUpdateResource(&VertexBuffers->PositionVertexBuffer);
+	InitOrUpdateResource(&VertexBuffers->StaticMeshVertexBuffer);
+
+	//The skinned sections read their influences, the other sections read the null influence
+	if (SkinWeightBuffer != nullptr)
+	{
+		InitOrUpdateResource(SkinWeightBuffer);
+		VertexFactory->SetSkinning(SkinningMode, SkinWeightBuffer);
+	}
+	else
+	{
+		VertexFactory->SetSkinning(EDeformMeshSkinningMode::Rigid, &GDeformMeshNullSkinWeightBuffer);
+	}
+	VertexFactory->SetLitShading(bLitShading);
+
+	//Use the RHI vertex buffers to create the needed Vertex stream components in an FDataType instance, and then set it as the data of the vertex factory
+	//The tangents are always bound, the declarations pick what they need from them (see FDeformMeshVertexFactory::InitRHI())
+	FLocalVertexFactory::FDataType Data;
+	VertexBuffers->PositionVertexBuffer.BindPositionVertexBuffer(VertexFactory, Data);
+	VertexBuffers->StaticMeshVertexBuffer.BindTangentVertexBuffer(VertexFactory, Data);
+	VertexBuffers->StaticMeshVertexBuffer.BindPackedTexCoordVertexBuffer(VertexFactory, Data);
+	VertexFactory->SetData(Data);
+
+	//Initalize the vertex factory using the data that we just set, this will call the InitRHI() method that we implemented in out vertex factory
+	InitOrUpdateResource(VertexFactory);
+}
 
-	//The structured buffer that will contain all the deform transoform and going to be used as a shader resource
-	FStructuredBufferRHIRef DeformTransformsSB;
 
-	//The shader resource view of the structured buffer, this is what we bind to the vertex factory shader
-	FShaderResourceViewRHIRef DeformTransformsSRV;
 
-	//Whether the structured buffer needs to be updated or not
-	bool bDeformTransformsDirty;
+///////////////////////////////////////////////////////////////////////
+// Deform transforms packing
+/*
+ * The deform transforms are stored as float4 elements in the render thread array and the structured buffer
+ * Each section takes GetDeformTransformStride() consecutive elements, depending on the format chosen in the component
+ * - Matrix4x4 : The 4 rows of the transposed matrix (That's the same memory layout as the float4x4 we used to upload)
+ * - Matrix3x4 : The 3 first rows of the transposed matrix, the last row of an affine transform is always (0,0,0,1)
+ * - QuatTranslationScale : (Quat.X, Quat.Y, Quat.Z, Quat.W), (Translation.X, Translation.Y, Translation.Z, UniformScale)
+ *   There's no room left for a scale per axis, the component switches to Matrix3x4 when it gets a non uniform scale, see CheckTransformFormatScale()
+ * The lit sections also need the normal matrix of the transform, it's packed after the transform (and after the parameters of the deformer) by PackNormalMatrix()
+ * The shader side is in Shaders/Private/DeformMeshVertexFactory.ush, it reads the buffer as a StructuredBuffer<float4> and decodes the 3 formats
+*/
+///////////////////////////////////////////////////////////////////////
+
+/* The largest number of float4 elements that a deform transform can take */
+static constexpr int32 DeformTransformMaxStride = 4;
+
+/* Number of float4 elements that each deform transform takes for the given format */
+static inline int32 GetDeformTransformStride(EDeformMeshTransformFormat Format)
+{
+	switch (Format)
+	{
+	case EDeformMeshTransformFormat::Matrix3x4:
+		return 3;
+	case EDeformMeshTransformFormat::QuatTranslationScale:
+		return 2;
+	default:
+		return 4;
+	}
+}
+
+/* Pack a deform transform directly from the FTransform, we don't build the matrix when the format doesn't need it */
+static void PackDeformTransform(const FTransform& Transform, EDeformMeshTransformFormat Format, FVector4* OutData)
+{
+	if (Format == EDeformMeshTransformFormat::QuatTranslationScale)
+	{
+		const FQuat Rotation = Transform.GetRotation();
+		OutData[0] = FVector4(Rotation.X, Rotation.Y, Rotation.Z, Rotation.W);
+		OutData[1] = FVector4(Transform.GetTranslation(), Transform.GetMaximumAxisScale());
+		return;
+	}
+
+	const FMatrix TransformMatrix = Transform.ToMatrixWithScale().GetTransposed();
+	const int32 Stride = GetDeformTransformStride(Format);
+	for (int32 Row = 0; Row < Stride; Row++)
+	{
+		OutData[Row] = FVector4(TransformMatrix.M[Row][0], TransformMatrix.M[Row][1], TransformMatrix.M[Row][2], TransformMatrix.M[Row][3]);
+	}
+}
+
+/* Pack a deform transform from the transposed matrix that is stored in the game thread mesh section */
+static void PackDeformTransform(const FMatrix& TransposedMatrix, EDeformMeshTransformFormat Format, FVector4* OutData)
+{
+	if (Format == EDeformMeshTransformFormat::QuatTranslationScale)
+	{
+		PackDeformTransform(FTransform(TransposedMatrix.GetTransposed()), Format, OutData);
+		return;
+	}
+
+	const int32 Stride = GetDeformTransformStride(Format);
+	for (int32 Row = 0; Row < Stride; Row++)
+	{
+		OutData[Row] = FVector4(TransposedMatrix.M[Row][0], TransposedMatrix.M[Row][1], TransposedMatrix.M[Row][2], TransposedMatrix.M[Row][3]);
+	}
+}
+
+/* Number of float4 elements of the normal matrix of a deform transform, the quaternion format has a uniform scale so the shader rotates the normals with the quaternion itself */
+static inline int32 GetNormalMatrixStride(EDeformMeshTransformFormat Format)
+{
+	return Format == EDeformMeshTransformFormat::QuatTranslationScale ? 0 : 3;
+}
+
+/*
+ * Pack the normal matrix of a deform matrix, the inverse transpose of its 3x3 part, as the 3 rows of its transpose (like the transforms)
+ * It's computed once per update on the CPU, so the vertex shader never inverts a matrix
+ * The W of the first row is the sign of the determinant, the shader flips the binormals of the mirrored sections with it
+*/
+static void PackNormalMatrix(const FMatrix& DeformMatrix, FVector4* OutData)
+{
+	//The transposed adjoint is the inverse transpose times the determinant, a flat matrix keeps it since the shader normalizes the normals anyway
+	const float Determinant = DeformMatrix.RotDeterminant();
+	FMatrix NormalMatrix = DeformMatrix.TransposeAdjoint();
+	if (FMath::Abs(Determinant) > SMALL_NUMBER)
+	{
+		NormalMatrix *= 1.f / Determinant;
+	}
+
+	for (int32 Row = 0; Row < 3; Row++)
+	{
+		OutData[Row] = FVector4(NormalMatrix.M[0][Row], NormalMatrix.M[1][Row], NormalMatrix.M[2][Row], 0.f);
+	}
+	OutData[0].W = Determinant < 0.f ? -1.f : 1.f;
+}
+
+/* Get back the deform matrix from a packed deform transform, the CPU deformation needs it */
+static FMatrix UnpackDeformTransform(const FVector4* Data, EDeformMeshTransformFormat Format)
+{
+	if (Format == EDeformMeshTransformFormat::QuatTranslationScale)
+	{
+		const FQuat Rotation(Data[0].X, Data[0].Y, Data[0].Z, Data[0].W);
+		return FTransform(Rotation, FVector(Data[1]), FVector(Data[1].W)).ToMatrixWithScale();
+	}
+
+	//The rows are the ones of the transposed matrix, the last one is implicit in the 3x4 format
+	FMatrix TransposedMatrix = FMatrix::Identity;
+	const int32 Stride = GetDeformTransformStride(Format);
+	for (int32 Row = 0; Row < Stride; Row++)
+	{
+		TransposedMatrix.M[Row][0] = Data[Row].X;
+		TransposedMatrix.M[Row][1] = Data[Row].Y;
+		TransposedMatrix.M[Row][2] = Data[Row].Z;
+		TransposedMatrix.M[Row][3] = Data[Row].W;
+	}
+	return TransposedMatrix.GetTransposed();
+}
+
+/* Number of vertices that each task of the CPU deformation processes*/
+static constexpr int32 DeformPositionsChunkSize = 4096;
+
+/* Deform a range of positions, the 4 rows of the matrix are kept in registers and each position is 3 multiply-adds*/
+static void DeformPositionsRange(const FMatrix& DeformMatrix, const FVector* RESTRICT InPositions, FVector* RESTRICT OutPositions, int32 NumPositions)
+{
+	const VectorRegister Row0 = VectorLoadAligned(&DeformMatrix.M[0][0]);
+	const VectorRegister Row1 = VectorLoadAligned(&DeformMatrix.M[1][0]);
+	const VectorRegister Row2 = VectorLoadAligned(&DeformMatrix.M[2][0]);
+	const VectorRegister Row3 = VectorLoadAligned(&DeformMatrix.M[3][0]);
+
+	for (int32 Index = 0; Index < NumPositions; Index++)
+	{
+		const VectorRegister Position = VectorLoadFloat3(&InPositions[Index]);
+		VectorRegister Result = VectorMultiplyAdd(VectorReplicate(Position, 2), Row2, Row3);
+		Result = VectorMultiplyAdd(VectorReplicate(Position, 1), Row1, Result);
+		Result = VectorMultiplyAdd(VectorReplicate(Position, 0), Row0, Result);
+		VectorStoreFloat3(Result, &OutPositions[Index]);
+	}
+}
+
+/* Deform the positions in NumTasks parallel tasks, the benchmark uses it to compare the thread counts*/
+static void DeformPositionsParallel(const FMatrix& DeformMatrix, const FVector* InPositions, FVector* OutPositions, int32 NumPositions, int32 NumTasks)
+{
+	const int32 PositionsPerTask = FMath::DivideAndRoundUp(NumPositions, FMath::Max(NumTasks, 1));
+	ParallelFor(NumTasks, [&](int32 TaskIndex)
+	{
+		const int32 First = TaskIndex * PositionsPerTask;
+		const int32 Count = FMath::Min(PositionsPerTask, NumPositions - First);
+		if (Count > 0)
+		{
+			DeformPositionsRange(DeformMatrix, InPositions + First, OutPositions + First, Count);
+		}
+	}, NumTasks <= 1);
+}
+
+void UDeformMeshComponent::DeformPositions(const FMatrix& DeformMatrix, TArrayView<const FVector> InPositions, TArrayView<FVector> OutPositions)
+{
+	check(InPositions.Num() == OutPositions.Num());
+	const int32 NumPositions = InPositions.Num();
+	DeformPositionsParallel(DeformMatrix, InPositions.GetData(), OutPositions.GetData(), NumPositions, FMath::DivideAndRoundUp(NumPositions, DeformPositionsChunkSize));
+}
+
+/* Measure the CPU deformation throughput for different task counts, run "DeformMesh.BenchmarkCPUDeformation [NumVertices]" in the console*/
+static void BenchmarkCPUDeformation(const TArray<FString>& Args)
+{
+	const int32 NumVertices = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 1000000;
+	const int32 NumIterations = 20;
+
+	TArray<FVector> InPositions;
+	TArray<FVector> OutPositions;
+	InPositions.SetNumUninitialized(NumVertices);
+	OutPositions.SetNumUninitialized(NumVertices);
+	FRandomStream Random(NumVertices);
+	for (FVector& Position : InPositions)
+	{
+		Position = Random.GetUnitVector() * 100.f;
+	}
+	const FMatrix DeformMatrix = FTransform(FRotator(30.f, 45.f, 10.f), FVector(10.f, 20.f, 30.f), FVector(1.5f)).ToMatrixWithScale();
+
+	const int32 MaxTasks = FMath::Max(FTaskGraphInterface::Get().GetNumWorkerThreads() + 1, 1);
+	for (int32 NumTasks = 1; ; NumTasks = FMath::Min(NumTasks * 2, MaxTasks))
+	{
+		const double StartTime = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < NumIterations; Iteration++)
+		{
+			DeformPositionsParallel(DeformMatrix, InPositions.GetData(), OutPositions.GetData(), NumVertices, NumTasks);
+		}
+		const double Duration = FPlatformTime::Seconds() - StartTime;
+		UE_LOG(LogDeformMesh, Display, TEXT("CPU deformation, %d threads: %.2f M vertices/s"), NumTasks, (double)NumVertices * NumIterations / FMath::Max(Duration, 1e-9) / 1e6);
+
+		if (NumTasks == MaxTasks)
+		{
+			break;
+		}
+	}
+}
+
+static FAutoConsoleCommand BenchmarkCPUDeformationCommand(
+	TEXT("DeformMesh.BenchmarkCPUDeformation"),
+	TEXT("Report the CPU deformation throughput in vertices per second for each thread count. Optional argument: number of vertices"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&BenchmarkCPUDeformation));
+
+/* One packed deform transform, used to send a single transform update to the render thread */
+struct FDeformMeshPackedTransform
+{
+	FVector4 Data[DeformTransformMaxStride];
+};
+
+/*
+ * The packed payload that is sent to the render thread when multiple section transforms are updated at once
+ * The transform of SectionIndices[i] starts at Transforms[i * Stride]
+ * The format is sent along so the proxy can drop the updates packed for a format it doesn't use anymore (The proxy is being recreated in that case)
+*/
+struct FDeformMeshTransformsUpdateData
+{
+	EDeformMeshTransformFormat Format;
+	TArray<int32> SectionIndices;
+	TArray<FVector4> Transforms;
+	/* The new local boxes of the sections, used for the per section culling*/
+	TArray<FBox> SectionLocalBoxes;
+	/* World time when the transforms were sent, used to interpolate them on the render thread*/
+	float Time = 0.f;
+	/* The sections whose deformer parameters changed, with their new parameters*/
+	TArray<int32> DeformerSectionIndices;
+	TArray<FVector4> DeformerParams;
+};
+
+/*
+ * The render thread interpolation of one section's deform transform
+ * The section goes from the transform it displayed when the update arrived to the new one, over the time between its last two updates
+*/
+struct FDeformMeshSectionInterpolation
+{
+	FTransform From;
+	FTransform To;
+	/* The local box of the section at the end of the interpolation, it's the union of both boxes meanwhile*/
+	FBox ToLocalBox = FBox(ForceInit);
+	float StartTime = 0.f;
+	float Duration = 0.f;
+	/* The first update of a section is never interpolated*/
+	float LastUpdateTime = -MAX_flt;
+
+	/* Get the transform at the world time Time, translation and scale are lerped and rotation is slerped*/
+	FTransform Evaluate(float Time) const
+	{
+		const float Alpha = GetAlpha(Time);
+		if (Alpha >= 1.f)
+		{
+			return To;
+		}
+		return FTransform(
+			FQuat::Slerp(From.GetRotation(), To.GetRotation(), Alpha),
+			FMath::Lerp(From.GetTranslation(), To.GetTranslation(), Alpha),
+			FMath::Lerp(From.GetScale3D(), To.GetScale3D(), Alpha));
+	}
+
+	float GetAlpha(float Time) const
+	{
+		return Duration > 0.f ? FMath::Clamp((Time - StartTime) / Duration, 0.f, 1.f) : 1.f;
+	}
+
+	/* Reset to a transform, without interpolation*/
+	void Reset(const FTransform& Transform)
+	{
+		From = To = Transform;
+		Duration = 0.f;
+		LastUpdateTime = -MAX_flt;
+	}
 };
 
-//////////////////////////////////////////////////////////////////////////
 
 ///////////////////////////////////////////////////////////////////////
-// The DeformMesh Vertex factory shader parameters
+// The history of the deform transforms
 /*
- * We can bind shader parameters here
- * There's two types of shader parameters: FShaderPrameter and FShaderResourcePramater
- * We can use the first to pass parameters like floats, integers, arrays
- * W can use the second to pass shader resources bindings, for example Structured Buffer, texture, samplerstate, etc
- * Actually that's how manual fetch is implmented; for each of the Vertex Buffers of the stream components, an SRV is created
- * That SRV can bound as a shader resource parameter and you can fetch the buffers using the SV_VertexID
+ * The velocity pass needs the deform transforms of the previous frame, so the pool keeps two buffers: the current one and the previous one
+ * The buffers are never swapped, the cached mesh draw commands bind their SRVs and swapping them would invalidate the commands of every proxy each frame
+ * Instead, the first flush of a frame uploads to the previous buffer the ranges that changed during the last frame, with the content they had at the end of it
+ * When nothing was uploaded during the last frame, both buffers have the same content and there's nothing to copy
+ * This only tracks the ranges to upload to each buffer, without touching the RHI, so the DeformMesh.TransformsHistory automation test can check it on the CPU
 */
 ///////////////////////////////////////////////////////////////////////
-class FDeformMeshVertexFactoryShaderParameters : public FVertexFactoryShaderParameters
+struct FDeformMeshTransformsHistory
 {
-	DECLARE_TYPE_LAYOUT(FDeformMeshVertexFactoryShaderParameters, NonVirtual);
-public:
-	void Bind(const FShaderParameterMap& ParameterMap)
+	/* Mark a range (Start, End) as changed, bBothBuffers also uploads it to the previous buffer (A new range has no previous transforms)*/
+	void MarkDirty(const FIntPoint& Range, bool bBothBuffers)
 	{
-		/* We bind our shader paramters to the paramtermap that will be used with it, the SPF_Optional flags tells the compiler that this paramter is optional*/
-		/* Otherwise, the shader compiler will complain when this parameter is not present in the shader file*/
-		TransformIndex.Bind(ParameterMap, TEXT("DMTransformIndex"), SPF_Optional);
-		TransformsSRV.Bind(ParameterMap, TEXT("DMTransforms"), SPF_Optional);
-	};
+		CurrentDirtyRanges.Add(Range);
+		if (bBothBuffers)
+		{
+			PreviousDirtyRanges.Add(Range);
+		}
+	}
 
-	void GetElementShaderBindings(
-		const class FSceneInterface* Scene,
-		const FSceneView* View,
-		const class FMeshMaterialShader* Shader,
-		const EVertexInputStreamType InputStreamType,
-		ERHIFeatureLevel::Type FeatureLevel,
-		const FVertexFactory* VertexFactory,
-		const FMeshBatchElement& BatchElement,
-		class FMeshDrawSingleShaderBindings& ShaderBindings,
-		FVertexInputStreamArray& VertexStreams
-	) const
+	bool HasDirtyRanges() const
 	{
-		if (BatchElement.bUserDataIsColorVertexBuffer)
+		return CurrentDirtyRanges.Num() > 0 || PreviousDirtyRanges.Num() > 0 || ResyncRanges.Num() > 0;
+	}
+
+	/* Called at the start of each flush, the first flush of a frame has to bring the previous buffer to the end of the last frame. Returns true for that first flush*/
+	bool BeginFlush(uint32 FrameNumber)
+	{
+		if (bHasFlushed && FrameNumber == LastFlushFrame)
 		{
-			const auto* LocalVertexFactory = static_cast<const FLocalVertexFactory*>(VertexFactory);
-			FColorVertexBuffer* OverrideColorVertexBuffer = (FColorVertexBuffer*)BatchElement.UserData;
-			check(OverrideColorVertexBuffer);
+			return false;
+		}
+		bHasFlushed = true;
+		LastFlushFrame = FrameNumber;
 
-			if (!LocalVertexFactory->SupportsManualVertexFetch(FeatureLevel))
+		//The previous buffer misses what changed during the last frame
+		ResyncRanges = MoveTemp(LastFrameRanges);
+		LastFrameRanges.Reset();
+		return true;
+	}
+
+	/* Get the merged ranges to upload, and remember the changed ones for the next frame*/
+	/* OutResyncRanges go to the previous buffer with the content of the current buffer before this flush (The end of the last frame)*/
+	/* OutCurrentRanges go to the current buffer, then OutPreviousRanges go to the previous buffer, both with the new content*/
+	void EndFlush(int32 MaxGap, int32 Capacity, TArray<FIntPoint>& OutCurrentRanges, TArray<FIntPoint>& OutResyncRanges, TArray<FIntPoint>& OutPreviousRanges)
+	{
+		LastFrameRanges.Append(CurrentDirtyRanges);
+		MergeRanges(CurrentDirtyRanges, MaxGap, Capacity, OutCurrentRanges);
+		MergeRanges(ResyncRanges, MaxGap, Capacity, OutResyncRanges);
+		MergeRanges(PreviousDirtyRanges, MaxGap, Capacity, OutPreviousRanges);
+		CurrentDirtyRanges.Reset();
+		PreviousDirtyRanges.Reset();
+		ResyncRanges.Reset();
+	}
+
+	/* Both buffers were recreated with the same content, there's nothing left to upload*/
+	void Reset()
+	{
+		CurrentDirtyRanges.Reset();
+		PreviousDirtyRanges.Reset();
+		ResyncRanges.Reset();
+		LastFrameRanges.Reset();
+	}
+
+	/* Sort the ranges and merge the overlapping and close ones, so one lock covers them*/
+	static void MergeRanges(TArray<FIntPoint>& Ranges, int32 MaxGap, int32 Capacity, TArray<FIntPoint>& OutMergedRanges)
+	{
+		OutMergedRanges.Reset();
+		Ranges.Sort([](const FIntPoint& A, const FIntPoint& B) { return A.X < B.X; });
+		for (const FIntPoint& Range : Ranges)
+		{
+			if (OutMergedRanges.Num() > 0 && Range.X - OutMergedRanges.Last().Y <= MaxGap)
 			{
-				LocalVertexFactory->GetColorOverrideStream(OverrideColorVertexBuffer, VertexStreams);
+				OutMergedRanges.Last().Y = FMath::Max(OutMergedRanges.Last().Y, Range.Y);
+			}
+			else
+			{
+				OutMergedRanges.Add(Range);
+			}
+		}
+		for (int32 RangeIdx = OutMergedRanges.Num() - 1; RangeIdx >= 0; RangeIdx--)
+		{
+			OutMergedRanges[RangeIdx].Y = FMath::Min(OutMergedRanges[RangeIdx].Y, Capacity);
+			if (OutMergedRanges[RangeIdx].X >= OutMergedRanges[RangeIdx].Y)
+			{
+				OutMergedRanges.RemoveAt(RangeIdx);
 			}
 		}
-		const FDeformMeshVertexFactory* DeformMeshVertexFactory = ((FDeformMeshVertexFactory*)VertexFactory);
+	}
+
+	/* The ranges (Start, End) to upload on the next flush, in no particular order*/
+	TArray<FIntPoint> CurrentDirtyRanges;
+	TArray<FIntPoint> PreviousDirtyRanges;
+	/* The ranges that changed since the first flush of the last frame*/
+	TArray<FIntPoint> LastFrameRanges;
+	/* The ranges that changed during the last frame, to copy to the previous buffer on the first flush of this frame*/
+	TArray<FIntPoint> ResyncRanges;
+	uint32 LastFlushFrame = 0;
+	bool bHasFlushed = false;
+};
+
+
+///////////////////////////////////////////////////////////////////////
+// The pool of deform transforms
+/*
+ * The deform transforms of all the scene proxies of a scene live in one structured buffer, each proxy owns a range of it
+ * Each scene has its own pool, so the worlds (PIE instances, editor previews, ...) don't share their buffers and each world subsystem only flushes its own pool
+ * The proxies keep their transforms in their CPU arrays, and only tell the pool which ranges are dirty
+ * The dirty ranges of all the proxies are then uploaded together, so a frame where many components moved costs a few locks instead of a few per component
+ * Each range starts at a multiple of the transform stride of its proxy, so the shader finds the transform of a section at (RangeStart / Stride + SectionIndex) * Stride
+ * A second buffer with the same layout keeps the transforms of the previous frame for the velocity pass, see FDeformMeshTransformsHistory
+ * The pool keeps a copy of what it uploaded to the current buffer, the previous buffer gets its ranges from it once the proxies already have the transforms of the new frame
+ * Both buffers keep the same SRVs until the pool grows, so the cached mesh draw commands stay valid
+ * This is only used on the render thread
+*/
+///////////////////////////////////////////////////////////////////////
+class FDeformMeshTransformsPool : public FRenderResource
+{
+public:
+	/* Get the pool of a scene, it's created by the first proxy of the scene that allocates transforms*/
+	static FDeformMeshTransformsPool& Get(const FSceneInterface* Scene);
+
+	/* Find the pool of a scene, null when no proxy of the scene has transforms in a pool*/
+	static FDeformMeshTransformsPool* Find(const FSceneInterface* Scene);
+
+	/* Release the pool of a scene once its last range was freed, the proxies of the scene are all removed before the scene is destroyed*/
+	static void ReleaseIfUnused(const FSceneInterface* Scene);
+
+	/* Allocate a range of NumElements float4 elements for a proxy, the buffers grow if there's no free range big enough*/
+	int32 Allocate(FDeformMeshSceneProxy* Owner, int32 NumElements, int32 Alignment);
+
+	/* Free the range starting at Offset*/
+	void Free(int32 Offset);
+
+	/* Mark a range of elements as changed, they're uploaded on the next Flush_RenderThread(). bBothBuffers also uploads them to the buffer of the previous frame*/
+	void MarkDirty(int32 Offset, int32 NumElements, bool bBothBuffers = false)
+	{
+		History.MarkDirty(FIntPoint(Offset, Offset + NumElements), bBothBuffers);
+	}
+
+	/* Copy the last frame's changes to the previous buffer on the first flush of a frame, and upload all the dirty ranges*/
+	void Flush_RenderThread();
+
+	FShaderResourceViewRHIRef& GetSRV() { return SRV; }
+
+	FShaderResourceViewRHIRef& GetPrevSRV() { return PrevSRV; }
+
+	virtual void ReleaseRHI() override
+	{
+		DEC_MEMORY_STAT_BY(STAT_DeformMesh_TransformBufferMemory, 2 * Capacity * sizeof(FVector4));
+		Buffer.SafeRelease();
+		SRV.SafeRelease();
+		PrevBuffer.SafeRelease();
+		PrevSRV.SafeRelease();
+		UploadedTransforms.Empty();
+		Capacity = 0;
+	}
+
+private:
+	/* Recreate both buffers with room for NewCapacity elements, and fill them with the transforms of all the proxies*/
+	void Grow(int32 NewCapacity);
+
+	/* Copy the transforms of all the proxies overlapping merged ranges to UploadedTransforms, the gaps between the proxies are zeroed*/
+	void GatherRanges(const TArray<FIntPoint>& Ranges);
+
+	/* Upload merged ranges of UploadedTransforms to one of the buffers*/
+	void UploadRanges(FRHIStructuredBuffer* TargetBuffer, const TArray<FIntPoint>& Ranges);
+
+	struct FAllocation
+	{
+		int32 Offset;
+		int32 NumElements;
+		FDeformMeshSceneProxy* Owner;
+	};
+
+	/* The allocated ranges, sorted by offset*/
+	TArray<FAllocation> Allocations;
+	/* The ranges to upload to each buffer*/
+	FDeformMeshTransformsHistory History;
+
+	FStructuredBufferRHIRef Buffer;
+	FShaderResourceViewRHIRef SRV;
+	/* The transforms of the previous frame*/
+	FStructuredBufferRHIRef PrevBuffer;
+	FShaderResourceViewRHIRef PrevSRV;
+	/* Content of the current buffer, Capacity elements*/
+	TArray<FVector4> UploadedTransforms;
+	/* Size of each buffer in float4 elements*/
+	int32 Capacity = 0;
+};
+
+/* The pool of each scene, only used on the render thread*/
+static TMap<const FSceneInterface*, TUniquePtr<FDeformMeshTransformsPool>> GDeformMeshTransformsPools;
+
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Component Scene Proxy
+/*
+ * Encapsulates the render thread data of the Deform Mesh Component
+ * Read more about scene proxies: https://docs.unrealengine.com/en-US/API/Runtime/Engine/FPrimitiveSceneProxy/index.html
+*/
+///////////////////////////////////////////////////////////////////////
+class FDeformMeshSceneProxy final : public FPrimitiveSceneProxy
+{
+public:
+	SIZE_T GetTypeHash() const override
+	{
+		static size_t UniquePointer;
+		return reinterpret_cast<size_t>(&UniquePointer);
+	}
+
+	/* On construction of the Scene proxy, we'll copy all the needed data from the game thread mesh sections to create the needed render thread mesh sections' proxies*/
+	/* The range of the pooled structured buffer that contains the deform transforms of all the sections is allocated later, on the render thread*/
+	FDeformMeshSceneProxy(UDeformMeshComponent* Component)
+		: FPrimitiveSceneProxy(Component)
+		, TransformFormat(Component->TransformFormat)
+		, TransformStride(GetDeformTransformStride(Component->TransformFormat))
+		, bLitSections(Component->HasLitSections())
+		//The normal matrices are only read from the structured buffer, the CPU deformation keeps the tangents of the static meshes
+		, NormalMatrixStride(bLitSections && !ShouldUseCPUDeformation(Component, GetScene().GetFeatureLevel()) ? GetNormalMatrixStride(Component->TransformFormat) : 0)
+		//The parameters of the deformers take one more float4 per section, only when a section of the component has a deformer, and the normal matrices go last
+		, SectionStride(TransformStride + (Component->HasSectionDeformers() ? 1 : 0) + NormalMatrixStride)
+		, TransformsCapacity(0)
+		, TransformsPoolOffset(INDEX_NONE)
+		, TransformsPool(nullptr)
+		, SharedIndexBufferBytes(0)
+		, TransformsBufferBytes(0)
+		, bDeformTransformsDirty(false)
+		//Instancing needs the transforms structured buffer, it can't be used with the CPU deformation
+		, bInstancedRendering(Component->bUseInstancedRendering && !ShouldUseCPUDeformation(Component, GetScene().GetFeatureLevel()))
+		, bUseStaticDrawPath(Component->bUseStaticDrawPath)
+		, bStaticMeshesStale(false)
+		, TransformsChangeFrame(0)
+		, ForcedLOD(Component->ForcedLodModel > 0 ? Component->ForcedLodModel - 1 : INDEX_NONE)
+		, MinLOD(FMath::Max(Component->MinLOD, 0))
+		, bCPUDeformation(ShouldUseCPUDeformation(Component, GetScene().GetFeatureLevel()))
+		, bInterpolateTransforms(Component->bInterpolateTransforms)
+		, MaxInterpolationInterval(Component->MaxInterpolationInterval)
+		, LatticePointsCapacity(0)
+	{
+		//Sections can be added in place later on, with materials that the component didn't have when this proxy was created
+		//So we can't rely on the list of used materials that the base class gathered to verify the materials of our mesh batches
+		bVerifyUsedMaterials = false;
+
+		//The sections move without the primitive moving, so bAlwaysHasVelocity is set while the transforms differ from the previous frame's, see SetTransformsVelocity_RenderThread()
+
+		// Copy each section
+		const uint16 NumSections = Component->DeformMeshSections.Num();
+
+		//Initialize the array of trnasforms and the array of mesh sections proxies
+		DeformTransforms.AddZeroed(NumSections * SectionStride);
+		DirtyTransforms.Init(false, NumSections);
+		Sections.AddZeroed(NumSections);
+		//The world bounds are computed in OnTransformChanged(), once the local to world transform is known
+		SectionWorldBounds.SetNum(NumSections);
+		if (bInterpolateTransforms)
+		{
+			SectionInterpolations.SetNum(NumSections);
+			InterpolatingSections.Init(false, NumSections);
+		}
+
+		//The materials are resolved on the game thread first, the material instances can only walk their parents there
+		TArray<UMaterialInterface*> Materials;
+		TBitArray<> LitSections(false, NumSections);
+		Materials.SetNumZeroed(NumSections);
+		for (int32 SectionIdx = 0; SectionIdx < NumSections; SectionIdx++)
+		{
+			if (Component->DeformMeshSections[SectionIdx].StaticMesh != nullptr)
+			{
+				Materials[SectionIdx] = Component->GetMaterial(SectionIdx);
+				LitSections[SectionIdx] = UsesDeformMeshLitShading(Materials[SectionIdx]);
+			}
+		}
+
+		//The sections are prepared on the task graph workers, each task only writes the entries of its own section
+		//The game thread waits for them, so the component is only read meanwhile
+		const bool bParallel = NumSections >= DeformMeshMinParallelProxySections && CVarDeformMeshParallelProxyCreation.GetValueOnGameThread() != 0;
+		ParallelFor(NumSections, [this, Component, &Materials, &LitSections](int32 SectionIdx)
+		{
+			const FDeformMeshSection& SrcSection = Component->DeformMeshSections[SectionIdx];
+
+			//Cleared sections don't have a static mesh, we keep a null entry so the other sections don't change index
+			if (SrcSection.StaticMesh == nullptr)
+			{
+				return;
+			}
+
+			//Create a new mesh section proxy and save a ref to it, its render resources are initialized below
+			Sections[SectionIdx] = PrepareSectionProxy(SectionIdx, SrcSection, Materials[SectionIdx], LitSections[SectionIdx]);
+
+			//Fill the array of transforms with the transform matrix from each section, packed in the format of this proxy
+			PackDeformTransform(SrcSection.DeformTransform, TransformFormat, &DeformTransforms[SectionIdx * SectionStride]);
+			if (HasDeformerParams())
+			{
+				DeformTransforms[SectionIdx * SectionStride + TransformStride] = Sections[SectionIdx]->DeformerParams;
+			}
+			if (NormalMatrixStride > 0)
+			{
+				PackNormalMatrix(SrcSection.DeformTransform.GetTransposed(), &DeformTransforms[SectionIdx * SectionStride + GetNormalMatrixOffset()]);
+			}
+			if (bInterpolateTransforms)
+			{
+				SectionInterpolations[SectionIdx].Reset(FTransform(SrcSection.DeformTransform.GetTransposed()));
+			}
+		}, !bParallel);
+
+		//The render resources of all the sections are initialized by one render command, instead of one command per LOD of each section
+		TArray<FDeformMeshSectionProxy*> NewSections;
+		NewSections.Reserve(NumSections);
+		for (FDeformMeshSectionProxy* Section : Sections)
+		{
+			if (Section != nullptr)
+			{
+				AddSectionMemoryStats(Section);
+				Section->MaterialRelevance = Section->Material->GetRelevance_Concurrent(GetScene().GetFeatureLevel());
+				MaterialRelevance |= Section->MaterialRelevance;
+				NewSections.Add(Section);
+			}
+		}
+		if (NewSections.Num() > 0)
+		{
+			ENQUEUE_RENDER_COMMAND(InitDeformMeshSections)(
+				[NewSections = MoveTemp(NewSections)](FRHICommandListImmediate& RHICmdList)
+			{
+				for (FDeformMeshSectionProxy* Section : NewSections)
+				{
+					InitSectionResources_RenderThread(Section);
+				}
+			});
+		}
+
+		if (bCPUDeformation)
+		{
+			//There's no structured buffer to grow, and all the sections are deformed once the render resources are created
+			TransformsCapacity = MAX_int32;
+			DirtyTransforms.Init(true, NumSections);
+			bDeformTransformsDirty = NumSections > 0;
+		}
+	}
+
+	/* The sections are deformed on the CPU when the component asks for it, or when the feature level can't read the structured buffer in the vertex shader*/
+	static bool ShouldUseCPUDeformation(const UDeformMeshComponent* Component, ERHIFeatureLevel::Type FeatureLevel)
+	{
+		return Component->bUseCPUDeformation || FeatureLevel < ERHIFeatureLevel::SM5;
+	}
+
+	/* Called on the render thread once the proxy is added to the scene, before its static meshes are cached*/
+	/* The sections deformed on the CPU get their first positions here, the others get their range in the transforms pool*/
+	/* The lattices are laid out first, the CPU deformation reads their control points*/
+	virtual void CreateRenderThreadResources() override
+	{
+		UpdateLatticeLayout_RenderThread();
+
+		if (bCPUDeformation)
+		{
+			UpdateDeformTransformsSB_RenderThread();
+		}
+		//Allocate the transforms only if we have at least one section
+		else if (Sections.Num() > 0)
+		{
+			CreateTransformsBuffers(Sections.Num());
+			TransformsPool->Flush_RenderThread();
+		}
+	}
+
+	/* Create the render thread proxy of one mesh section, and enqueue the initialization of its render resources*/
+	/* This is called from the game thread when a section is added or replaced in place*/
+	FDeformMeshSectionProxy* CreateSectionProxy(int32 SectionIdx, const FDeformMeshSection& SrcSection, UMaterialInterface* Material)
+	{
+		FDeformMeshSectionProxy* NewSection = PrepareSectionProxy(SectionIdx, SrcSection, Material, UsesDeformMeshLitShading(Material));
+		NewSection->MaterialRelevance = NewSection->Material->GetRelevance_Concurrent(GetScene().GetFeatureLevel());
+		ENQUEUE_RENDER_COMMAND(InitDeformMeshSection)(
+			[NewSection](FRHICommandListImmediate& RHICmdList)
+		{
+			InitSectionResources_RenderThread(NewSection);
+		});
+		return NewSection;
+	}
+
+	/* Create the render thread proxy of one mesh section, without its render resources (see InitSectionResources_RenderThread())*/
+	/* It only reads the section and the static mesh, so the constructor calls it from worker threads for several sections at once*/
+	/* bLitMaterial is UsesDeformMeshLitShading(Material), resolved by the caller on the game thread*/
+	FDeformMeshSectionProxy* PrepareSectionProxy(int32 SectionIdx, const FDeformMeshSection& SrcSection, UMaterialInterface* Material, bool bLitMaterial)
+	{
+		//Create a new mesh section proxy
+		FDeformMeshSectionProxy* NewSection = new FDeformMeshSectionProxy();
+		const ERHIFeatureLevel::Type FeatureLevel = GetScene().GetFeatureLevel();
+
+		//The influences of a skinned section are given for the vertices of LOD 0, so it only has that LOD
+		if (SrcSection.IsSkinned())
+		{
+			NewSection->SkinningMode = SrcSection.SkinningMode;
+			NewSection->SkinWeightBuffer = MakeUnique<FDeformMeshSkinWeightBuffer>();
+			NewSection->SkinWeightBuffer->SkinWeights = SrcSection.SkinWeights;
+		}
+
+		//The control points go to the lattice points of this proxy once the render thread lays out the lattices
+		if (SrcSection.HasLattice())
+		{
+			NewSection->LatticeMode = SrcSection.LatticeMode;
+			NewSection->LatticeResolution = SrcSection.LatticeResolution;
+			NewSection->LatticeBox = SrcSection.LatticeBox;
+			NewSection->PendingLatticePoints.Reserve(SrcSection.LatticePoints.Num());
+			for (const FVector& Point : SrcSection.LatticePoints)
+			{
+				NewSection->PendingLatticePoints.Add(FVector4(Point, 0.f));
+			}
+		}
+
+		//The parameters go after the deform transform of the section, a proxy created without room for them can't have deformers (the component recreates it)
+		//The component already dropped the deformers that aren't compiled, their vertex factory type would have no shaders
+		if (SrcSection.HasDeformer() && HasDeformerParams() && FDeformMeshDeformers::IsDeformerCompiled(SrcSection.Deformer))
+		{
+			NewSection->Deformer = SrcSection.Deformer;
+			NewSection->DeformerParams = SrcSection.DeformerParams;
+		}
+
+		//The lit sections need the normal matrices after the transforms, a proxy created without lit sections has no room for them (the component recreates it)
+		NewSection->bLitShading = HasLitSections() && bLitMaterial;
+
+		//Get the needed data from each LOD of the static mesh of the mesh section
+		FStaticMeshRenderData* RenderData = SrcSection.StaticMesh->RenderData.Get();
+		const int32 NumLODs = NewSection->SkinWeightBuffer.IsValid() ? 1 : FMath::Min(RenderData->LODResources.Num(), MAX_STATIC_MESH_LODS);
+		for (int32 LODIndex = 0; LODIndex < NumLODs; LODIndex++)
+		{
+			FStaticMeshLODResources& LODResource = RenderData->LODResources[LODIndex];
+			FDeformMeshSectionLOD* LOD = new FDeformMeshSectionLOD(FeatureLevel, NewSection->Deformer);
+			NewSection->LODs.Add(LOD);
+			NewSection->LODScreenSizes[LODIndex] = RenderData->ScreenSize[LODIndex].GetValue();
+
+			//Use the index buffer of the static mesh directly, it's already initialized and it's shared by all the sections using the same mesh
+			//Just like the vertex buffers, it stays alive as long as the component references the static mesh
+			LOD->IndexBuffer = &LODResource.IndexBuffer;
+			LOD->NumPrimitives = LODResource.IndexBuffer.GetNumIndices() / 3;
+
+			//Set the max vertex index for this LOD
+			LOD->MaxVertexIndex = LODResource.VertexBuffers.PositionVertexBuffer.GetNumVertices() - 1;
+			LOD->VertexBuffers = &LODResource.VertexBuffers;
+
+			//The sections deformed on the CPU don't use the vertex factories of the LODs
+			if (bCPUDeformation)
+			{
+				continue;
+			}
+
+			FDeformMeshVertexFactory* VertexFactory = LOD->VertexFactory.Get();
+			//Initialize the additional data using setters (Transform Index and pointer to this scene proxy that holds reference to the structured buffer and its SRV
+			//All the LODs of a section share the same deform transform
+			VertexFactory->SetTransformIndex(SectionIdx);
+			VertexFactory->SetSceneProxy(this);
+			VertexFactory->SetLattice(NewSection->LatticeMode, NewSection->LatticeResolution, NewSection->LatticeBox);
+		}
+
+		if (bCPUDeformation)
+		{
+			InitCPUDeformData(NewSection, FeatureLevel);
+		}
+
+		//Set the material of this section
+		NewSection->Material = Material;
+
+		if (NewSection->Material == NULL)
+		{
+			NewSection->Material = UMaterial::GetDefaultMaterial(MD_Surface);
+		}
+
+		// Copy visibility info
+		NewSection->bSectionVisible = SrcSection.bSectionVisible;
+
+		NewSection->StaticMesh = SrcSection.StaticMesh;
+		NewSection->LocalBox = SrcSection.SectionLocalBox;
+
+		return NewSection;
+	}
+
+	/* Create the CPU deformation data of a section, its dynamic position buffer and the local vertex factory that reads it, they're initialized with the other render resources of the section*/
+	/* Only the fixed LOD of the section is deformed, there's no per view LOD selection in this mode*/
+	void InitCPUDeformData(FDeformMeshSectionProxy* Section, ERHIFeatureLevel::Type FeatureLevel)
+	{
+		FDeformMeshCPUDeformData* CPUDeform = new FDeformMeshCPUDeformData(FeatureLevel);
+		Section->CPUDeform.Reset(CPUDeform);
+		CPUDeform->LODIndex = GetFixedSectionLOD(Section);
+
+		const FStaticMeshVertexBuffers* VertexBuffers = Section->LODs[CPUDeform->LODIndex].VertexBuffers;
+		CPUDeform->SourcePositions = &VertexBuffers->PositionVertexBuffer;
+		CPUDeform->PositionBuffer.NumVertices = VertexBuffers->PositionVertexBuffer.GetNumVertices();
+	}
+
+	/* Initialize the render resources of a section prepared by PrepareSectionProxy(), the vertex factories of its LODs or its CPU deformation data*/
+	static void InitSectionResources_RenderThread(FDeformMeshSectionProxy* Section)
+	{
+		check(IsInRenderingThread());
+
+		if (Section->CPUDeform.IsValid())
+		{
+			FDeformMeshCPUDeformData* CPUDeform = Section->CPUDeform.Get();
+			FStaticMeshVertexBuffers* VertexBuffers = Section->LODs[CPUDeform->LODIndex].VertexBuffers;
+			InitOrUpdateResource(&CPUDeform->PositionBuffer);
+
+			//The positions come from our dynamic buffer, the other attributes are read from the static mesh as usual
+			FLocalVertexFactory::FDataType Data;
+			Data.PositionComponent = FVertexStreamComponent(&CPUDeform->PositionBuffer, 0, sizeof(FVector), VET_Float3);
+			Data.PositionComponentSRV = CPUDeform->PositionBuffer.PositionSRV;
+			VertexBuffers->StaticMeshVertexBuffer.BindTangentVertexBuffer(&CPUDeform->VertexFactory, Data);
+			VertexBuffers->StaticMeshVertexBuffer.BindPackedTexCoordVertexBuffer(&CPUDeform->VertexFactory, Data);
+			VertexBuffers->ColorVertexBuffer.BindColorVertexBuffer(&CPUDeform->VertexFactory, Data);
+			CPUDeform->VertexFactory.SetData(Data);
+
+			InitOrUpdateResource(&CPUDeform->VertexFactory);
+			return;
+		}
+
+		//Initialize the vertex factory of each LOD with the vertex data from the static mesh using the helper function defined above
+		for (FDeformMeshSectionLOD& LOD : Section->LODs)
+		{
+			InitVertexFactoryData(LOD.VertexFactory.Get(), LOD.VertexBuffers, Section->SkinningMode, Section->SkinWeightBuffer.Get(), Section->bLitShading);
+		}
+	}
+
+	/* Deform the positions of the dirty sections on the CPU, and write them to their dynamic position buffers*/
+	void UpdateCPUDeformedPositions_RenderThread()
+	{
+		check(IsInRenderingThread());
+		if (!bDeformTransformsDirty)
+		{
+			return;
+		}
+		DEFORMMESH_SCOPE_CYCLE_COUNTER(STAT_DeformMesh_CPUDeformation);
+
+		TArray<FVector> MeshSpaceScratch;
+		for (TConstSetBitIterator<> It(DirtyTransforms); It; ++It)
+		{
+			const int32 SectionIndex = It.GetIndex();
+			const FDeformMeshSectionProxy* Section = Sections[SectionIndex];
+			if (Section == nullptr || !Section->CPUDeform.IsValid() || Section->SkinWeightBuffer.IsValid())
+			{
+				continue;
+			}
+
+			const FDeformMeshCPUDeformData& CPUDeform = *Section->CPUDeform;
+			const FVector* SourcePositions = (const FVector*)CPUDeform.SourcePositions->GetVertexData();
+			const int32 NumVertices = CPUDeform.PositionBuffer.NumVertices;
+			//The static mesh doesn't keep its positions on the CPU, it needs bAllowCPUAccess in cooked builds
+			if (SourcePositions == nullptr || NumVertices == 0)
+			{
+				continue;
+			}
+
+			const FMatrix DeformMatrix = UnpackDeformTransform(&DeformTransforms[SectionIndex * SectionStride], TransformFormat);
+			const FVector* MeshSpacePositions = ApplyMeshSpaceDeformation_RenderThread(SectionIndex, SourcePositions, NumVertices, MeshSpaceScratch);
+			FVector* DeformedPositions = (FVector*)RHILockVertexBuffer(CPUDeform.PositionBuffer.VertexBufferRHI, 0, NumVertices * sizeof(FVector), RLM_WriteOnly);
+			UDeformMeshComponent::DeformPositions(DeformMatrix, MakeArrayView(MeshSpacePositions, NumVertices), MakeArrayView(DeformedPositions, NumVertices));
+			RHIUnlockVertexBuffer(CPUDeform.PositionBuffer.VertexBufferRHI);
+		}
+
+		//The skinned sections blend the transforms of other sections, they're deformed again when any transform changed
+		UpdateCPUSkinnedPositions_RenderThread();
+
+		DirtyTransforms.Init(false, Sections.Num());
+		bDeformTransformsDirty = false;
+	}
+
+	/* Move the positions of a section by its lattice and then by its deformer, into Scratch. Returns the source positions when the section has neither*/
+	const FVector* ApplyMeshSpaceDeformation_RenderThread(int32 SectionIndex, const FVector* SourcePositions, int32 NumVertices, TArray<FVector>& Scratch) const
+	{
+		const FDeformMeshSectionProxy* Section = Sections[SectionIndex];
+		const FVector* Positions = SourcePositions;
+		if (Section->HasLattice() && Section->LatticeOffset != INDEX_NONE)
+		{
+			Scratch.SetNumUninitialized(NumVertices, false);
+			FDeformMeshLattice::DeformPositions(Section->LatticeMode == EDeformMeshLatticeMode::Bernstein, Section->LatticeBox, Section->LatticeResolution,
+				MakeArrayView(&LatticePoints[Section->LatticeOffset], Section->GetNumLatticePoints()), MakeArrayView(Positions, NumVertices), Scratch);
+			Positions = Scratch.GetData();
+		}
+		if (Section->Deformer != EDeformMeshDeformer::None)
+		{
+			//The deformer kernels can work in place, on the output of the lattice
+			Scratch.SetNumUninitialized(NumVertices, false);
+			FDeformMeshDeformers::DeformPositions(Section->Deformer, DeformTransforms[SectionIndex * SectionStride + TransformStride], MakeArrayView(Positions, NumVertices), Scratch);
+			Positions = Scratch.GetData();
+		}
+		return Positions;
+	}
+
+	/* Blend the positions of the skinned sections on the CPU, with the same kernel as GetDeformedSectionPositions()*/
+	void UpdateCPUSkinnedPositions_RenderThread()
+	{
+		TArray<FMatrix> DeformMatrices;
+		TArray<FVector> MeshSpaceScratch;
+		for (int32 SectionIndex = 0; SectionIndex < Sections.Num(); SectionIndex++)
+		{
+			const FDeformMeshSectionProxy* Section = Sections[SectionIndex];
+			if (Section == nullptr || !Section->CPUDeform.IsValid() || !Section->SkinWeightBuffer.IsValid())
+			{
+				continue;
+			}
+
+			const FDeformMeshCPUDeformData& CPUDeform = *Section->CPUDeform;
+			const FDeformMeshSkinWeights& SkinWeights = *Section->SkinWeightBuffer->SkinWeights;
+			const FVector* SourcePositions = (const FVector*)CPUDeform.SourcePositions->GetVertexData();
+			const int32 NumVertices = CPUDeform.PositionBuffer.NumVertices;
+			if (SourcePositions == nullptr || NumVertices == 0 || SkinWeights.GetNumVertices() != NumVertices)
+			{
+				continue;
+			}
+
+			//The transforms of all the sections are unpacked once, for all the skinned sections
+			if (DeformMatrices.Num() == 0)
+			{
+				DeformMatrices.SetNumUninitialized(Sections.Num());
+				for (int32 TransformIndex = 0; TransformIndex < Sections.Num(); TransformIndex++)
+				{
+					DeformMatrices[TransformIndex] = UnpackDeformTransform(&DeformTransforms[TransformIndex * SectionStride], TransformFormat);
+				}
+			}
+
+			const FVector* MeshSpacePositions = ApplyMeshSpaceDeformation_RenderThread(SectionIndex, SourcePositions, NumVertices, MeshSpaceScratch);
+			FVector* DeformedPositions = (FVector*)RHILockVertexBuffer(CPUDeform.PositionBuffer.VertexBufferRHI, 0, NumVertices * sizeof(FVector), RLM_WriteOnly);
+			FDeformMeshSkinWeights::SkinPositions(Section->SkinningMode == EDeformMeshSkinningMode::DualQuaternion, DeformMatrices, SkinWeights.GetInfluences(),
+				MakeArrayView(MeshSpacePositions, NumVertices), MakeArrayView(DeformedPositions, NumVertices));
+			RHIUnlockVertexBuffer(CPUDeform.PositionBuffer.VertexBufferRHI);
+		}
+	}
+
+	/* Allocate the range of the transforms pool (and create the instance indices structured buffer) with room for Capacity sections*/
+	/* This is called once the proxy is in the scene, and when a new section doesn't fit anymore. The range is uploaded on the next flush of the pool*/
+	void CreateTransformsBuffers(int32 Capacity)
+	{
+		check(IsInRenderingThread());
+		///////////////////////////////////////////////////////////////
+		//// ALLOCATING THE RANGE OF THE POOLED STRUCTURED BUFFER FOR THE DEFORM TRANSFORMS OF ALL THE SECTIONS
+		//All the proxies share one structured buffer, we use one contiguous range of it for all the mesh sections of the component
+		//Each section uses SectionStride consecutive float4 elements (its transform, and the parameters of its deformer if any), and the range is aligned on the stride
+		//The range is allocated in the pool of the scene of this proxy
+		if (TransformsPool == nullptr)
+		{
+			TransformsPool = &FDeformMeshTransformsPool::Get(&GetScene());
+		}
+		if (TransformsPoolOffset != INDEX_NONE)
+		{
+			TransformsPool->Free(TransformsPoolOffset);
+		}
+		TransformsPoolOffset = TransformsPool->Allocate(this, Capacity * SectionStride, SectionStride);
+
+		//The dirty bits are cleared below, the normal matrices of the sections that changed are packed before
+		UpdateNormalMatrices_RenderThread();
+
+		//The whole new range needs to be uploaded, to both buffers so the sections don't get a velocity from the previous content of the range
+		if (DeformTransforms.Num() > 0)
+		{
+			TransformsPool->MarkDirty(TransformsPoolOffset, DeformTransforms.Num(), true);
+		}
+		DirtyTransforms.Init(false, Sections.Num());
+		bDeformTransformsDirty = false;
+
+		///////////////////////////////////////////////////////////////
+		//// CREATING THE STRUCTURED BUFFER OF THE INSTANCES' TRANSFORM INDICES
+		//It's big enough for all the sections, so visibility changes only need to update it
+		if (bInstancedRendering)
+		{
+			BuildDeformMeshInstanceGroups(Sections, GetTransformIndexBase(), InstanceGroups, InstanceGroupIndices, InstanceTransformIndices);
+
+			TResourceArray<uint32>* IndicesResourceArray = new TResourceArray<uint32>(true);
+			IndicesResourceArray->Append(InstanceTransformIndices);
+			IndicesResourceArray->AddZeroed(Capacity - InstanceTransformIndices.Num());
+			FRHIResourceCreateInfo IndicesCreateInfo;
+			IndicesCreateInfo.ResourceArray = IndicesResourceArray;
+			IndicesCreateInfo.DebugName = TEXT("DeformMesh_InstanceTransformIndicesSB");
+
+			InstanceTransformIndicesSB = RHICreateStructuredBuffer(sizeof(uint32), Capacity * sizeof(uint32), BUF_ShaderResource, IndicesCreateInfo);
+			InstanceTransformIndicesSRV = RHICreateShaderResourceView(InstanceTransformIndicesSB);
+		}
+
+		TransformsCapacity = Capacity;
+
+		//The previous buffer, if any, is released when its ref is replaced. The memory of the transforms is reported by the pool
+		DEC_MEMORY_STAT_BY(STAT_DeformMesh_TransformBufferMemory, TransformsBufferBytes);
+		TransformsBufferBytes = bInstancedRendering ? Capacity * sizeof(uint32) : 0;
+		INC_MEMORY_STAT_BY(STAT_DeformMesh_TransformBufferMemory, TransformsBufferBytes);
+	}
+
+	virtual ~FDeformMeshSceneProxy()
+	{
+		//For each section , release the render resources
+		for (int32 SectionIdx = 0; SectionIdx < Sections.Num(); SectionIdx++)
+		{
+			ReleaseSection_RenderThread(SectionIdx);
+		}
+
+		//Give the range of the transforms back to the pool, and release the instance indices structured buffer and its SRV
+		if (TransformsPoolOffset != INDEX_NONE)
+		{
+			TransformsPool->Free(TransformsPoolOffset);
+			FDeformMeshTransformsPool::ReleaseIfUnused(&GetScene());
+		}
+		DEC_MEMORY_STAT_BY(STAT_DeformMesh_TransformBufferMemory, TransformsBufferBytes);
+		InstanceTransformIndicesSB.SafeRelease();
+		InstanceTransformIndicesSRV.SafeRelease();
+
+		DEC_MEMORY_STAT_BY(STAT_DeformMesh_LatticeBufferMemory, LatticePointsCapacity * sizeof(FVector4));
+		LatticePointsSB.SafeRelease();
+		LatticePointsSRV.SafeRelease();
+	}
+
+
+	/* Insert or replace one section in place, instead of recreating the whole scene proxy*/
+	/* The section proxy was created on the game thread with CreateSectionProxy(), this proxy takes ownership of it*/
+	void SetSection_RenderThread(int32 SectionIndex, FDeformMeshSectionProxy* NewSection, EDeformMeshTransformFormat Format, const FDeformMeshPackedTransform& Transform)
+	{
+		check(IsInRenderingThread());
+
+		if (SectionIndex >= Sections.Num())
+		{
+			const int32 NumSections = SectionIndex + 1;
+			Sections.SetNumZeroed(NumSections);
+			DeformTransforms.SetNumZeroed(NumSections * SectionStride);
+			DirtyTransforms.Add(false, NumSections - DirtyTransforms.Num());
+			SectionWorldBounds.SetNum(NumSections);
+			if (bInterpolateTransforms)
+			{
+				SectionInterpolations.SetNum(NumSections);
+				InterpolatingSections.Add(false, NumSections - InterpolatingSections.Num());
+			}
+		}
+
+		//Release the section that we're replacing, if any
+		const bool bReplacesSection = Sections[SectionIndex] != nullptr;
+		const bool bLatticesChanged = NewSection->HasLattice() || (bReplacesSection && Sections[SectionIndex]->HasLattice());
+		ReleaseSection_RenderThread(SectionIndex);
+
+		Sections[SectionIndex] = NewSection;
+		UpdateSectionWorldBounds_RenderThread(SectionIndex);
+		AddSectionMemoryStats(NewSection);
+
+		//The ranges of the lattices are packed again, before the new section is deformed
+		if (bLatticesChanged)
+		{
+			UpdateLatticeLayout_RenderThread();
+		}
+
+		//A new section can only add to the relevance, it only shrinks when a section goes away
+		if (bReplacesSection)
+		{
+			UpdateMaterialRelevance_RenderThread();
+		}
+		else
+		{
+			MaterialRelevance |= NewSection->MaterialRelevance;
+		}
+
+		MarkStaticMeshesStale_RenderThread();
+
+		//The transform is dropped if it was packed for another format, this proxy is being recreated in that case
+		if (Format == TransformFormat)
+		{
+			FMemory::Memcpy(&DeformTransforms[SectionIndex * SectionStride], Transform.Data, TransformStride * sizeof(FVector4));
+		}
+		if (HasDeformerParams())
+		{
+			DeformTransforms[SectionIndex * SectionStride + TransformStride] = NewSection->DeformerParams;
+		}
+		//A new section starts at its transform, the next update is interpolated from there
+		if (bInterpolateTransforms)
+		{
+			SectionInterpolations[SectionIndex].Reset(FTransform(UnpackDeformTransform(&DeformTransforms[SectionIndex * SectionStride], TransformFormat)));
+			InterpolatingSections[SectionIndex] = false;
+		}
+		DirtyTransforms[SectionIndex] = true;
+		bDeformTransformsDirty = true;
+
+		if (Sections.Num() > TransformsCapacity)
+		{
+			//Grow the range geometrically so adding sections one by one costs O(1) amortized, the new instance indices buffer already contains all the groups
+			//The static meshes are already stale, so the new transform indices are picked up
+			CreateTransformsBuffers(FMath::Max(Sections.Num(), TransformsCapacity * 2));
+			TransformsPool->Flush_RenderThread();
+		}
+		else
+		{
+			if (bInstancedRendering)
+			{
+				//Adding the last section, the usual case, only appends its instance to the groups, any other change rebuilds them
+				if (!bReplacesSection && SectionIndex == Sections.Num() - 1)
+				{
+					if (NewSection->bSectionVisible)
+					{
+						const int32 FirstChangedInstance = AddDeformMeshInstance(NewSection, GetTransformIndexBase() + SectionIndex, InstanceGroups, InstanceGroupIndices, InstanceTransformIndices);
+						UploadInstanceTransformIndices_RenderThread(FirstChangedInstance);
+					}
+				}
+				else
+				{
+					UpdateInstanceGroups_RenderThread();
+				}
+			}
+			UpdateDeformTransformsSB_RenderThread();
+		}
+	}
+
+	/* Remove one section in place, the other sections don't change index*/
+	void RemoveSection_RenderThread(int32 SectionIndex)
+	{
+		check(IsInRenderingThread());
+
+		if (SectionIndex < Sections.Num() &&
+			Sections[SectionIndex] != nullptr)
+		{
+			const bool bHadLattice = Sections[SectionIndex]->HasLattice();
+			ReleaseSection_RenderThread(SectionIndex);
+
+			if (bHadLattice)
+			{
+				UpdateLatticeLayout_RenderThread();
+			}
+			if (bInstancedRendering)
+			{
+				UpdateInstanceGroups_RenderThread();
+			}
+			UpdateMaterialRelevance_RenderThread();
+			MarkStaticMeshesStale_RenderThread();
+		}
+	}
+
+	/* Recompute the relevance of the proxy from the materials of the remaining sections, so it also shrinks when a section is replaced or removed*/
+	void UpdateMaterialRelevance_RenderThread()
+	{
+		MaterialRelevance = FMaterialRelevance();
+		for (const FDeformMeshSectionProxy* Section : Sections)
+		{
+			if (Section != nullptr)
+			{
+				MaterialRelevance |= Section->MaterialRelevance;
+			}
+		}
+	}
+
+	/* Remove all the sections, the structured buffers are kept so adding sections again doesn't need to recreate them*/
+	void RemoveAllSections_RenderThread()
+	{
+		check(IsInRenderingThread());
+
+		for (int32 SectionIdx = 0; SectionIdx < Sections.Num(); SectionIdx++)
+		{
+			ReleaseSection_RenderThread(SectionIdx);
+		}
+		Sections.Reset();
+		SectionWorldBounds.SetNum(0);
+		DeformTransforms.Reset();
+		DirtyTransforms.Init(false, 0);
+		bDeformTransformsDirty = false;
+		SectionInterpolations.Reset();
+		InterpolatingSections.Init(false, 0);
+		InstanceGroups.Reset();
+		InstanceGroupIndices.Reset();
+		InstanceTransformIndices.Reset();
+		LatticePoints.Reset();
+		MaterialRelevance = FMaterialRelevance();
+		MarkStaticMeshesStale_RenderThread();
+	}
+
+	/* Account for the memory of a section that was added to this proxy*/
+	void AddSectionMemoryStats(const FDeformMeshSectionProxy* Section)
+	{
+		//Each section used to hold a 32 bit copy of the indices of its static mesh
+		const SIZE_T SectionIndexBufferBytes = Section->GetSharedIndexBufferBytes();
+		SharedIndexBufferBytes += SectionIndexBufferBytes;
+		INC_MEMORY_STAT_BY(STAT_DeformMesh_SharedIndexBufferMemorySaved, SectionIndexBufferBytes);
+		INC_MEMORY_STAT_BY(STAT_DeformMesh_SectionProxyMemory, Section->GetAllocatedSize());
+		INC_MEMORY_STAT_BY(STAT_DeformMesh_CPUDeformBufferMemory, Section->GetCPUDeformBufferBytes());
+	}
+
+	/* Remove the memory of a section that is being released from the stats*/
+	void RemoveSectionMemoryStats(const FDeformMeshSectionProxy* Section)
+	{
+		const SIZE_T SectionIndexBufferBytes = Section->GetSharedIndexBufferBytes();
+		SharedIndexBufferBytes -= SectionIndexBufferBytes;
+		DEC_MEMORY_STAT_BY(STAT_DeformMesh_SharedIndexBufferMemorySaved, SectionIndexBufferBytes);
+		DEC_MEMORY_STAT_BY(STAT_DeformMesh_SectionProxyMemory, Section->GetAllocatedSize());
+		DEC_MEMORY_STAT_BY(STAT_DeformMesh_CPUDeformBufferMemory, Section->GetCPUDeformBufferBytes());
+	}
+
+	/* Release the render resources of a section and delete it*/
+	void ReleaseSection_RenderThread(int32 SectionIndex)
+	{
+		FDeformMeshSectionProxy* Section = Sections[SectionIndex];
+		if (Section != nullptr)
+		{
+			RemoveSectionMemoryStats(Section);
+
+			for (FDeformMeshSectionLOD& LOD : Section->LODs)
+			{
+				LOD.VertexFactory->ReleaseResource();
+			}
+			if (Section->CPUDeform.IsValid())
+			{
+				Section->CPUDeform->VertexFactory.ReleaseResource();
+				Section->CPUDeform->PositionBuffer.ReleaseResource();
+			}
+			if (Section->SkinWeightBuffer.IsValid())
+			{
+				Section->SkinWeightBuffer->ReleaseResource();
+			}
+			delete Section;
+			Sections[SectionIndex] = nullptr;
+		}
+	}
+
+	/* Update the transforms structured buffer using the array of deform transform, this will update the array on the GPU*/
+	/* The dirty ranges are handed to the transforms pool, which uploads them right away unless bFlushPool is false. The caller then flushes the pool once for all the proxies it updated*/
+	void UpdateDeformTransformsSB_RenderThread(bool bFlushPool = true)
+	{
+		check(IsInRenderingThread());
+		//Without the structured buffer, the new transforms are applied to the positions on the CPU
+		if (bCPUDeformation)
+		{
+			UpdateCPUDeformedPositions_RenderThread();
+			return;
+		}
+		//Update the structured buffer only if it needs update
+		if (bDeformTransformsDirty && TransformsPoolOffset != INDEX_NONE)
+		{
+			DEFORMMESH_SCOPE_CYCLE_COUNTER(STAT_DeformMesh_UpdateTransformsBuffer);
+			UpdateNormalMatrices_RenderThread();
+
+			//We only upload the ranges of transforms that changed since the last upload
+			//Close dirty ranges are merged, since one bigger copy is cheaper than an additional lock (The pool merges them again with the ranges of the other proxies)
+			int32 RangeStart = INDEX_NONE;
+			int32 RangeEnd = INDEX_NONE;
+			for (TConstSetBitIterator<> It(DirtyTransforms); It; ++It)
+			{
+				const int32 TransformIndex = It.GetIndex();
+				if (RangeStart != INDEX_NONE && TransformIndex - RangeEnd > DeformTransformsMaxMergedGap)
+				{
+					UploadDeformTransformsRange_RenderThread(RangeStart, RangeEnd - RangeStart);
+					RangeStart = INDEX_NONE;
+				}
+				if (RangeStart == INDEX_NONE)
+				{
+					RangeStart = TransformIndex;
+				}
+				RangeEnd = TransformIndex + 1;
+			}
+			if (RangeStart != INDEX_NONE)
+			{
+				UploadDeformTransformsRange_RenderThread(RangeStart, RangeEnd - RangeStart);
+			}
+
+			DirtyTransforms.Init(false, Sections.Num());
+			bDeformTransformsDirty = false;
+		}
+
+		if (bFlushPool && TransformsPool != nullptr)
+		{
+			TransformsPool->Flush_RenderThread();
+		}
+	}
+
+	/* Pack the normal matrices of the sections whose transform changed since the last upload, from their packed transforms*/
+	/* A section can get several transforms in one frame (an update and its interpolation), its normal matrix is only computed for the last one*/
+	void UpdateNormalMatrices_RenderThread()
+	{
+		if (NormalMatrixStride == 0)
+		{
+			return;
+		}
+		const int32 NormalMatrixOffset = GetNormalMatrixOffset();
+		for (TConstSetBitIterator<> It(DirtyTransforms); It; ++It)
+		{
+			FVector4* SectionData = &DeformTransforms[It.GetIndex() * SectionStride];
+			PackNormalMatrix(UnpackDeformTransform(SectionData, TransformFormat), SectionData + NormalMatrixOffset);
+		}
+	}
+
+	/* Hand the transforms of a contiguous range of sections to the transforms pool, they're uploaded on its next flush*/
+	void UploadDeformTransformsRange_RenderThread(int32 FirstTransform, int32 NumTransforms)
+	{
+		TransformsPool->MarkDirty(TransformsPoolOffset + FirstTransform * SectionStride, NumTransforms * SectionStride);
+
+		//The previous buffer keeps the old transforms until the next frame, the velocity pass draws the sections meanwhile
+		TransformsChangeFrame = GFrameNumberRenderThread;
+		SetTransformsVelocity_RenderThread(true);
+	}
+
+	/* Called by the pool on its first flush of a frame, the previous buffer then gets the transforms that changed during the last frame*/
+	void OnTransformsPoolNewFrame_RenderThread(uint32 FrameNumber)
+	{
+		if (TransformsChangeFrame != FrameNumber)
+		{
+			SetTransformsVelocity_RenderThread(false);
+		}
+	}
+
+	/* The velocity pass only draws the primitives that moved or that always have a velocity, the sections need it only while their transforms move*/
+	/* The cached velocity draw commands depend on it, so they're rebuilt when the sections start or stop moving, not on every frame where they move*/
+	void SetTransformsVelocity_RenderThread(bool bHasVelocity)
+	{
+		if (bAlwaysHasVelocity != bHasVelocity)
+		{
+			bAlwaysHasVelocity = bHasVelocity;
+			MarkStaticMeshesStale_RenderThread();
+		}
+	}
+
+	/* Give each lattice its range of the lattice points, the ranges are packed in the order of the sections*/
+	/* This runs when sections with a lattice are added or removed, so the whole buffer is uploaded again. Moving control points doesn't change the layout*/
+	void UpdateLatticeLayout_RenderThread()
+	{
+		check(IsInRenderingThread());
+
+		TArray<FVector4> NewLatticePoints;
+		for (FDeformMeshSectionProxy* Section : Sections)
+		{
+			if (Section == nullptr || !Section->HasLattice())
+			{
+				continue;
+			}
+
+			//The sections that were already laid out keep their points, the new ones bring the points copied from the game thread
+			const int32 NewOffset = NewLatticePoints.Num();
+			if (Section->LatticeOffset != INDEX_NONE)
+			{
+				NewLatticePoints.Append(&LatticePoints[Section->LatticeOffset], Section->GetNumLatticePoints());
+			}
+			else
+			{
+				NewLatticePoints.Append(Section->PendingLatticePoints);
+				DEC_MEMORY_STAT_BY(STAT_DeformMesh_SectionProxyMemory, Section->PendingLatticePoints.GetAllocatedSize());
+				Section->PendingLatticePoints.Empty();
+			}
+			Section->LatticeOffset = NewOffset;
+			for (FDeformMeshSectionLOD& LOD : Section->LODs)
+			{
+				LOD.VertexFactory->SetLatticeOffset(NewOffset);
+			}
+		}
+
+		if (NewLatticePoints.Num() == 0 && LatticePoints.Num() == 0)
+		{
+			return;
+		}
+		LatticePoints = MoveTemp(NewLatticePoints);
+
+		//On the CPU deformation path the points are only read on the CPU
+		if (!bCPUDeformation && LatticePoints.Num() > 0)
+		{
+			if (LatticePoints.Num() > LatticePointsCapacity)
+			{
+				//Grow geometrically, like the range of the transforms, so adding lattices one by one doesn't recreate the buffer each time
+				const int32 NewCapacity = FMath::Max(LatticePoints.Num(), LatticePointsCapacity * 2);
+				FRHIResourceCreateInfo CreateInfo;
+				CreateInfo.DebugName = TEXT("DeformMesh_LatticePointsSB");
+				//Not dynamic: a write only lock of a dynamic buffer discards all of it, and we only upload the points that moved
+				LatticePointsSB = RHICreateStructuredBuffer(sizeof(FVector4), NewCapacity * sizeof(FVector4), BUF_ShaderResource, CreateInfo);
+				LatticePointsSRV = RHICreateShaderResourceView(LatticePointsSB);
+
+				DEC_MEMORY_STAT_BY(STAT_DeformMesh_LatticeBufferMemory, LatticePointsCapacity * sizeof(FVector4));
+				LatticePointsCapacity = NewCapacity;
+				INC_MEMORY_STAT_BY(STAT_DeformMesh_LatticeBufferMemory, LatticePointsCapacity * sizeof(FVector4));
+			}
+			UploadLatticePoints_RenderThread(0, LatticePoints.Num());
+		}
+
+		//The cached mesh draw commands bound the old offsets, and maybe the old buffer
+		MarkStaticMeshesStale_RenderThread();
+	}
+
+	/* Move control points of the lattice of a section, only the points that moved are uploaded*/
+	/* Close points are uploaded with one lock, like the dirty ranges of the transforms*/
+	void UpdateLatticePoints_RenderThread(int32 SectionIndex, const TArray<int32>& PointIndices, const TArray<FVector>& Positions)
+	{
+		check(IsInRenderingThread());
+		if (!Sections.IsValidIndex(SectionIndex) || Sections[SectionIndex] == nullptr || !Sections[SectionIndex]->HasLattice())
+		{
+			return;
+		}
+
+		//The section isn't laid out yet, its points are uploaded with the layout
+		FDeformMeshSectionProxy* Section = Sections[SectionIndex];
+		TArray<FVector4>& Points = Section->LatticeOffset != INDEX_NONE ? LatticePoints : Section->PendingLatticePoints;
+		const int32 Offset = Section->LatticeOffset != INDEX_NONE ? Section->LatticeOffset : 0;
+		for (int32 UpdateIdx = 0; UpdateIdx < PointIndices.Num(); UpdateIdx++)
+		{
+			Points[Offset + PointIndices[UpdateIdx]] = FVector4(Positions[UpdateIdx], 0.f);
+		}
+		if (Section->LatticeOffset == INDEX_NONE)
+		{
+			return;
+		}
+
+		//The CPU deformation moves the vertices of the section again
+		if (bCPUDeformation)
+		{
+			DirtyTransforms[SectionIndex] = true;
+			bDeformTransformsDirty = true;
+			UpdateCPUDeformedPositions_RenderThread();
+			return;
+		}
+
+		TArray<int32> SortedPointIndices = PointIndices;
+		SortedPointIndices.Sort();
+		int32 RangeStart = INDEX_NONE;
+		int32 RangeEnd = INDEX_NONE;
+		for (int32 PointIndex : SortedPointIndices)
+		{
+			if (RangeStart != INDEX_NONE && PointIndex - RangeEnd > DeformTransformsMaxMergedGap)
+			{
+				UploadLatticePoints_RenderThread(Offset + RangeStart, RangeEnd - RangeStart);
+				RangeStart = INDEX_NONE;
+			}
+			if (RangeStart == INDEX_NONE)
+			{
+				RangeStart = PointIndex;
+			}
+			RangeEnd = FMath::Max(RangeEnd, PointIndex + 1);
+		}
+		if (RangeStart != INDEX_NONE)
+		{
+			UploadLatticePoints_RenderThread(Offset + RangeStart, RangeEnd - RangeStart);
+		}
+	}
+
+	/* Copy a range of the lattice points to the structured buffer, the rest of the buffer is kept since it isn't dynamic*/
+	void UploadLatticePoints_RenderThread(int32 FirstPoint, int32 NumPoints)
+	{
+		const uint32 Size = NumPoints * sizeof(FVector4);
+		void* BufferData = RHILockStructuredBuffer(LatticePointsSB, FirstPoint * sizeof(FVector4), Size, RLM_WriteOnly);
+		FMemory::Memcpy(BufferData, &LatticePoints[FirstPoint], Size);
+		RHIUnlockStructuredBuffer(LatticePointsSB);
+		INC_DWORD_STAT_BY(STAT_DeformMesh_LatticeBytesUploaded, Size);
+	}
+
+	/* Apply a batch of deform transforms updates to the CPU array, call UpdateDeformTransformsSB_RenderThread() after this to upload them*/
+	void UpdateDeformTransforms_RenderThread(const FDeformMeshTransformsUpdateData& UpdateData)
+	{
+		check(IsInRenderingThread());
+		if (UpdateData.Format != TransformFormat)
+		{
+			return;
+		}
+		check(UpdateData.SectionIndices.Num() * TransformStride == UpdateData.Transforms.Num());
+
+		for (int32 UpdateIdx = 0; UpdateIdx < UpdateData.SectionIndices.Num(); UpdateIdx++)
+		{
+			const int32 SectionIndex = UpdateData.SectionIndices[UpdateIdx];
+			if (bInterpolateTransforms)
+			{
+				StartSectionInterpolation_RenderThread(SectionIndex, &UpdateData.Transforms[UpdateIdx * TransformStride], UpdateData.SectionLocalBoxes[UpdateIdx], UpdateData.Time);
+			}
+			else if (SectionIndex < Sections.Num() &&
+				Sections[SectionIndex] != nullptr)
+			{
+				Sections[SectionIndex]->LocalBox = UpdateData.SectionLocalBoxes[UpdateIdx];
+				UpdateSectionWorldBounds_RenderThread(SectionIndex);
+				FMemory::Memcpy(&DeformTransforms[SectionIndex * SectionStride], &UpdateData.Transforms[UpdateIdx * TransformStride], TransformStride * sizeof(FVector4));
+				DirtyTransforms[SectionIndex] = true;
+				bDeformTransformsDirty = true;
+			}
+		}
+
+		//The parameters of the deformers aren't interpolated, they're used as soon as they arrive
+		check(UpdateData.DeformerSectionIndices.Num() == UpdateData.DeformerParams.Num());
+		for (int32 UpdateIdx = 0; UpdateIdx < UpdateData.DeformerSectionIndices.Num(); UpdateIdx++)
+		{
+			const int32 SectionIndex = UpdateData.DeformerSectionIndices[UpdateIdx];
+			if (HasDeformerParams() && SectionIndex < Sections.Num() && Sections[SectionIndex] != nullptr)
+			{
+				DeformTransforms[SectionIndex * SectionStride + TransformStride] = UpdateData.DeformerParams[UpdateIdx];
+				DirtyTransforms[SectionIndex] = true;
+				bDeformTransformsDirty = true;
+			}
+		}
+	}
+
+	/* Start interpolating a section from the transform it displays at Time to its new transform*/
+	void StartSectionInterpolation_RenderThread(int32 SectionIndex, const FVector4* PackedTransform, const FBox& SectionLocalBox, float Time)
+	{
+		if (SectionIndex >= Sections.Num() ||
+			Sections[SectionIndex] == nullptr)
+		{
+			return;
+		}
+
+		FDeformMeshSectionInterpolation& Interpolation = SectionInterpolations[SectionIndex];
+		const FTransform Displayed = Interpolation.Evaluate(Time);
+		//The section takes the time between its last two updates to reach the new transform, so it arrives when the next update is expected
+		const float Interval = Time - Interpolation.LastUpdateTime;
+		Interpolation.From = Displayed;
+		Interpolation.To = FTransform(UnpackDeformTransform(PackedTransform, TransformFormat));
+		Interpolation.ToLocalBox = SectionLocalBox;
+		Interpolation.StartTime = Time;
+		Interpolation.Duration = (Interval > 0.f && Interval <= MaxInterpolationInterval) ? Interval : 0.f;
+		Interpolation.LastUpdateTime = Time;
+
+		//The section is somewhere between both boxes until the interpolation ends
+		if (Interpolation.Duration > 0.f)
+		{
+			Sections[SectionIndex]->LocalBox = Sections[SectionIndex]->LocalBox + SectionLocalBox;
+			InterpolatingSections[SectionIndex] = true;
+		}
+		else
+		{
+			Sections[SectionIndex]->LocalBox = SectionLocalBox;
+			InterpolatingSections[SectionIndex] = false;
+		}
+		UpdateSectionWorldBounds_RenderThread(SectionIndex);
+
+		PackDeformTransform(Interpolation.Evaluate(Time), TransformFormat, &DeformTransforms[SectionIndex * SectionStride]);
+		DirtyTransforms[SectionIndex] = true;
+		bDeformTransformsDirty = true;
+	}
+
+	/* Move the interpolating sections to the world time Time, call UpdateDeformTransformsSB_RenderThread() after this to upload them*/
+	void InterpolateTransforms_RenderThread(float Time)
+	{
+		check(IsInRenderingThread());
+		if (!bInterpolateTransforms)
+		{
+			return;
+		}
+		DEFORMMESH_SCOPE_CYCLE_COUNTER(STAT_DeformMesh_InterpolateTransforms);
+
+		for (TConstSetBitIterator<> It(InterpolatingSections); It; ++It)
+		{
+			const int32 SectionIndex = It.GetIndex();
+			const FDeformMeshSectionInterpolation& Interpolation = SectionInterpolations[SectionIndex];
+			PackDeformTransform(Interpolation.Evaluate(Time), TransformFormat, &DeformTransforms[SectionIndex * SectionStride]);
+			DirtyTransforms[SectionIndex] = true;
+			bDeformTransformsDirty = true;
+
+			//The section reached its new transform, it can use its new box alone
+			if (Interpolation.GetAlpha(Time) >= 1.f)
+			{
+				InterpolatingSections[SectionIndex] = false;
+				if (Sections[SectionIndex] != nullptr)
+				{
+					Sections[SectionIndex]->LocalBox = Interpolation.ToLocalBox;
+					UpdateSectionWorldBounds_RenderThread(SectionIndex);
+				}
+			}
+		}
+	}
+
+	/* Recompute the world space bounds of a section from its local box and the local to world transform of the primitive*/
+	void UpdateSectionWorldBounds_RenderThread(int32 SectionIndex)
+	{
+		const FDeformMeshSectionProxy* Section = Sections[SectionIndex];
+		if (Section != nullptr && Section->LocalBox.IsValid)
+		{
+			SectionWorldBounds.Set(SectionIndex, Section->LocalBox.TransformBy(GetLocalToWorld()));
+		}
+	}
+
+	/* The local to world transform of the primitive changed, so all the world bounds of the sections need to be updated*/
+	virtual void OnTransformChanged() override
+	{
+		for (int32 SectionIdx = 0; SectionIdx < Sections.Num(); SectionIdx++)
+		{
+			UpdateSectionWorldBounds_RenderThread(SectionIdx);
+		}
+	}
+
+	/* Update the mesh section's visibility*/
+	void SetSectionVisibility_RenderThread(int32 SectionIndex, bool bNewVisibility)
+	{
+		check(IsInRenderingThread());
+
+		if (SectionIndex < Sections.Num() &&
+			Sections[SectionIndex] != nullptr)
+		{
+			Sections[SectionIndex]->bSectionVisible = bNewVisibility;
+
+			//The hidden sections are removed from the instance groups
+			if (bInstancedRendering)
+			{
+				UpdateInstanceGroups_RenderThread();
+			}
+			MarkStaticMeshesStale_RenderThread();
+		}
+	}
+
+	/* Rebuild the instance groups and upload the transform indices of the instances*/
+	void UpdateInstanceGroups_RenderThread()
+	{
+		check(IsInRenderingThread());
+
+		BuildDeformMeshInstanceGroups(Sections, GetTransformIndexBase(), InstanceGroups, InstanceGroupIndices, InstanceTransformIndices);
+		UploadInstanceTransformIndices_RenderThread(0);
+	}
+
+	/* Upload the transform indices of the instances from FirstInstance to the end, the ones before it didn't change*/
+	void UploadInstanceTransformIndices_RenderThread(int32 FirstInstance)
+	{
+		if (InstanceTransformIndicesSB && InstanceTransformIndices.Num() > FirstInstance)
+		{
+			const uint32 Offset = FirstInstance * sizeof(uint32);
+			const uint32 Size = (InstanceTransformIndices.Num() - FirstInstance) * sizeof(uint32);
+			void* StructuredBufferData = RHILockStructuredBuffer(InstanceTransformIndicesSB, Offset, Size, RLM_WriteOnly);
+			FMemory::Memcpy(StructuredBufferData, &InstanceTransformIndices[FirstInstance], Size);
+			RHIUnlockStructuredBuffer(InstanceTransformIndicesSB);
+		}
+	}
+
+	/* Given the scene views and the visibility map, we add to the collector the relevant dynamic meshes that need to be rendered by this component*/
+	virtual void GetDynamicMeshElements(const TArray<const FSceneView*>& Views, const FSceneViewFamily& ViewFamily, uint32 VisibilityMap, FMeshElementCollector& Collector) const override
+	{
+		DEFORMMESH_SCOPE_CYCLE_COUNTER(STAT_DeformMesh_GetDynamicMeshElements);
+		FDeformMeshScopeCycleAccumulator BenchmarkCycles(GDeformMeshGetDynamicMeshElementsCycles);
+
+		// Set up wireframe material (if needed)
+		const bool bWireframe = AllowDebugViewmodes() && ViewFamily.EngineShowFlags.Wireframe;
+
+		FColoredMaterialRenderProxy* WireframeMaterialInstance = NULL;
+		if (bWireframe)
+		{
+			WireframeMaterialInstance = new FColoredMaterialRenderProxy(
+				GEngine->WireframeMaterial ? GEngine->WireframeMaterial->GetRenderProxy() : NULL,
+				FLinearColor(0, 0.5f, 1.f)
+			);
+
+			Collector.RegisterOneFrameMaterialProxy(WireframeMaterialInstance);
+		}
+
+		//The LocalVertexFactory uses a uniform buffer to pass primitve data like the local to world transform for this frame and for the previous one
+		//That data only depends on the primitive, so we fill one temporary uniform buffer for this frame and share it with all the sections in all the views
+		//Most of this data can be fetched using the helper function below
+		bool bHasPrecomputedVolumetricLightmap;
+		FMatrix PreviousLocalToWorld;
+		int32 SingleCaptureIndex;
+		bool bOutputVelocity;
+		GetScene().GetPrimitiveUniformShaderParameters_RenderThread(GetPrimitiveSceneInfo(), bHasPrecomputedVolumetricLightmap, PreviousLocalToWorld, SingleCaptureIndex, bOutputVelocity);
+		//Alloate a temporary primitive uniform buffer and fill it with the data
+		FDynamicPrimitiveUniformBuffer& DynamicPrimitiveUniformBuffer = Collector.AllocateOneFrameResource<FDynamicPrimitiveUniformBuffer>();
+		DynamicPrimitiveUniformBuffer.Set(GetLocalToWorld(), PreviousLocalToWorld, GetBounds(), GetLocalBounds(), true, bHasPrecomputedVolumetricLightmap, DrawsVelocity(), bOutputVelocity);
+		const TUniformBuffer<FPrimitiveUniformShaderParameters>* PrimitiveUniformBuffer = &DynamicPrimitiveUniformBuffer.UniformBuffer;
+
+		//In instanced mode, we draw one batch per group of sections sharing the same mesh and material
+		//The instances of a group share one buffer of transform indices for all the views, so the sections aren't frustum culled individually in this mode
+		//And for the same reason, they all use the same LOD; the forced LOD or the min LOD
+		if (bInstancedRendering)
+		{
+			for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+			{
+				if (VisibilityMap & (1 << ViewIndex))
+				{
+					for (const FDeformMeshInstanceGroup& Group : InstanceGroups)
+					{
+						FMaterialRenderProxy* MaterialProxy = bWireframe ? WireframeMaterialInstance : Group.Section->Material->GetRenderProxy();
+						AddMeshBatch(Collector, ViewIndex, Group.Section, GetFixedSectionLOD(Group.Section), MaterialProxy, PrimitiveUniformBuffer, bWireframe, Group.FirstInstance, Group.NumInstances);
+					}
+				}
+			}
+			return;
+		}
+
+		//The visibility of each section in the current view, after the frustum culling
+		FMemMark Mark(FMemStack::Get());
+		TArray<uint8, TMemStackAllocator<>> SectionsInFrustum;
+		SectionsInFrustum.SetNumUninitialized(Sections.Num());
+
+		// For each view..
+		for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+		{
+			//Check if our mesh is visible from this view
+			if (!(VisibilityMap & (1 << ViewIndex)))
+			{
+				continue;
+			}
+
+			//Cull the sections against the frustum of the view, or against the shadow frustum when we're gathering the meshes of a shadow depth pass
+			const FSceneView* View = Views[ViewIndex];
+			const FConvexVolume* ShadowFrustum = View->GetDynamicMeshElementsShadowCullFrustum();
+			CullSectionBounds(ShadowFrustum ? *ShadowFrustum : View->ViewFrustum, ShadowFrustum ? View->GetPreShadowTranslation() : FVector::ZeroVector, SectionWorldBounds, Sections.Num(), SectionsInFrustum.GetData());
+
+			// Iterate over sections
+			int32 NumTested = 0;
+			int32 NumCulled = 0;
+			for (int32 SectionIdx = 0; SectionIdx < Sections.Num(); SectionIdx++)
+			{
+				const FDeformMeshSectionProxy* Section = Sections[SectionIdx];
+				if (Section != nullptr && Section->bSectionVisible)
+				{
+					NumTested++;
+					if (!SectionsInFrustum[SectionIdx])
+					{
+						NumCulled++;
+						continue;
+					}
+
+					//Get the section's materil, or the wireframe material if we're rendering in wireframe mode
+					FMaterialRenderProxy* MaterialProxy = bWireframe ? WireframeMaterialInstance : Section->Material->GetRenderProxy();
+					AddMeshBatch(Collector, ViewIndex, Section, GetSectionLOD(SectionIdx, *View), MaterialProxy, PrimitiveUniformBuffer, bWireframe, 0, 1);
+				}
+			}
+			INC_DWORD_STAT_BY(STAT_DeformMesh_SectionsTested, NumTested);
+			INC_DWORD_STAT_BY(STAT_DeformMesh_SectionsCulled, NumCulled);
+		}
+	}
+
+	/* Select the LOD of a section for a view, from the screen size of the section's deformed world bounds*/
+	/* Each section picks its own LOD, since the deformation can move the sections far away from each other*/
+	int32 GetSectionLOD(int32 SectionIndex, const FSceneView& View) const
+	{
+		const FDeformMeshSectionProxy* Section = Sections[SectionIndex];
+		if (Section->CPUDeform.IsValid())
+		{
+			return Section->CPUDeform->LODIndex;
+		}
+
+		const int32 NumLODs = Section->LODs.Num();
+		if (ForcedLOD != INDEX_NONE)
+		{
+			return FMath::Clamp(ForcedLOD, 0, NumLODs - 1);
+		}
+
+		const FVector Center(SectionWorldBounds.CenterX[SectionIndex], SectionWorldBounds.CenterY[SectionIndex], SectionWorldBounds.CenterZ[SectionIndex]);
+		const FVector Extent(SectionWorldBounds.ExtentX[SectionIndex], SectionWorldBounds.ExtentY[SectionIndex], SectionWorldBounds.ExtentZ[SectionIndex]);
+		const float ScreenSize = ComputeBoundsScreenSize(Center, Extent.Size(), View);
+		return SelectDeformMeshSectionLOD(Section->LODScreenSizes, NumLODs, ScreenSize, FMath::Min(MinLOD, NumLODs - 1));
+	}
+
+	/* The LOD used when the section is drawn without a view to select it, in instanced mode and on the static draw path*/
+	int32 GetFixedSectionLOD(const FDeformMeshSectionProxy* Section) const
+	{
+		return FMath::Clamp(ForcedLOD != INDEX_NONE ? ForcedLOD : MinLOD, 0, Section->LODs.Num() - 1);
+	}
+
+	/* Allocate a mesh batch that draws the section's geometry NumInstances times, and add it to the collector for the given view*/
+	/* FirstInstance is only used in instanced mode, it's where the transform indices of the instances start in the instance transform indices buffer*/
+	/* The primitive uniform buffer is shared by all the batches of the frame*/
+	void AddMeshBatch(FMeshElementCollector& Collector, int32 ViewIndex, const FDeformMeshSectionProxy* Section, int32 LODIndex, FMaterialRenderProxy* MaterialProxy, const TUniformBuffer<FPrimitiveUniformShaderParameters>* PrimitiveUniformBuffer, bool bWireframe, uint32 FirstInstance, uint32 NumInstances) const
+	{
+		INC_DWORD_STAT_BY(STAT_DeformMesh_SectionsDrawn, NumInstances);
+
+		// Allocate a mesh batch and get a ref to the first element
+		FMeshBatch& Mesh = Collector.AllocateMesh();
+		FillMeshBatch(Mesh, Section, LODIndex, MaterialProxy, FirstInstance, NumInstances);
+		Mesh.bWireframe = bWireframe;
+
+		FMeshBatchElement& BatchElement = Mesh.Elements[0];
+		BatchElement.PrimitiveUniformBufferResource = PrimitiveUniformBuffer;
+		BatchElement.PrimitiveIdMode = PrimID_DynamicPrimitiveShaderData;
+
+		//Add the batch to the collector
+		Collector.AddMesh(ViewIndex, Mesh);
+	}
+
+	/* Register the sections once as static meshes, the renderer caches their mesh draw commands and we don't need to build batches every frame*/
+	/* The deformation still works since it's read from the transforms SRV, which is updated in place*/
+	/* This is called again when we request a static meshes update, after sections were added, removed or hidden*/
+	virtual void DrawStaticElements(FStaticPrimitiveDrawInterface* PDI) override
+	{
+		bStaticMeshesStale = false;
+
+		if (!bUseStaticDrawPath)
+		{
+			return;
+		}
+
+		if (bInstancedRendering)
+		{
+			for (const FDeformMeshInstanceGroup& Group : InstanceGroups)
+			{
+				DrawStaticSection(PDI, Group.Section, Group.FirstInstance, Group.NumInstances);
+			}
+			return;
+		}
+
+		for (const FDeformMeshSectionProxy* Section : Sections)
+		{
+			if (Section != nullptr && Section->bSectionVisible)
+			{
+				DrawStaticSection(PDI, Section, 0, 1);
+			}
+		}
+	}
+
+	/* Add the static mesh batch of a section (or of an instance group) to the static draw interface*/
+	void DrawStaticSection(FStaticPrimitiveDrawInterface* PDI, const FDeformMeshSectionProxy* Section, uint32 FirstInstance, uint32 NumInstances)
+	{
+		FMeshBatch Mesh;
+		FillMeshBatch(Mesh, Section, GetFixedSectionLOD(Section), Section->Material->GetRenderProxy(), FirstInstance, NumInstances);
+
+		//Static meshes use the uniform buffer of the primitive, instead of a temporary one
+		FMeshBatchElement& BatchElement = Mesh.Elements[0];
+		BatchElement.PrimitiveUniformBuffer = GetUniformBuffer();
+		BatchElement.PrimitiveIdMode = PrimID_FromPrimitiveSceneInfo;
+
+		PDI->DrawMesh(Mesh, FLT_MAX);
+	}
+
+	/* Fill the mesh batch with the render data of one LOD of the section, this is shared by the dynamic and the static paths*/
+	void FillMeshBatch(FMeshBatch& Mesh, const FDeformMeshSectionProxy* Section, int32 LODIndex, FMaterialRenderProxy* MaterialProxy, uint32 FirstInstance, uint32 NumInstances) const
+	{
+		const FDeformMeshSectionLOD& LOD = Section->LODs[LODIndex];
+
+		FMeshBatchElement& BatchElement = Mesh.Elements[0];
+		//Fill this batch element with the mesh section's render data
+		BatchElement.IndexBuffer = LOD.IndexBuffer;
+		//The sections deformed on the CPU are drawn with the vertex factory that reads their deformed positions
+		Mesh.VertexFactory = Section->CPUDeform.IsValid() ? (const FVertexFactory*)&Section->CPUDeform->VertexFactory : LOD.VertexFactory.Get();
+		Mesh.MaterialRenderProxy = MaterialProxy;
+		Mesh.LODIndex = LODIndex;
+
+		//Additional data 
+		BatchElement.FirstIndex = 0;
+		BatchElement.NumPrimitives = LOD.NumPrimitives;
+		BatchElement.MinVertexIndex = 0;
+		BatchElement.MaxVertexIndex = LOD.MaxVertexIndex;
+		BatchElement.NumInstances = NumInstances;
+		//The vertex factory shader parameters read it back to bind DMInstanceOffset
+		BatchElement.UserIndex = FirstInstance;
+		Mesh.ReverseCulling = IsLocalToWorldDeterminantNegative();
+		Mesh.Type = PT_TriangleList;
+		Mesh.DepthPriorityGroup = SDPG_World;
+		Mesh.bCanApplyViewModeOverrides = false;
+	}
+
+	/* The cached static meshes don't match the sections anymore, we draw with the dynamic path until the renderer calls DrawStaticElements() again*/
+	void MarkStaticMeshesStale_RenderThread()
+	{
+		if (bUseStaticDrawPath && !bStaticMeshesStale)
+		{
+			bStaticMeshesStale = true;
+			GetScene().UpdateCachedRenderStates(this);
+		}
+	}
+
+	virtual FPrimitiveViewRelevance GetViewRelevance(const FSceneView* View) const
+	{
+		FPrimitiveViewRelevance Result;
+		Result.bDrawRelevance = IsShown(View);
+		Result.bShadowRelevance = IsShadowCast(View);
+		//The static path is used for stable components, we fall back to the dynamic path while the sections are changing, and for the rich views (Editor view modes)
+		const bool bStaticPath = bUseStaticDrawPath && !bStaticMeshesStale && !IsRichView(*View->Family);
+		Result.bStaticRelevance = bStaticPath;
+		Result.bDynamicRelevance = !bStaticPath;
+		Result.bRenderInMainPass = ShouldRenderInMainPass();
+		Result.bUsesLightingChannels = GetLightingChannelMask() != GetDefaultLightingChannelMask();
+		Result.bRenderCustomDepth = ShouldRenderCustomDepth();
+		Result.bTranslucentSelfShadow = bCastVolumetricTranslucentShadow;
+		MaterialRelevance.SetPrimitiveViewRelevance(Result);
+		Result.bVelocityRelevance = IsMovable() && Result.bOpaque && Result.bRenderInMainPass;
+		return Result;
+	}
+
+	virtual bool CanBeOccluded() const override
+	{
+		return !MaterialRelevance.bDisableDepthTest;
+	}
+
+	virtual uint32 GetMemoryFootprint(void) const
+	{
+		return(sizeof(*this) + GetAllocatedSize());
+	}
+
+	/* The index buffers are shared with the static meshes so they're not part of this, the bytes that we didn't have to copy are reported by STAT_DeformMesh_SharedIndexBufferMemorySaved*/
+	/* The GPU buffers aren't part of it either, they're reported by the memory stats of the DeformMesh group*/
+	uint32 GetAllocatedSize(void) const
+	{
+		SIZE_T SectionsSize = 0;
+		for (const FDeformMeshSectionProxy* Section : Sections)
+		{
+			if (Section != nullptr)
+			{
+				SectionsSize += Section->GetAllocatedSize();
+			}
+		}
+
+		return(FPrimitiveSceneProxy::GetAllocatedSize() + Sections.GetAllocatedSize() + SectionsSize
+			+ DeformTransforms.GetAllocatedSize() + DirtyTransforms.GetAllocatedSize() + SectionWorldBounds.GetAllocatedSize()
+			+ InstanceGroups.GetAllocatedSize() + InstanceGroupIndices.GetAllocatedSize() + InstanceTransformIndices.GetAllocatedSize()
+			+ SectionInterpolations.GetAllocatedSize() + InterpolatingSections.GetAllocatedSize() + LatticePoints.GetAllocatedSize());
+	}
+
+	/* Size of the index data that the sections would have copied if they didn't share the static meshes' index buffers*/
+	inline SIZE_T GetSharedIndexBufferBytes() const { return SharedIndexBufferBytes; }
+
+	//Getter to the SRV of the transforms structured buffer, it's the buffer of the pool shared by all the proxies of the scene
+	inline FRHIShaderResourceView* GetDeformTransformsSRV() const { return TransformsPool ? TransformsPool->GetSRV().GetReference() : nullptr; }
+
+	//Getter to the SRV of the transforms of the previous frame, at the same offsets, for the velocity pass
+	inline FRHIShaderResourceView* GetPrevDeformTransformsSRV() const { return TransformsPool ? TransformsPool->GetPrevSRV().GetReference() : nullptr; }
+
+	//Getter to the pool of the scene of this proxy, null until the proxy allocates its range (Never with the CPU deformation)
+	inline FDeformMeshTransformsPool* GetTransformsPool() const { return TransformsPool; }
+
+	//Index of the first transform of this proxy in the pooled buffer, the shader gets the transform of a section at this base + the section index
+	inline uint32 GetTransformIndexBase() const { return TransformsPoolOffset != INDEX_NONE ? TransformsPoolOffset / SectionStride : 0; }
+
+	//Number of float4 elements per section in the pooled buffer, the shader finds the transform of a section at its transform index * this stride
+	inline uint32 GetSectionStride() const { return SectionStride; }
+
+	//Whether each section has a float4 for the parameters of its deformer after its transform, it's fixed for the lifetime of the proxy so the game thread can read it
+	inline bool HasDeformerParams() const { return SectionStride > TransformStride + NormalMatrixStride; }
+
+	//Whether the sections with a lit material can be drawn by this proxy, it's fixed for the lifetime of the proxy so the game thread can read it
+	inline bool HasLitSections() const { return bLitSections; }
+
+	//Where the normal matrix of a section starts in its SectionStride elements, it's 0 when the sections have no normal matrix so the shader can skip it
+	inline uint32 GetNormalMatrixOffset() const { return NormalMatrixStride > 0 ? SectionStride - NormalMatrixStride : 0; }
+
+	//Getter to the packed transforms of the sections, the pool copies them to its new buffer when it grows
+	inline const TArray<FVector4>& GetDeformTransforms() const { return DeformTransforms; }
+
+	/* The pool moved to new buffers, the cached mesh draw commands still reference the old ones*/
+	void OnTransformsPoolReallocated_RenderThread()
+	{
+		MarkStaticMeshesStale_RenderThread();
+	}
+
+	//Getter to the storage format of the transforms, the shader needs it to decode the structured buffer elements
+	inline EDeformMeshTransformFormat GetDeformTransformFormat() const { return TransformFormat; }
+
+	//Whether the sections are drawn in instance groups, the shader then gets the transform index from the instance id
+	inline bool IsInstancedRendering() const { return bInstancedRendering; }
+
+	//Getter to the SRV of the instances' transform indices, only valid in instanced mode
+	inline FShaderResourceViewRHIRef& GetInstanceTransformIndicesSRV() { return InstanceTransformIndicesSRV; }
+
+	//Getter to the SRV of the lattice points, or to the null lattice when this proxy has no lattice
+	inline FShaderResourceViewRHIRef& GetLatticePointsSRV() { return LatticePointsSRV.IsValid() ? LatticePointsSRV : GDeformMeshNullLatticeBuffer.SRV; }
+
+	//Getter to the instance groups, one mesh batch is drawn per group and per view in instanced mode
+	inline const TArray<FDeformMeshInstanceGroup>& GetInstanceGroups() const { return InstanceGroups; }
+
+private:
+	/** Array of sections */
+	TArray<FDeformMeshSectionProxy*> Sections;
+
+	FMaterialRelevance MaterialRelevance;
+
+	//The render thread array of transforms of all the sections, packed in TransformFormat (SectionStride float4 per section, the transform, the parameters of the deformer and the normal matrix)
+	//Individual updates of each section's deform transform will just update the entry in this array
+	//Before binding the SRV, we update the content of the structured buffer with this updated array
+	TArray<FVector4> DeformTransforms;
+
+	//Storage format of the deform transforms, copied from the component on creation
+	EDeformMeshTransformFormat TransformFormat;
+
+	//Number of float4 elements of a packed transform
+	int32 TransformStride;
+
+	//Whether the component had sections with a lit material when this proxy was created, the sections with a lit material added later need a new proxy
+	const bool bLitSections;
+
+	//Number of float4 elements of the normal matrix of each section, 0 without lit sections (see GetNormalMatrixStride())
+	const int32 NormalMatrixStride;
+
+	//Number of float4 elements per section in DeformTransforms and in the structured buffer, TransformStride + 1 when the component has deformers + NormalMatrixStride
+	const int32 SectionStride;
+
+	//Number of sections that the range of the transforms pool can hold, it grows geometrically when sections are added in place
+	int32 TransformsCapacity;
+
+	//First float4 element of the range of the transforms pool owned by this proxy, INDEX_NONE until the render resources are created
+	int32 TransformsPoolOffset;
+	/* The pool of the scene of this proxy, where TransformsPoolOffset is allocated*/
+	FDeformMeshTransformsPool* TransformsPool;
+
+	//Size of the static meshes' index buffers referenced by the sections, we used to hold a copy of each one
+	SIZE_T SharedIndexBufferBytes;
+
+	//Size of the instance indices structured buffer on the GPU, for the memory stats
+	SIZE_T TransformsBufferBytes;
+
+	//One bit per transform, set when the transform changed since the last upload of the structured buffer
+	TBitArray<> DirtyTransforms;
+
+	//Whether the structured buffer needs to be updated or not
+	bool bDeformTransformsDirty;
+
+	//The world space bounds of the sections, used to cull them against the frustum of each view
+	FDeformMeshSectionBoundsSoA SectionWorldBounds;
+
+	//Whether we draw one batch per group of sections sharing the same mesh and material, copied from the component on creation
+	bool bInstancedRendering;
+
+	//Whether the sections are registered once as static meshes, copied from the component on creation
+	bool bUseStaticDrawPath;
+
+	//Set when sections were added, removed or hidden, until the renderer gets the new static meshes from DrawStaticElements()
+	bool bStaticMeshesStale;
+
+	//The render thread frame where the transforms were last handed to the pool
+	uint32 TransformsChangeFrame;
+
+	//The groups of visible sections that are drawn with one instanced batch
+	TArray<FDeformMeshInstanceGroup> InstanceGroups;
+
+	//The group of each key, so a new section finds its group without building them again
+	TMap<FDeformMeshInstanceGroupKey, int32> InstanceGroupIndices;
+
+	//The transform indices of the instances of all the groups, each group owns a contiguous range
+	TArray<uint32> InstanceTransformIndices;
+
+	//The structured buffer and its SRV that hold InstanceTransformIndices on the GPU
+	FStructuredBufferRHIRef InstanceTransformIndicesSB;
+	FShaderResourceViewRHIRef InstanceTransformIndicesSRV;
+
+	//The LOD that all the sections use, or INDEX_NONE to select it from the screen size of each section
+	int32 ForcedLOD;
+
+	//The most detailed LOD that the screen size selection can pick
+	int32 MinLOD;
+
+	//Whether the sections are deformed on the CPU, instead of reading the transforms structured buffer in the vertex shader
+	bool bCPUDeformation;
+
+	//Whether the updates of the deform transforms are interpolated, copied from the component on creation
+	bool bInterpolateTransforms;
+
+	//Updates further apart than this aren't interpolated
+	float MaxInterpolationInterval;
+
+	//The interpolation state of each section, only used when bInterpolateTransforms is set
+	TArray<FDeformMeshSectionInterpolation> SectionInterpolations;
+
+	//One bit per section, set while the section is moving towards its last update
+	TBitArray<> InterpolatingSections;
+
+	//The control points of the lattices of all the sections, each lattice owns a contiguous range (See FDeformMeshSectionProxy::LatticeOffset)
+	TArray<FVector4> LatticePoints;
+
+	//The structured buffer and its SRV that hold LatticePoints on the GPU, created with the first lattice
+	FStructuredBufferRHIRef LatticePointsSB;
+	FShaderResourceViewRHIRef LatticePointsSRV;
+
+	//Size of the lattice points structured buffer in float4 elements
+	int32 LatticePointsCapacity;
+};
+
+///////////////////////////////////////////////////////////////////////
+// The pool of deform transforms, implementation
+///////////////////////////////////////////////////////////////////////
+
+FDeformMeshTransformsPool& FDeformMeshTransformsPool::Get(const FSceneInterface* Scene)
+{
+	check(IsInRenderingThread());
+
+	TUniquePtr<FDeformMeshTransformsPool>& Pool = GDeformMeshTransformsPools.FindOrAdd(Scene);
+	if (!Pool.IsValid())
+	{
+		Pool = MakeUnique<FDeformMeshTransformsPool>();
+		Pool->InitResource();
+	}
+	return *Pool;
+}
+
+FDeformMeshTransformsPool* FDeformMeshTransformsPool::Find(const FSceneInterface* Scene)
+{
+	check(IsInRenderingThread());
+
+	TUniquePtr<FDeformMeshTransformsPool>* Pool = GDeformMeshTransformsPools.Find(Scene);
+	return Pool ? Pool->Get() : nullptr;
+}
+
+void FDeformMeshTransformsPool::ReleaseIfUnused(const FSceneInterface* Scene)
+{
+	check(IsInRenderingThread());
+
+	TUniquePtr<FDeformMeshTransformsPool>* Pool = GDeformMeshTransformsPools.Find(Scene);
+	if (Pool && (*Pool)->Allocations.Num() == 0)
+	{
+		(*Pool)->ReleaseResource();
+		GDeformMeshTransformsPools.Remove(Scene);
+	}
+}
+
+int32 FDeformMeshTransformsPool::Allocate(FDeformMeshSceneProxy* Owner, int32 NumElements, int32 Alignment)
+{
+	check(IsInRenderingThread());
+
+	//First fit, in the holes left by the freed ranges
+	int32 Offset = 0;
+	int32 InsertIdx = 0;
+	for (; InsertIdx < Allocations.Num(); InsertIdx++)
+	{
+		if (Offset + NumElements <= Allocations[InsertIdx].Offset)
+		{
+			break;
+		}
+		const int32 End = Allocations[InsertIdx].Offset + Allocations[InsertIdx].NumElements;
+		Offset = ((End + Alignment - 1) / Alignment) * Alignment;
+	}
+
+	//No hole is big enough, the range is appended and the buffers grow geometrically if it doesn't fit
+	if (Offset + NumElements > Capacity)
+	{
+		Grow(FMath::Max(Offset + NumElements, Capacity * 2));
+	}
+
+	Allocations.Insert({ Offset, NumElements, Owner }, InsertIdx);
+	return Offset;
+}
+
+void FDeformMeshTransformsPool::Free(int32 Offset)
+{
+	check(IsInRenderingThread());
+
+	const int32 AllocationIdx = Allocations.IndexOfByPredicate([Offset](const FAllocation& Allocation) { return Allocation.Offset == Offset; });
+	if (AllocationIdx != INDEX_NONE)
+	{
+		//The dirty ranges of the freed range are uploaded for nothing on the next flush, it's harmless
+		Allocations.RemoveAt(AllocationIdx);
+	}
+}
+
+void FDeformMeshTransformsPool::Grow(int32 NewCapacity)
+{
+	//Both new buffers are initialized with the transforms of all the proxies, so there's nothing left to upload
+	//The sections don't get a velocity during the frame where the pool grows
+	UploadedTransforms.Reset();
+	UploadedTransforms.AddZeroed(NewCapacity);
+	for (const FAllocation& Allocation : Allocations)
+	{
+		const TArray<FVector4>& Transforms = Allocation.Owner->GetDeformTransforms();
+		const int32 NumElements = FMath::Min(Allocation.NumElements, Transforms.Num());
+		if (NumElements > 0)
+		{
+			FMemory::Memcpy(&UploadedTransforms[Allocation.Offset], Transforms.GetData(), NumElements * sizeof(FVector4));
+		}
+	}
+
+	FStructuredBufferRHIRef* Buffers[2] = { &Buffer, &PrevBuffer };
+	FShaderResourceViewRHIRef* SRVs[2] = { &SRV, &PrevSRV };
+	for (int32 BufferIdx = 0; BufferIdx < 2; BufferIdx++)
+	{
+		TResourceArray<FVector4>* ResourceArray = new TResourceArray<FVector4>(true);
+		ResourceArray->Append(UploadedTransforms);
+
+		FRHIResourceCreateInfo CreateInfo;
+		CreateInfo.ResourceArray = ResourceArray;
+		//Set the debug name so we can find the resource when debugging in RenderDoc
+		CreateInfo.DebugName = BufferIdx == 0 ? TEXT("DeformMesh_TransformsPoolSB") : TEXT("DeformMesh_PrevTransformsPoolSB");
+
+		//The previous buffers are released when their refs are replaced, the mesh draw commands that bound them are invalidated below
+		*Buffers[BufferIdx] = RHICreateStructuredBuffer(sizeof(FVector4), NewCapacity * sizeof(FVector4), BUF_ShaderResource, CreateInfo);
+		*SRVs[BufferIdx] = RHICreateShaderResourceView(*Buffers[BufferIdx]);
+	}
+	History.Reset();
+
+	DEC_MEMORY_STAT_BY(STAT_DeformMesh_TransformBufferMemory, 2 * Capacity * sizeof(FVector4));
+	Capacity = NewCapacity;
+	INC_MEMORY_STAT_BY(STAT_DeformMesh_TransformBufferMemory, 2 * Capacity * sizeof(FVector4));
+
+	for (const FAllocation& Allocation : Allocations)
+	{
+		Allocation.Owner->OnTransformsPoolReallocated_RenderThread();
+	}
+}
+
+void FDeformMeshTransformsPool::Flush_RenderThread()
+{
+	check(IsInRenderingThread());
+	if (!Buffer)
+	{
+		return;
+	}
+
+	//The first flush of a frame brings the previous buffer to the end of the last frame, the SRVs stay the same
+	//The proxies that didn't change since then have the same transforms in both buffers, they stop drawing velocities
+	if (History.BeginFlush(GFrameNumberRenderThread))
+	{
+		for (const FAllocation& Allocation : Allocations)
+		{
+			Allocation.Owner->OnTransformsPoolNewFrame_RenderThread(GFrameNumberRenderThread);
+		}
+	}
+
+	if (!History.HasDirtyRanges())
+	{
+		return;
+	}
+	DEFORMMESH_SCOPE_CYCLE_COUNTER(STAT_DeformMesh_UpdateTransformsBuffer);
+
+	//Merge the overlapping and close ranges, the ranges of neighbouring proxies are uploaded with one lock
+	TArray<FIntPoint> CurrentRanges;
+	TArray<FIntPoint> ResyncRanges;
+	TArray<FIntPoint> PreviousRanges;
+	History.EndFlush(DeformTransformsMaxMergedGap * DeformTransformMaxStride, Capacity, CurrentRanges, ResyncRanges, PreviousRanges);
+
+	//The copy of the current buffer still has the transforms of the last frame, the proxies already have the new ones
+	if (ResyncRanges.Num() > 0)
+	{
+		UploadRanges(PrevBuffer, ResyncRanges);
+		INC_DWORD_STAT(STAT_DeformMesh_PrevTransformsCopies);
+	}
+
+	GatherRanges(CurrentRanges);
+	UploadRanges(Buffer, CurrentRanges);
+	//The new ranges have no previous transforms, they're in the gathered current ranges
+	UploadRanges(PrevBuffer, PreviousRanges);
+}
+
+void FDeformMeshTransformsPool::GatherRanges(const TArray<FIntPoint>& Ranges)
+{
+	int32 AllocationIdx = 0;
+	for (const FIntPoint& Range : Ranges)
+	{
+		const int32 Start = Range.X;
+		const int32 End = Range.Y;
+
+		//The gaps between the ranges are written too, they're not used
+		FVector4* BufferData = &UploadedTransforms[Start];
+		FMemory::Memzero(BufferData, (End - Start) * sizeof(FVector4));
+
+		//The ranges and the allocations are sorted, the allocations before this range won't overlap the next ones either
+		while (AllocationIdx < Allocations.Num() && Allocations[AllocationIdx].Offset + Allocations[AllocationIdx].NumElements <= Start)
+		{
+			AllocationIdx++;
+		}
+		for (int32 OverlapIdx = AllocationIdx; OverlapIdx < Allocations.Num() && Allocations[OverlapIdx].Offset < End; OverlapIdx++)
+		{
+			const FAllocation& Allocation = Allocations[OverlapIdx];
+			const TArray<FVector4>& Transforms = Allocation.Owner->GetDeformTransforms();
+			const int32 CopyStart = FMath::Max(Start, Allocation.Offset);
+			const int32 CopyEnd = FMath::Min3(End, Allocation.Offset + Allocation.NumElements, Allocation.Offset + Transforms.Num());
+			if (CopyStart < CopyEnd)
+			{
+				FMemory::Memcpy(&BufferData[CopyStart - Start], &Transforms[CopyStart - Allocation.Offset], (CopyEnd - CopyStart) * sizeof(FVector4));
+			}
+		}
+	}
+}
+
+void FDeformMeshTransformsPool::UploadRanges(FRHIStructuredBuffer* TargetBuffer, const TArray<FIntPoint>& Ranges)
+{
+	for (const FIntPoint& Range : Ranges)
+	{
+		//One lock for the merged range, the buffer isn't dynamic so the rest of it is kept
+		const uint32 Size = (Range.Y - Range.X) * sizeof(FVector4);
+		void* BufferData = RHILockStructuredBuffer(TargetBuffer, Range.X * sizeof(FVector4), Size, RLM_WriteOnly);
+		FMemory::Memcpy(BufferData, &UploadedTransforms[Range.X], Size);
+		RHIUnlockStructuredBuffer(TargetBuffer);
+
+		INC_DWORD_STAT_BY(STAT_DeformMesh_TransformBytesUploaded, Size);
+		INC_DWORD_STAT(STAT_DeformMesh_TransformBufferLocks);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////
+// Automation tests
+/*
+ * They only run the CPU side of the render thread code, so they work headless
+ * eg. UE4Editor.exe Project.uproject -game -nullrhi -ExecCmds="Automation RunTests DeformMesh"
+*/
+///////////////////////////////////////////////////////////////////////
+#if WITH_DEV_AUTOMATION_TESTS
+
+/* Check the normal matrices packed for the lit sections, on random transforms with non uniform and negative scales*/
+/* The deformed normals have to stay perpendicular to the deformed tangents, and the sign in the first row has to match the mirroring of the transform*/
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDeformMeshNormalMatricesTest, "DeformMesh.NormalMatrices", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FDeformMeshNormalMatricesTest::RunTest(const FString& Parameters)
+{
+	const int32 NumTransforms = 1000;
+	FRandomStream Random(NumTransforms);
+	int32 NumErrors = 0;
+
+	for (int32 TransformIdx = 0; TransformIdx < NumTransforms; TransformIdx++)
+	{
+		const FVector Scale(Random.FRandRange(0.2f, 3.f) * (Random.FRand() < 0.2f ? -1.f : 1.f), Random.FRandRange(0.2f, 3.f), Random.FRandRange(0.2f, 3.f));
+		const FTransform Transform(FRotator(Random.FRandRange(-180.f, 180.f), Random.FRandRange(-180.f, 180.f), Random.FRandRange(-180.f, 180.f)), Random.VRand() * 100.f, Scale);
+
+		//Same path as the render thread, from the packed transform
+		FVector4 Packed[DeformTransformMaxStride + 3];
+		PackDeformTransform(Transform, EDeformMeshTransformFormat::Matrix3x4, Packed);
+		const FMatrix DeformMatrix = UnpackDeformTransform(Packed, EDeformMeshTransformFormat::Matrix3x4);
+		PackNormalMatrix(DeformMatrix, &Packed[3]);
+
+		const FVector Normal = Random.GetUnitVector();
+		const FVector Tangent = FVector::CrossProduct(Normal, Random.GetUnitVector()).GetSafeNormal();
+		const FVector DeformedTangent = DeformMatrix.TransformVector(Tangent).GetSafeNormal();
+		const FVector DeformedNormal = FVector(FVector::DotProduct(FVector(Packed[3]), Normal), FVector::DotProduct(FVector(Packed[4]), Normal), FVector::DotProduct(FVector(Packed[5]), Normal)).GetSafeNormal();
+
+		const bool bPerpendicular = FMath::Abs(FVector::DotProduct(DeformedNormal, DeformedTangent)) < 1e-3f;
+		const bool bSign = (Packed[3].W < 0.f) == (DeformMatrix.RotDeterminant() < 0.f);
+		if (!bPerpendicular || !bSign)
+		{
+			NumErrors++;
+		}
+	}
+
+	TestEqual(FString::Printf(TEXT("Transforms with wrong normal matrices, out of %d"), NumTransforms), NumErrors, 0);
+	return true;
+}
+
+/* Check on the CPU that the ranges uploaded by FDeformMeshTransformsHistory keep both buffers in sync with the transforms of the current and previous frames*/
+/* Two arrays stand for the GPU buffers, the frames randomly change some ranges, flush several times, or skip the flush*/
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDeformMeshTransformsHistoryTest, "DeformMesh.TransformsHistory", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FDeformMeshTransformsHistoryTest::RunTest(const FString& Parameters)
+{
+	const int32 NumFrames = 1000;
+	const int32 NumElements = 1024;
+	const int32 MaxGap = DeformTransformsMaxMergedGap * DeformTransformMaxStride;
+	FRandomStream Random(NumFrames);
+
+	//The transforms on the CPU, and the content that each buffer should have
+	TArray<FVector4> Transforms;
+	Transforms.AddZeroed(NumElements);
+	TArray<FVector4> ExpectedPrevious = Transforms;
+	TArray<FVector4> CurrentBuffer = Transforms;
+	TArray<FVector4> PreviousBuffer = Transforms;
+
+	FDeformMeshTransformsHistory History;
+	TArray<FIntPoint> CurrentRanges;
+	TArray<FIntPoint> ResyncRanges;
+	TArray<FIntPoint> PreviousRanges;
+	uint32 FrameNumber = 0;
+
+	for (int32 Frame = 0; Frame < NumFrames; Frame++)
+	{
+		//Some frames don't change anything and don't flush, the transforms of the previous frame are the current ones
+		FrameNumber++;
+		ExpectedPrevious = Transforms;
+		if (Random.FRand() < 0.2f)
+		{
+			continue;
+		}
+
+		const int32 NumFlushes = Random.RandRange(1, 3);
+		for (int32 Flush = 0; Flush < NumFlushes; Flush++)
+		{
+			//Change a few random ranges, some of them are new ranges that go to both buffers
+			const int32 NumChanges = Random.RandRange(0, 4);
+			for (int32 Change = 0; Change < NumChanges; Change++)
+			{
+				const int32 Start = Random.RandRange(0, NumElements - 1);
+				const FIntPoint Range(Start, FMath::Min(Start + Random.RandRange(1, 32), NumElements));
+				for (int32 Element = Range.X; Element < Range.Y; Element++)
+				{
+					Transforms[Element] = FVector4(Random.FRand(), Random.FRand(), Random.FRand(), Random.FRand());
+				}
+				History.MarkDirty(Range, Random.FRand() < 0.1f);
+			}
+
+			History.BeginFlush(FrameNumber);
+			History.EndFlush(MaxGap, NumElements, CurrentRanges, ResyncRanges, PreviousRanges);
+
+			//Same order as the pool: the previous buffer gets the content of the current buffer before it's updated
+			for (const FIntPoint& Range : ResyncRanges)
+			{
+				FMemory::Memcpy(&PreviousBuffer[Range.X], &CurrentBuffer[Range.X], (Range.Y - Range.X) * sizeof(FVector4));
+			}
+			for (const FIntPoint& Range : CurrentRanges)
+			{
+				FMemory::Memcpy(&CurrentBuffer[Range.X], &Transforms[Range.X], (Range.Y - Range.X) * sizeof(FVector4));
+			}
+			for (const FIntPoint& Range : PreviousRanges)
+			{
+				FMemory::Memcpy(&PreviousBuffer[Range.X], &CurrentBuffer[Range.X], (Range.Y - Range.X) * sizeof(FVector4));
+			}
+			//The previous buffer of the merged ranges gets the current transforms, the gaps included
+			for (const FIntPoint& Range : PreviousRanges)
+			{
+				FMemory::Memcpy(&ExpectedPrevious[Range.X], &Transforms[Range.X], (Range.Y - Range.X) * sizeof(FVector4));
+			}
+		}
+
+		//The first wrong frame is enough, the next ones would only repeat it
+		const bool bCurrentMatches = FMemory::Memcmp(CurrentBuffer.GetData(), Transforms.GetData(), NumElements * sizeof(FVector4)) == 0;
+		const bool bPreviousMatches = FMemory::Memcmp(PreviousBuffer.GetData(), ExpectedPrevious.GetData(), NumElements * sizeof(FVector4)) == 0;
+		if (!TestTrue(FString::Printf(TEXT("Frame %d current buffer"), Frame), bCurrentMatches) ||
+			!TestTrue(FString::Printf(TEXT("Frame %d previous buffer"), Frame), bPreviousMatches))
+		{
+			break;
+		}
+	}
+
+	return true;
+}
+
+/* Group section proxies that only have their grouping keys set, and check the groups and the transform indices of their instances*/
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDeformMeshInstanceGroupsTest, "DeformMesh.InstanceGroups", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FDeformMeshInstanceGroupsTest::RunTest(const FString& Parameters)
+{
+	//The meshes and materials are only used as keys, the grouping never reads them
+	const UStaticMesh* MeshA = NewObject<UStaticMesh>(GetTransientPackage());
+	const UStaticMesh* MeshB = NewObject<UStaticMesh>(GetTransientPackage());
+	UMaterialInterface* Material0 = UMaterial::GetDefaultMaterial(MD_Surface);
+	UMaterialInterface* Material1 = UMaterial::GetDefaultMaterial(MD_DeferredDecal);
+
+	TArray<TUniquePtr<FDeformMeshSectionProxy>> OwnedSections;
+	TArray<FDeformMeshSectionProxy*> Sections;
+	auto AddSection = [&](const UStaticMesh* Mesh, UMaterialInterface* Material, int32 NumLODs)
+	{
+		FDeformMeshSectionProxy* Section = new FDeformMeshSectionProxy();
+		Section->StaticMesh = Mesh;
+		Section->Material = Material;
+		for (int32 LODIndex = 0; LODIndex < NumLODs; LODIndex++)
+		{
+			Section->LODs.Add(new FDeformMeshSectionLOD(GMaxRHIFeatureLevel, EDeformMeshDeformer::None));
+		}
+		OwnedSections.Emplace(Section);
+		Sections.Add(Section);
+		return Section;
+	};
+
+	AddSection(MeshA, Material0, 3);													// 0 : group 0
+	AddSection(MeshA, Material0, 3);													// 1 : group 0
+	AddSection(MeshB, Material0, 2);													// 2 : other mesh
+	AddSection(MeshA, Material1, 3);													// 3 : other material
+	AddSection(MeshA, Material0, 3)->bSectionVisible = false;							// 4 : hidden, not drawn
+	AddSection(MeshA, Material0, 1)->SkinWeightBuffer = MakeUnique<FDeformMeshSkinWeightBuffer>();	// 5 : skinned, alone
+	AddSection(MeshA, Material0, 3)->LatticeMode = EDeformMeshLatticeMode::Trilinear;	// 6 : lattice, alone
+	AddSection(MeshA, Material0, 3)->Deformer = EDeformMeshDeformer::Bend;			// 7 : other deformer
+	Sections.Add(nullptr);																// 8 : cleared
+	AddSection(MeshA, Material0, 3);													// 9 : group 0
+	AddSection(MeshA, Material0, 3)->LatticeMode = EDeformMeshLatticeMode::Bernstein;	// 10 : lattice, alone
+	AddSection(MeshA, Material0, 3)->Deformer = EDeformMeshDeformer::Bend;			// 11 : group of 7
+
+	const uint32 TransformIndexBase = 100;
+	TArray<FDeformMeshInstanceGroup> Groups;
+	TMap<FDeformMeshInstanceGroupKey, int32> GroupIndices;
+	TArray<uint32> InstanceTransformIndices;
+	BuildDeformMeshInstanceGroups(Sections, TransformIndexBase, Groups, GroupIndices, InstanceTransformIndices);
+
+	//The groups are sorted by their first section, and each one lists its sections in order
+	const TArray<TArray<int32>> ExpectedGroups = { { 0, 1, 9 }, { 2 }, { 3 }, { 5 }, { 6 }, { 7, 11 }, { 10 } };
+	if (!TestEqual(TEXT("Number of groups"), Groups.Num(), ExpectedGroups.Num()))
+	{
+		return false;
+	}
+	TestEqual(TEXT("Number of instances"), InstanceTransformIndices.Num(), 10);
+
+	for (int32 GroupIdx = 0; GroupIdx < Groups.Num(); GroupIdx++)
+	{
+		const FDeformMeshInstanceGroup& Group = Groups[GroupIdx];
+		const TArray<int32>& Expected = ExpectedGroups[GroupIdx];
+		TestTrue(FString::Printf(TEXT("Group %d is drawn with its first section"), GroupIdx), Group.Section == Sections[Expected[0]]);
+		if (!TestEqual(FString::Printf(TEXT("Group %d instances"), GroupIdx), (int32)Group.NumInstances, Expected.Num()))
+		{
+			continue;
+		}
+		for (int32 InstanceIdx = 0; InstanceIdx < Expected.Num(); InstanceIdx++)
+		{
+			const int32 TransformIndex = (int32)InstanceTransformIndices[Group.FirstInstance + InstanceIdx];
+			TestEqual(FString::Printf(TEXT("Group %d instance %d transform index"), GroupIdx, InstanceIdx), TransformIndex, (int32)TransformIndexBase + Expected[InstanceIdx]);
+
+			//The group is drawn with the fixed LOD of its first section, all its instances need the same LODs
+			TestEqual(FString::Printf(TEXT("Group %d instance %d LODs"), GroupIdx, InstanceIdx), Sections[TransformIndex - TransformIndexBase]->LODs.Num(), Group.Section->LODs.Num());
+		}
+	}
+
+	//Building again gives the same result, the output arrays are reset
+	TArray<FDeformMeshInstanceGroup> RebuiltGroups = Groups;
+	BuildDeformMeshInstanceGroups(Sections, TransformIndexBase, RebuiltGroups, GroupIndices, InstanceTransformIndices);
+	TestEqual(TEXT("Number of groups after a rebuild"), RebuiltGroups.Num(), Groups.Num());
+	TestEqual(TEXT("Number of instances after a rebuild"), InstanceTransformIndices.Num(), 10);
+
+	//Adding the sections one by one gives the same groups as building them, whether the section joins a group in the middle or starts a new one
+	TArray<FDeformMeshInstanceGroup> AddedGroups;
+	TMap<FDeformMeshInstanceGroupKey, int32> AddedGroupIndices;
+	TArray<uint32> AddedInstanceTransformIndices;
+	for (int32 SectionIdx = 0; SectionIdx < Sections.Num(); SectionIdx++)
+	{
+		if (Sections[SectionIdx] != nullptr && Sections[SectionIdx]->bSectionVisible)
+		{
+			AddDeformMeshInstance(Sections[SectionIdx], TransformIndexBase + SectionIdx, AddedGroups, AddedGroupIndices, AddedInstanceTransformIndices);
+		}
+	}
+	TestTrue(TEXT("Added instances"), AddedInstanceTransformIndices == InstanceTransformIndices);
+	if (TestEqual(TEXT("Number of added groups"), AddedGroups.Num(), Groups.Num()))
+	{
+		for (int32 GroupIdx = 0; GroupIdx < Groups.Num(); GroupIdx++)
+		{
+			TestTrue(FString::Printf(TEXT("Added group %d"), GroupIdx), AddedGroups[GroupIdx].Section == Groups[GroupIdx].Section
+				&& AddedGroups[GroupIdx].FirstInstance == Groups[GroupIdx].FirstInstance && AddedGroups[GroupIdx].NumInstances == Groups[GroupIdx].NumInstances);
+		}
+	}
+
+	return true;
+}
+
+/* Select the LODs of a section seen from synthetic distances, with the same screen size as the scene proxy computes for a view*/
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDeformMeshSectionLODTest, "DeformMesh.SectionLOD", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FDeformMeshSectionLODTest::RunTest(const FString& Parameters)
+{
+	//With a 90 degrees field of view, the screen size of the bounds is their radius divided by their distance to the view
+	const FReversedZPerspectiveMatrix ProjMatrix(PI / 4.0f, 1.0f, 1.0f, 10.0f);
+	const float Radius = 50.0f;
+	auto GetScreenSize = [&](float Distance)
+	{
+		return ComputeBoundsScreenSize(FVector4(0, 0, 0, 1), Radius, FVector4(Distance, 0, 0, 1), ProjMatrix);
+	};
+	TestTrue(TEXT("Screen size at 100 units"), FMath::IsNearlyEqual(GetScreenSize(100.0f), 0.5f, KINDA_SMALL_NUMBER));
+
+	const float LODScreenSizes[] = { 1.0f, 0.5f, 0.25f, 0.1f };
+	const int32 NumLODs = UE_ARRAY_COUNT(LODScreenSizes);
+	auto SelectLOD = [&](float Distance, int32 MinLOD)
+	{
+		return SelectDeformMeshSectionLOD(LODScreenSizes, NumLODs, GetScreenSize(Distance), MinLOD);
+	};
+
+	//Bigger than the screen, and between the thresholds of each LOD
+	TestEqual(TEXT("LOD at 40 units"), SelectLOD(40.0f, 0), 0);
+	TestEqual(TEXT("LOD at 75 units"), SelectLOD(75.0f, 0), 0);
+	TestEqual(TEXT("LOD at 150 units"), SelectLOD(150.0f, 0), 1);
+	TestEqual(TEXT("LOD at 300 units"), SelectLOD(300.0f, 0), 2);
+	TestEqual(TEXT("LOD at 1000 units"), SelectLOD(1000.0f, 0), 3);
+
+	//The minimum LOD clamps the finer LODs only
+	TestEqual(TEXT("LOD at 75 units with MinLOD 2"), SelectLOD(75.0f, 2), 2);
+	TestEqual(TEXT("LOD at 1000 units with MinLOD 2"), SelectLOD(1000.0f, 2), 3);
+
+	//A section that gets further away never switches to a finer LOD
+	int32 PrevLOD = 0;
+	for (float Distance = 10.0f; Distance < 5000.0f; Distance *= 1.1f)
+	{
+		const int32 LODIndex = SelectLOD(Distance, 0);
+		if (!TestTrue(FString::Printf(TEXT("LOD at %.1f units is not finer than at the previous distance"), Distance), LODIndex >= PrevLOD))
+		{
+			break;
+		}
+		PrevLOD = LODIndex;
+	}
+	TestEqual(TEXT("LOD of the furthest distance"), PrevLOD, NumLODs - 1);
+
+	return true;
+}
+
+#endif //WITH_DEV_AUTOMATION_TESTS
+
+//////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+// The DeformMesh Vertex factory shader parameters
+/*
+ * We can bind shader parameters here
+ * There's two types of shader parameters: FShaderPrameter and FShaderResourcePramater
+ * We can use the first to pass parameters like floats, integers, arrays
+ * W can use the second to pass shader resources bindings, for example Structured Buffer, texture, samplerstate, etc
+ * Actually that's how manual fetch is implmented; for each of the Vertex Buffers of the stream components, an SRV is created
+ * That SRV can bound as a shader resource parameter and you can fetch the buffers using the SV_VertexID
+*/
+///////////////////////////////////////////////////////////////////////
+class FDeformMeshVertexFactoryShaderParameters : public FVertexFactoryShaderParameters
+{
+	DECLARE_TYPE_LAYOUT(FDeformMeshVertexFactoryShaderParameters, NonVirtual);
+public:
+	void Bind(const FShaderParameterMap& ParameterMap)
+	{
+		/* We bind our shader paramters to the paramtermap that will be used with it, the SPF_Optional flags tells the compiler that this paramter is optional*/
+		/* Otherwise, the shader compiler will complain when this parameter is not present in the shader file*/
+		/* They're all declared and used in Shaders/Private/DeformMeshVertexFactory.ush, which our copy of LocalVertexFactory.ush includes*/
+		/* DMTransforms is a StructuredBuffer<float4>, the transform of the section starts at DMTransformIndex * DMTransformStride, and DMTransformFormat tells how to decode it*/
+		/* (0 = 4x4 matrix, 1 = 3x4 matrix, 2 = quaternion + translation + uniform scale), it's the same for all the draws of a component so the branch in the shader is uniform*/
+		/* DMTransformStride is the size of the format, + 1 when the component has deformers: the parameters of the deformer are the float4 after the transform, + the normal matrix when it has lit sections*/
+		TransformIndex.Bind(ParameterMap, TEXT("DMTransformIndex"), SPF_Optional);
+		TransformFormat.Bind(ParameterMap, TEXT("DMTransformFormat"), SPF_Optional);
+		TransformStride.Bind(ParameterMap, TEXT("DMTransformStride"), SPF_Optional);
+		/* With DEFORM_MESH_LIT, the normals and tangents are deformed with the normal matrix at DMNormalMatrixOffset in the elements of the section (3 rows, like the transforms)*/
+		/* It's 0 for the quaternion format, the shader rotates the normals with the quaternion, and the tangents are always deformed with the transform itself*/
+		NormalMatrixOffset.Bind(ParameterMap, TEXT("DMNormalMatrixOffset"), SPF_Optional);
+		TransformsSRV.Bind(ParameterMap, TEXT("DMTransforms"), SPF_Optional);
+		/* DMPrevTransforms has the same layout, with the transforms of the previous frame. The velocity pass uses it to compute the previous position of the vertices*/
+		PrevTransformsSRV.Bind(ParameterMap, TEXT("DMPrevTransforms"), SPF_Optional);
+		/* In instanced mode (DMInstanced != 0), the transform index is DMInstanceTransformIndices[DMInstanceOffset + InstanceId] instead of DMTransformIndex*/
+		Instanced.Bind(ParameterMap, TEXT("DMInstanced"), SPF_Optional);
+		InstanceOffset.Bind(ParameterMap, TEXT("DMInstanceOffset"), SPF_Optional);
+		InstanceTransformIndicesSRV.Bind(ParameterMap, TEXT("DMInstanceTransformIndices"), SPF_Optional);
+		/* When DMSkinningMode != 0 (1 = linear blend, 2 = dual quaternion), the vertex blends the transforms of its influences (ATTRIBUTE14 indices, ATTRIBUTE15 weights) instead of using DMTransformIndex*/
+		/* The indices of the influences are section indices, the transforms are at DMTransformIndexBase + index*/
+		SkinningMode.Bind(ParameterMap, TEXT("DMSkinningMode"), SPF_Optional);
+		TransformIndexBase.Bind(ParameterMap, TEXT("DMTransformIndexBase"), SPF_Optional);
+		/* When DMLatticeMode != 0 (1 = trilinear, 2 = Bernstein), the position is first moved by the lattice: it's brought to [0, 1] with (Position - DMLatticeMin) * DMLatticeInvSize*/
+		/* and interpolated from the control points DMLatticePoints[DMLatticeOffset + X + DMLatticeResolution.x * (Y + DMLatticeResolution.y * Z)], then deformed as usual*/
+		LatticeMode.Bind(ParameterMap, TEXT("DMLatticeMode"), SPF_Optional);
+		LatticeOffset.Bind(ParameterMap, TEXT("DMLatticeOffset"), SPF_Optional);
+		LatticeResolution.Bind(ParameterMap, TEXT("DMLatticeResolution"), SPF_Optional);
+		LatticeMin.Bind(ParameterMap, TEXT("DMLatticeMin"), SPF_Optional);
+		LatticeInvSize.Bind(ParameterMap, TEXT("DMLatticeInvSize"), SPF_Optional);
+		LatticePointsSRV.Bind(ParameterMap, TEXT("DMLatticePoints"), SPF_Optional);
+	};
+
+	void GetElementShaderBindings(
+		const class FSceneInterface* Scene,
+		const FSceneView* View,
+		const class FMeshMaterialShader* Shader,
+		const EVertexInputStreamType InputStreamType,
+		ERHIFeatureLevel::Type FeatureLevel,
+		const FVertexFactory* VertexFactory,
+		const FMeshBatchElement& BatchElement,
+		class FMeshDrawSingleShaderBindings& ShaderBindings,
+		FVertexInputStreamArray& VertexStreams
+	) const
+	{
+		if (BatchElement.bUserDataIsColorVertexBuffer)
+		{
+			const auto* LocalVertexFactory = static_cast<const FLocalVertexFactory*>(VertexFactory);
+			FColorVertexBuffer* OverrideColorVertexBuffer = (FColorVertexBuffer*)BatchElement.UserData;
+			check(OverrideColorVertexBuffer);
+
+			if (!LocalVertexFactory->SupportsManualVertexFetch(FeatureLevel))
+			{
+				LocalVertexFactory->GetColorOverrideStream(OverrideColorVertexBuffer, VertexStreams);
+			}
+		}
+		const FDeformMeshVertexFactory* DeformMeshVertexFactory = ((FDeformMeshVertexFactory*)VertexFactory);
+
+		/* Get the transform index from the vertex factory and pass it as the value for TransformIndex, offset by the range of the proxy in the transforms pool*/
+		const uint32 Index = DeformMeshVertexFactory->SceneProxy->GetTransformIndexBase() + DeformMeshVertexFactory->TransformIndex;
+		ShaderBindings.Add(TransformIndex, Index);
+		/* Get the storage format of the transforms from the scene proxy*/
+		const uint32 Format = (uint32)DeformMeshVertexFactory->SceneProxy->GetDeformTransformFormat();
+		ShaderBindings.Add(TransformFormat, Format);
+		ShaderBindings.Add(TransformStride, DeformMeshVertexFactory->SceneProxy->GetSectionStride());
+		ShaderBindings.Add(NormalMatrixOffset, DeformMeshVertexFactory->SceneProxy->GetNormalMatrixOffset());
+		/* Get tHE SRV from the scen proxy and pass is as the value for TransformsSRV*/
+		ShaderBindings.Add(TransformsSRV, DeformMeshVertexFactory->SceneProxy->GetDeformTransformsSRV());
+		ShaderBindings.Add(PrevTransformsSRV, DeformMeshVertexFactory->SceneProxy->GetPrevDeformTransformsSRV());
+
+		/* The skinned sections read the transforms of other sections of the proxy*/
+		ShaderBindings.Add(SkinningMode, (uint32)DeformMeshVertexFactory->SkinningMode);
+		ShaderBindings.Add(TransformIndexBase, DeformMeshVertexFactory->SceneProxy->GetTransformIndexBase());
+
+		/* The lattice of the section, its control points are in the lattice points buffer of the scene proxy*/
+		ShaderBindings.Add(LatticeMode, (uint32)DeformMeshVertexFactory->LatticeMode);
+		ShaderBindings.Add(LatticeOffset, DeformMeshVertexFactory->LatticeOffset);
+		ShaderBindings.Add(LatticeResolution, DeformMeshVertexFactory->LatticeResolution);
+		ShaderBindings.Add(LatticeMin, DeformMeshVertexFactory->LatticeMin);
+		ShaderBindings.Add(LatticeInvSize, DeformMeshVertexFactory->LatticeInvSize);
+		ShaderBindings.Add(LatticePointsSRV, DeformMeshVertexFactory->SceneProxy->GetLatticePointsSRV());
+
+		/* In instanced mode, the batch element carries the offset of its group in the instance transform indices buffer*/
+		const bool bInstanced = DeformMeshVertexFactory->SceneProxy->IsInstancedRendering();
+		ShaderBindings.Add(Instanced, (uint32)bInstanced);
+		if (bInstanced)
+		{
+			ShaderBindings.Add(InstanceOffset, (uint32)BatchElement.UserIndex);
+			ShaderBindings.Add(InstanceTransformIndicesSRV, DeformMeshVertexFactory->SceneProxy->GetInstanceTransformIndicesSRV());
+		}
+	};
+private:
+	LAYOUT_FIELD(FShaderParameter, TransformIndex);
+	LAYOUT_FIELD(FShaderParameter, TransformFormat);
+	LAYOUT_FIELD(FShaderParameter, TransformStride);
+	LAYOUT_FIELD(FShaderParameter, NormalMatrixOffset);
+	LAYOUT_FIELD(FShaderResourceParameter, TransformsSRV);
+	LAYOUT_FIELD(FShaderResourceParameter, PrevTransformsSRV);
+	LAYOUT_FIELD(FShaderParameter, Instanced);
+	LAYOUT_FIELD(FShaderParameter, InstanceOffset);
+	LAYOUT_FIELD(FShaderResourceParameter, InstanceTransformIndicesSRV);
+	LAYOUT_FIELD(FShaderParameter, SkinningMode);
+	LAYOUT_FIELD(FShaderParameter, TransformIndexBase);
+	LAYOUT_FIELD(FShaderParameter, LatticeMode);
+	LAYOUT_FIELD(FShaderParameter, LatticeOffset);
+	LAYOUT_FIELD(FShaderParameter, LatticeResolution);
+	LAYOUT_FIELD(FShaderParameter, LatticeMin);
+	LAYOUT_FIELD(FShaderParameter, LatticeInvSize);
+	LAYOUT_FIELD(FShaderResourceParameter, LatticePointsSRV);
+
+};
+
+///////////////////////////////////////////////////////////////////////
+
+IMPLEMENT_TYPE_LAYOUT(FDeformMeshVertexFactoryShaderParameters);
+
+///////////////////////////////////////////////////////////////////////
+
+IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FDeformMeshVertexFactory, SF_Vertex, FDeformMeshVertexFactoryShaderParameters);
+IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FDeformMeshBendVertexFactory, SF_Vertex, FDeformMeshVertexFactoryShaderParameters);
+IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FDeformMeshTwistVertexFactory, SF_Vertex, FDeformMeshVertexFactoryShaderParameters);
+IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FDeformMeshTaperVertexFactory, SF_Vertex, FDeformMeshVertexFactoryShaderParameters);
+IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FDeformMeshWaveVertexFactory, SF_Vertex, FDeformMeshVertexFactoryShaderParameters);
+
+///////////////////////////////////////////////////////////////////////
+
+IMPLEMENT_VERTEX_FACTORY_TYPE(FDeformMeshVertexFactory, "/CustomShaders/LocalVertexFactory.ush", true, true, true, true, true);
+IMPLEMENT_VERTEX_FACTORY_TYPE(FDeformMeshBendVertexFactory, "/CustomShaders/LocalVertexFactory.ush", true, true, true, true, true);
+IMPLEMENT_VERTEX_FACTORY_TYPE(FDeformMeshTwistVertexFactory, "/CustomShaders/LocalVertexFactory.ush", true, true, true, true, true);
+IMPLEMENT_VERTEX_FACTORY_TYPE(FDeformMeshTaperVertexFactory, "/CustomShaders/LocalVertexFactory.ush", true, true, true, true, true);
+IMPLEMENT_VERTEX_FACTORY_TYPE(FDeformMeshWaveVertexFactory, "/CustomShaders/LocalVertexFactory.ush", true, true, true, true, true);
+
+///////////////////////////////////////////////////////////////////////
+
+
+
+
+
+
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Component Methods' Definitions
+///////////////////////////////////////////////////////////////////////
+/*
+ * Most of ths method below are self explanatory, they make changes to the game thread state and propagate changes to the render thread using the scene proxy
+*/
+void UDeformMeshComponent::CreateMeshSection(int32 SectionIndex, UStaticMesh* Mesh, const FTransform& Transform)
+{
+	// Ensure sections array is long enough
+	if (SectionIndex >= DeformMeshSections.Num())
+	{
+		DeformMeshSections.SetNum(SectionIndex + 1, false);
+	}
+
+	// Reset this section (in case it already existed)
+	FDeformMeshSection& NewSection = DeformMeshSections[SectionIndex];
+	if (NewSection.SectionLocalBox.IsValid)
+	{
+		bLocalBoundsNeedShrink = true; // The box of the replaced section may still be part of the overall bounds
+	}
+	NewSection.Reset();
+	SkinnedSectionIndices.Remove(SectionIndex);
+
+	// Fill in the mesh section with the needed data
+	// I'm assuming that the StaticMesh has only one section and I'm only using that
+	NewSection.StaticMesh = Mesh;
+	CheckTransformFormatScale(Transform.GetScale3D());
+	NewSection.DeformTransform = Transform.ToMatrixWithScale().GetTransposed();
+	NewSection.LocalTransform = Transform;
+	bSectionHierarchyNeedsBuild = true;
+
+	//Update the local bound using the bounds of the static mesh that we're adding, deformed by the deform transform
+	NewSection.StaticMesh->CalculateExtendedBounds();
+	if (UpdateSectionLocalBox(NewSection, NewSection.StaticMesh->GetBoundingBox().TransformBy(Transform)))
+	{
+		SendLocalBounds(); // Update overall bounds
+	}
+
+	//The section uses the material of its static mesh, see GetMaterial()
+
+	UpdateSectionProxy(SectionIndex); // Insert the new section in the scene proxy
+}
+
+/// <summary>
+/// Update the Transform Matrix that we use to deform the mesh
+/// The update of the state in the game thread is simple, for the scene proxy update we queue the packed transform
+/// The DeformMesh world subsystem sends the queued transforms of all the components with one render command at the end of the world tick
+/// </summary>
+/// <param name="SectionIndex"> The index for the section that we want to update its DeformTransform </param>
+/// <param name="Transform"> The new Transform Matrix </param>
+void UDeformMeshComponent::UpdateMeshSectionTransform(int32 SectionIndex, const FTransform& Transform)
+{
+	DEFORMMESH_SCOPE_CYCLE_COUNTER(STAT_DeformMesh_UpdateSectionTransform);
+
+	//Cleared sections don't have a static mesh to bound, and the scene proxy has no section to move
+	if (DeformMeshSections.IsValidIndex(SectionIndex) && DeformMeshSections[SectionIndex].StaticMesh)
+	{
+		//Set game thread state
+		CheckTransformFormatScale(Transform.GetScale3D());
+		const FMatrix TransformMatrix = Transform.ToMatrixWithScale().GetTransposed();
+		DeformMeshSections[SectionIndex].DeformTransform = TransformMatrix;
+		//A root's local transform is its deform transform, its children follow it on the next evaluation of the hierarchy
+		if (DeformMeshSections[SectionIndex].ParentIndex == INDEX_NONE)
+		{
+			DeformMeshSections[SectionIndex].LocalTransform = Transform;
+			SectionHierarchy.SetRootDeformMatrix(SectionIndex, TransformMatrix.GetTransposed());
+		}
+
+		//The bounds of the section only depend on the current deform transform, the boxes of the skinned sections are updated by EvaluatePendingTransforms()
+		bSkinnedSectionBoxesDirty |= SkinnedSectionIndices.Num() > 0;
+		const bool bLocalBoundsGrew = !DeformMeshSections[SectionIndex].IsSkinned() &&
+			UpdateSectionLocalBox(DeformMeshSections[SectionIndex], GetSectionMeshBox(DeformMeshSections[SectionIndex]).TransformBy(Transform));
+
+		if (SceneProxy)
+		{
+			//Pack the transform in the format used by the scene proxy, in the queue of pending transforms
+			PendingSectionIndices.Add(SectionIndex);
+			const int32 FirstElement = PendingTransforms.AddUninitialized(GetDeformTransformStride(TransformFormat));
+			PackDeformTransform(Transform, TransformFormat, &PendingTransforms[FirstElement]);
+			PendingSectionBoxes.Add(DeformMeshSections[SectionIndex].SectionLocalBox);
+			//Without a subsystem, FinishTransformsUpdate() sends them
+			QueuePendingTransforms();
+		}
+		//The overall bounds only need to be sent when they grew, the shrinking is deferred to FinishTransformsUpdate()
+		if (bLocalBoundsGrew)
+		{
+			SendLocalBounds();
+		}
+	}
+}
+
+/// <summary>
+/// Batched version of UpdateMeshSectionTransform
+/// All the transforms are converted in one pass and the bounds are updated once, the render thread receives them with the other queued transforms
+/// That same command also updates the structured buffer, so we don't need to call FinishTransformsUpdate() after this
+/// </summary>
+/// <param name="SectionIndices"> The indices of the sections that we want to update </param>
+/// <param name="Transforms"> The new transforms, one per section index </param>
+void UDeformMeshComponent::UpdateMeshSectionTransforms(TArrayView<const int32> SectionIndices, TArrayView<const FTransform> Transforms)
+{
+	DEFORMMESH_SCOPE_CYCLE_COUNTER(STAT_DeformMesh_UpdateSectionTransforms);
+	check(SectionIndices.Num() == Transforms.Num());
+
+	//The roots' local transforms are their deform transforms, their children follow them on the next evaluation of the hierarchy
+	for (int32 UpdateIdx = 0; UpdateIdx < SectionIndices.Num(); UpdateIdx++)
+	{
+		const int32 SectionIndex = SectionIndices[UpdateIdx];
+		if (DeformMeshSections.IsValidIndex(SectionIndex) && DeformMeshSections[SectionIndex].ParentIndex == INDEX_NONE)
+		{
+			DeformMeshSections[SectionIndex].LocalTransform = Transforms[UpdateIdx];
+			if (!SectionHierarchy.IsEmpty())
+			{
+				SectionHierarchy.SetRootDeformMatrix(SectionIndex, Transforms[UpdateIdx].ToMatrixWithScale());
+			}
+		}
+	}
+
+	UpdateMeshSectionTransformsImpl(SectionIndices, Transforms);
+
+	//The children of the roots that moved follow them
+	if (!SectionHierarchy.IsEmpty())
+	{
+		EvaluateSectionHierarchy();
+	}
+}
+
+/* Helpers for the batched update, it takes the transforms set by the user and the matrices computed by the hierarchy*/
+static inline FMatrix GetSectionDeformMatrix(const FTransform& Transform) { return Transform.ToMatrixWithScale(); }
+static inline FMatrix GetSectionDeformMatrix(const FMatrix& Matrix) { return Matrix; }
+static inline FVector GetSectionDeformScale(const FTransform& Transform) { return Transform.GetScale3D(); }
+static inline FVector GetSectionDeformScale(const FMatrix& Matrix) { return FTransform(Matrix).GetScale3D(); }
+static inline void PackSectionDeformTransform(const FTransform& Transform, EDeformMeshTransformFormat Format, FVector4* OutData) { PackDeformTransform(Transform, Format, OutData); }
+static inline void PackSectionDeformTransform(const FMatrix& Matrix, EDeformMeshTransformFormat Format, FVector4* OutData) { PackDeformTransform(Matrix.GetTransposed(), Format, OutData); }
+
+template<typename TransformType>
+void UDeformMeshComponent::UpdateMeshSectionTransformsImpl(TArrayView<const int32> SectionIndices, TArrayView<const TransformType> Transforms)
+{
+	//The format has to be settled before we pack anything, the stride depends on it
+	if (TransformFormat == EDeformMeshTransformFormat::QuatTranslationScale)
+	{
+		for (const TransformType& Transform : Transforms)
+		{
+			if (CheckTransformFormatScale(GetSectionDeformScale(Transform)))
+			{
+				break;
+			}
+		}
+	}
+
+	const int32 Stride = GetDeformTransformStride(TransformFormat);
+
+	//The transforms are only queued when there's a scene proxy to send them to
+	const bool bQueueTransforms = SceneProxy != nullptr;
+	if (bQueueTransforms)
+	{
+		PendingSectionIndices.Reserve(PendingSectionIndices.Num() + SectionIndices.Num());
+		PendingTransforms.Reserve(PendingTransforms.Num() + SectionIndices.Num() * Stride);
+		PendingSectionBoxes.Reserve(PendingSectionBoxes.Num() + SectionIndices.Num());
+	}
+
+	bool bLocalBoundsGrew = false;
+	for (int32 UpdateIdx = 0; UpdateIdx < SectionIndices.Num(); UpdateIdx++)
+	{
+		const int32 SectionIndex = SectionIndices[UpdateIdx];
+		if (DeformMeshSections.IsValidIndex(SectionIndex) && DeformMeshSections[SectionIndex].StaticMesh)
+		{
+			//Set game thread state
+			FDeformMeshSection& Section = DeformMeshSections[SectionIndex];
+			const TransformType& Transform = Transforms[UpdateIdx];
+			Section.DeformTransform = GetSectionDeformMatrix(Transform).GetTransposed();
+			if (!Section.IsSkinned())
+			{
+				bLocalBoundsGrew |= UpdateSectionLocalBox(Section, GetSectionMeshBox(Section).TransformBy(Transform));
+			}
+
+			//Pack the transform directly in the queue of pending transforms, in the format used by the scene proxy
+			if (bQueueTransforms)
+			{
+				PendingSectionIndices.Add(SectionIndex);
+				const int32 FirstElement = PendingTransforms.AddUninitialized(Stride);
+				PackSectionDeformTransform(Transform, TransformFormat, &PendingTransforms[FirstElement]);
+				PendingSectionBoxes.Add(Section.SectionLocalBox);
+			}
+		}
+	}
+
+	//The skinned sections follow the transforms that they blend
+	bLocalBoundsGrew |= UpdateSkinnedSectionBoxes();
+
+	if (PendingSectionIndices.Num() > 0 && !QueuePendingTransforms())
+	{
+		//There's no subsystem to send them at the end of the tick, send them now
+		UDeformMeshComponent* const ThisComponent = this;
+		FlushPendingTransforms(MakeArrayView(&ThisComponent, 1));
+	}
+	// Update overall bounds once for the whole batch
+	if (bLocalBoundsNeedShrink)
+	{
+		UpdateLocalBounds();
+	}
+	else if (bLocalBoundsGrew)
+	{
+		SendLocalBounds();
+	}
+}
+
+void UDeformMeshComponent::UpdateMeshSectionTransforms(TArrayView<const FTransform> Transforms)
+{
+	const int32 NumUpdates = FMath::Min(Transforms.Num(), DeformMeshSections.Num());
+
+	TArray<int32> SectionIndices;
+	SectionIndices.Reserve(NumUpdates);
+	for (int32 SectionIndex = 0; SectionIndex < NumUpdates; SectionIndex++)
+	{
+		SectionIndices.Add(SectionIndex);
+	}
+
+	UpdateMeshSectionTransforms(SectionIndices, Transforms.Slice(0, NumUpdates));
+}
+
+bool UDeformMeshComponent::SetMeshSectionParent(int32 SectionIndex, int32 ParentIndex)
+{
+	if (!DeformMeshSections.IsValidIndex(SectionIndex) ||
+		(ParentIndex != INDEX_NONE && !DeformMeshSections.IsValidIndex(ParentIndex)))
+	{
+		return false;
+	}
+
+	//Walk up from the new parent, we'd make a cycle if we find the section
+	for (int32 AncestorIndex = ParentIndex; AncestorIndex != INDEX_NONE; AncestorIndex = DeformMeshSections[AncestorIndex].ParentIndex)
+	{
+		if (AncestorIndex == SectionIndex)
+		{
+			UE_LOG(LogDeformMesh, Warning, TEXT("%s: section %d can't be the parent of section %d, it's one of its children"), *GetPathName(), ParentIndex, SectionIndex);
+			return false;
+		}
+	}
+
+	if (DeformMeshSections[SectionIndex].ParentIndex != ParentIndex)
+	{
+		DeformMeshSections[SectionIndex].ParentIndex = ParentIndex;
+		bSectionHierarchyNeedsBuild = true;
+	}
+	return true;
+}
+
+int32 UDeformMeshComponent::GetMeshSectionParent(int32 SectionIndex) const
+{
+	return DeformMeshSections.IsValidIndex(SectionIndex) ? DeformMeshSections[SectionIndex].ParentIndex : INDEX_NONE;
+}
+
+void UDeformMeshComponent::SetMeshSectionLocalTransform(int32 SectionIndex, const FTransform& LocalTransform)
+{
+	if (!DeformMeshSections.IsValidIndex(SectionIndex))
+	{
+		return;
+	}
+
+	DeformMeshSections[SectionIndex].LocalTransform = LocalTransform;
+	if (SectionHierarchy.IsEmpty() && !bSectionHierarchyNeedsBuild)
+	{
+		//No hierarchy, the local transform is the deform transform
+		UpdateMeshSectionTransform(SectionIndex, LocalTransform);
+	}
+	else
+	{
+		SectionHierarchy.SetLocalTransform(SectionIndex, LocalTransform);
+		//The subsystem evaluates the subtree when it flushes the component
+		QueuePendingTransforms();
+	}
+}
+
+void UDeformMeshComponent::SetMeshSectionLocalTransforms(TArrayView<const int32> SectionIndices, TArrayView<const FTransform> LocalTransforms)
+{
+	check(SectionIndices.Num() == LocalTransforms.Num());
+
+	if (SectionHierarchy.IsEmpty() && !bSectionHierarchyNeedsBuild)
+	{
+		//No hierarchy, the local transforms are the deform transforms
+		for (int32 UpdateIdx = 0; UpdateIdx < SectionIndices.Num(); UpdateIdx++)
+		{
+			if (DeformMeshSections.IsValidIndex(SectionIndices[UpdateIdx]))
+			{
+				DeformMeshSections[SectionIndices[UpdateIdx]].LocalTransform = LocalTransforms[UpdateIdx];
+			}
+		}
+		UpdateMeshSectionTransforms(SectionIndices, LocalTransforms);
+		return;
+	}
+
+	for (int32 UpdateIdx = 0; UpdateIdx < SectionIndices.Num(); UpdateIdx++)
+	{
+		SetMeshSectionLocalTransform(SectionIndices[UpdateIdx], LocalTransforms[UpdateIdx]);
+	}
+	EvaluateSectionHierarchy();
+}
+
+/// <summary>
+/// Compute the deform transforms of the sections whose local transform, or the local transform of one of their ancestors, changed
+/// The hierarchy is rebuilt first when sections or parents changed, all the sections are evaluated in that case
+/// </summary>
+void UDeformMeshComponent::EvaluateSectionHierarchy()
+{
+	if (bSectionHierarchyNeedsBuild)
+	{
+		bSectionHierarchyNeedsBuild = false;
+
+		//The hierarchy is optional, without parents the local transforms are the deform transforms
+		const bool bHadHierarchy = !SectionHierarchy.IsEmpty();
+		SectionHierarchy.Reset();
+		if (DeformMeshSections.ContainsByPredicate([](const FDeformMeshSection& Section) { return Section.ParentIndex != INDEX_NONE; }))
+		{
+			TArray<int32> ParentIndices;
+			TArray<FTransform> LocalTransforms;
+			ParentIndices.Reserve(DeformMeshSections.Num());
+			LocalTransforms.Reserve(DeformMeshSections.Num());
+			for (const FDeformMeshSection& Section : DeformMeshSections)
+			{
+				ParentIndices.Add(Section.ParentIndex);
+				LocalTransforms.Add(Section.LocalTransform);
+			}
+			SectionHierarchy.Build(ParentIndices, LocalTransforms);
+		}
+		else
+		{
+			//The last parent was removed, the sections that were children go back to their local transform
+			if (!bHadHierarchy)
+			{
+				return;
+			}
+			TArray<int32> SectionIndices;
+			TArray<FTransform> Transforms;
+			for (int32 SectionIndex = 0; SectionIndex < DeformMeshSections.Num(); SectionIndex++)
+			{
+				const FDeformMeshSection& Section = DeformMeshSections[SectionIndex];
+				if (Section.StaticMesh && !Section.DeformTransform.Equals(Section.LocalTransform.ToMatrixWithScale().GetTransposed()))
+				{
+					SectionIndices.Add(SectionIndex);
+					Transforms.Add(Section.LocalTransform);
+				}
+			}
+			if (SectionIndices.Num() > 0)
+			{
+				UpdateMeshSectionTransformsImpl<FTransform>(SectionIndices, Transforms);
+			}
+			return;
+		}
+	}
+
+	if (!SectionHierarchy.HasDirtySections())
+	{
+		return;
+	}
+
+	DEFORMMESH_SCOPE_CYCLE_COUNTER(STAT_DeformMesh_EvaluateHierarchy);
+	TArray<int32> SectionIndices;
+	TArray<FMatrix> DeformMatrices;
+	SectionHierarchy.Evaluate(SectionIndices, DeformMatrices);
+	if (SectionIndices.Num() > 0)
+	{
+		UpdateMeshSectionTransformsImpl<FMatrix>(SectionIndices, DeformMatrices);
+	}
+}
+
+void UDeformMeshComponent::ClearMeshSection(int32 SectionIndex)
+{
+	if (SectionIndex < DeformMeshSections.Num())
+	{
+		DeformMeshSections[SectionIndex].Reset();
+		SkinnedSectionIndices.Remove(SectionIndex);
+		bSectionHierarchyNeedsBuild = true;
+		UpdateLocalBounds();
+		UpdateSectionProxy(SectionIndex); // Remove the section from the scene proxy
+	}
+}
+
+/// <summary>
+/// This method is called after we finished updating all the section transforms that we want to update
+/// The deform transforms of the sections with a parent are computed here, from the local transforms that changed
+/// The structured buffer is updated with the new transforms when the subsystem flushes the queued transforms, or right away if there's no subsystem
+/// </summary>
+void UDeformMeshComponent::FinishTransformsUpdate()
+{
+	DEFORMMESH_SCOPE_CYCLE_COUNTER(STAT_DeformMesh_FinishTransformsUpdate);
+
+	//An explicit update recomputes the boxes of the skinned sections, whatever moved the transforms that they blend
+	bSkinnedSectionBoxesDirty = SkinnedSectionIndices.Num() > 0;
+	EvaluatePendingTransforms();
+
+	if (SceneProxy && !bPendingTransformsQueued)
+	{
+		UDeformMeshComponent* const ThisComponent = this;
+		FlushPendingTransforms(MakeArrayView(&ThisComponent, 1));
+	}
+}
+
+/// <summary>
+/// Evaluate everything that follows the transforms set since the last update, before they're sent
+/// The subsystem calls it on the queued components when it flushes them, so the hierarchy and the skinned sections don't wait for a FinishTransformsUpdate()
+/// </summary>
+void UDeformMeshComponent::EvaluatePendingTransforms()
+{
+	//The children of the sections that moved follow their parents
+	EvaluateSectionHierarchy();
+
+	//Then the skinned sections follow the transforms that they blend
+	if (bSkinnedSectionBoxesDirty && UpdateSkinnedSectionBoxes() && !bLocalBoundsNeedShrink)
+	{
+		SendLocalBounds();
+	}
+
+	//Some sections moved away from the border of the overall bounds, we can shrink them now that all the sections were updated
+	if (bLocalBoundsNeedShrink)
+	{
+		UpdateLocalBounds();
+	}
+}
+
+bool UDeformMeshComponent::QueuePendingTransforms()
+{
+	if (!bPendingTransformsQueued)
+	{
+		UWorld* World = GetWorld();
+		UDeformMeshSubsystem* Subsystem = World ? World->GetSubsystem<UDeformMeshSubsystem>() : nullptr;
+		if (Subsystem == nullptr)
+		{
+			return false;
+		}
+		Subsystem->QueueComponent(this);
+		bPendingTransformsQueued = true;
+	}
+	return true;
+}
+
+/* Flush the pools of the scenes of some proxies once each, after they all marked their dirty ranges*/
+/* The proxies are usually in the same scene, since they're flushed by the subsystem of their world*/
+static void FlushDeformMeshTransformsPools_RenderThread(TArrayView<FDeformMeshSceneProxy* const> SceneProxies)
+{
+	TArray<FDeformMeshTransformsPool*, TInlineAllocator<1>> Pools;
+	for (FDeformMeshSceneProxy* DeformMeshSceneProxy : SceneProxies)
+	{
+		if (FDeformMeshTransformsPool* Pool = DeformMeshSceneProxy->GetTransformsPool())
+		{
+			Pools.AddUnique(Pool);
+		}
+	}
+	for (FDeformMeshTransformsPool* Pool : Pools)
+	{
+		Pool->Flush_RenderThread();
+	}
+}
+
+/// <summary>
+/// Send the pending transforms of multiple components to the render thread, and move the interpolated transforms of other components to the world time Time
+/// One render command applies the transforms of all the scene proxies, advances their interpolations, then the pool of transforms uploads the dirty ranges of all of them together
+/// </summary>
+void UDeformMeshComponent::FlushPendingTransforms(TArrayView<UDeformMeshComponent* const> Components, TArrayView<UDeformMeshComponent* const> InterpolatedComponents, float Time)
+{
+	DEFORMMESH_SCOPE_CYCLE_COUNTER(STAT_DeformMesh_FlushPendingTransforms);
+
+	TArray<TPair<FDeformMeshSceneProxy*, FDeformMeshTransformsUpdateData>> Updates;
+	Updates.Reserve(Components.Num());
+
+	for (UDeformMeshComponent* Component : Components)
+	{
+		//The components queued in the subsystem didn't go through FinishTransformsUpdate(), their children and skinned sections are evaluated now
+		//They stay marked as queued until their pending transforms are moved, so the transforms that this adds are queued with the others
+		if (Component->bPendingTransformsQueued)
+		{
+			Component->EvaluatePendingTransforms();
+		}
+
+		//The proxy may have been recreated since the transforms were queued, the new proxy already has them, but sending them again is harmless
+		FDeformMeshSceneProxy* DeformMeshSceneProxy = (FDeformMeshSceneProxy*)Component->SceneProxy;
+		//Even without new transforms, a FinishTransformsUpdate() asks the proxy to upload its dirty transforms
+		if (DeformMeshSceneProxy)
+		{
+			FDeformMeshTransformsUpdateData UpdateData;
+			UpdateData.Format = Component->TransformFormat;
+			UpdateData.Time = Component->LastTransformsFlushTime = Component->GetWorld() ? Component->GetWorld()->GetTimeSeconds() : 0.f;
+			UpdateData.SectionIndices = MoveTemp(Component->PendingSectionIndices);
+			UpdateData.Transforms = MoveTemp(Component->PendingTransforms);
+			UpdateData.SectionLocalBoxes = MoveTemp(Component->PendingSectionBoxes);
+			UpdateData.DeformerSectionIndices = MoveTemp(Component->PendingDeformerSectionIndices);
+			UpdateData.DeformerParams = MoveTemp(Component->PendingDeformerParams);
+			Updates.Emplace(DeformMeshSceneProxy, MoveTemp(UpdateData));
+		}
+
+		Component->PendingSectionIndices.Reset();
+		Component->PendingTransforms.Reset();
+		Component->PendingSectionBoxes.Reset();
+		Component->PendingDeformerSectionIndices.Reset();
+		Component->PendingDeformerParams.Reset();
+		Component->bPendingTransformsQueued = false;
+	}
+
+	TArray<FDeformMeshSceneProxy*> InterpolatedSceneProxies;
+	InterpolatedSceneProxies.Reserve(InterpolatedComponents.Num());
+	for (UDeformMeshComponent* Component : InterpolatedComponents)
+	{
+		if (Component->SceneProxy && Component->bInterpolateTransforms)
+		{
+			InterpolatedSceneProxies.Add((FDeformMeshSceneProxy*)Component->SceneProxy);
+		}
+	}
+
+	if (Updates.Num() == 0 && InterpolatedSceneProxies.Num() == 0)
+	{
+		return;
+	}
+
+	INC_DWORD_STAT(STAT_DeformMesh_TransformUpdateCommands);
+
+	// Enqueue one command that applies the transforms of all the proxies, interpolates the others and updates the structured buffer
+	ENQUEUE_RENDER_COMMAND(FDeformMeshBatchedTransformsUpdate)(
+		[Updates = MoveTemp(Updates), InterpolatedSceneProxies = MoveTemp(InterpolatedSceneProxies), Time](FRHICommandListImmediate& RHICmdList)
+		{
+			TArray<FDeformMeshSceneProxy*, TInlineAllocator<64>> SceneProxies;
+			for (const TPair<FDeformMeshSceneProxy*, FDeformMeshTransformsUpdateData>& Update : Updates)
+			{
+				Update.Key->UpdateDeformTransforms_RenderThread(Update.Value);
+				SceneProxies.Add(Update.Key);
+			}
+			//The new transforms are the targets of the interpolations, so they're applied first
+			//A proxy can have both, its transforms are only uploaded once
+			TSet<FDeformMeshSceneProxy*> UpdatedSceneProxies;
+			if (Updates.Num() > 0 && InterpolatedSceneProxies.Num() > 0)
+			{
+				UpdatedSceneProxies.Append(SceneProxies);
+			}
+			for (FDeformMeshSceneProxy* DeformMeshSceneProxy : InterpolatedSceneProxies)
+			{
+				DeformMeshSceneProxy->InterpolateTransforms_RenderThread(Time);
+				if (!UpdatedSceneProxies.Contains(DeformMeshSceneProxy))
+				{
+					SceneProxies.Add(DeformMeshSceneProxy);
+				}
+			}
+			for (FDeformMeshSceneProxy* DeformMeshSceneProxy : SceneProxies)
+			{
+				DeformMeshSceneProxy->UpdateDeformTransformsSB_RenderThread(false);
+			}
+			FlushDeformMeshTransformsPools_RenderThread(SceneProxies);
+		});
+}
+
+/// <summary>
+/// Flush the pool of transforms of a world's scene without sending new transforms
+/// The first flush of a frame copies the last frame's changes to the previous buffer, this is needed on the frame after a change so the sections that stopped don't keep a velocity
+/// </summary>
+void UDeformMeshComponent::FlushTransformsPool(UWorld* World)
+{
+	if (World == nullptr || World->Scene == nullptr)
+	{
+		return;
+	}
+
+	//The scene is only used as the key of its pool, the pool is gone if the scene has no proxy with transforms anymore
+	const FSceneInterface* Scene = World->Scene;
+	ENQUEUE_RENDER_COMMAND(FDeformMeshFlushTransformsPool)(
+		[Scene](FRHICommandListImmediate& RHICmdList)
+		{
+			if (FDeformMeshTransformsPool* Pool = FDeformMeshTransformsPool::Find(Scene))
+			{
+				Pool->Flush_RenderThread();
+			}
+		});
+}
+
+void UDeformMeshComponent::ClearAllMeshSections()
+{
+	DeformMeshSections.Empty();
+	SkinnedSectionIndices.Reset();
+	SectionHierarchy.Reset();
+	bSectionHierarchyNeedsBuild = false;
+	UpdateLocalBounds();
+
+	if (SceneProxy)
+	{
+		// Enqueue command to remove all the sections from the scene proxy
+		FDeformMeshSceneProxy* DeformMeshSceneProxy = (FDeformMeshSceneProxy*)SceneProxy;
+		ENQUEUE_RENDER_COMMAND(FDeformMeshRemoveAllSections)(
+			[DeformMeshSceneProxy](FRHICommandListImmediate& RHICmdList)
+			{
+				DeformMeshSceneProxy->RemoveAllSections_RenderThread();
+			});
+	}
+}
+
+void UDeformMeshComponent::SetMeshSectionVisible(int32 SectionIndex, bool bNewVisibility)
+{
+	if (SectionIndex < DeformMeshSections.Num())
+	{
+		// Set game thread state
+		DeformMeshSections[SectionIndex].bSectionVisible = bNewVisibility;
+
+		if (SceneProxy)
+		{
+			// Enqueue command to modify render thread info
+			FDeformMeshSceneProxy* DeformMeshSceneProxy = (FDeformMeshSceneProxy*)SceneProxy;
+			ENQUEUE_RENDER_COMMAND(FDeformMeshSectionVisibilityUpdate)(
+				[DeformMeshSceneProxy, SectionIndex, bNewVisibility](FRHICommandListImmediate& RHICmdList)
+				{
+					DeformMeshSceneProxy->SetSectionVisibility_RenderThread(SectionIndex, bNewVisibility);
+				});
+		}
+	}
+}
+
+bool UDeformMeshComponent::IsMeshSectionVisible(int32 SectionIndex) const
+{
+	return (SectionIndex < DeformMeshSections.Num()) ? DeformMeshSections[SectionIndex].bSectionVisible : false;
+}
+
+int32 UDeformMeshComponent::GetNumSections() const
+{
+	return DeformMeshSections.Num();
+}
+
+void UDeformMeshComponent::SetTransformFormat(EDeformMeshTransformFormat NewFormat)
+{
+	if (TransformFormat != NewFormat)
+	{
+		TransformFormat = NewFormat;
+		//The queued transforms were packed in the old format, the new proxy gets all the transforms from the sections anyway
+		PendingSectionIndices.Reset();
+		PendingTransforms.Reset();
+		PendingSectionBoxes.Reset();
+		PendingDeformerSectionIndices.Reset();
+		PendingDeformerParams.Reset();
+		MarkRenderStateDirty(); // The transforms buffer layout changed, we need to recreate the scene proxy
+	}
+}
+
+bool UDeformMeshComponent::CheckTransformFormatScale(const FVector& Scale)
+{
+	//The quaternion format only has room for one positive scale, anything else would be drawn with the largest axis of the scale
+	if (TransformFormat == EDeformMeshTransformFormat::QuatTranslationScale && !(Scale.AllComponentsEqual(KINDA_SMALL_NUMBER) && Scale.X > 0.f))
+	{
+		UE_LOG(LogDeformMesh, Warning, TEXT("%s: QuatTranslationScale can't store the scale %s, the component falls back to Matrix3x4"), *GetPathName(), *Scale.ToString());
+		//The new scene proxy packs all the transforms of the sections in the new format, the ones queued for the old proxy are dropped
+		SetTransformFormat(EDeformMeshTransformFormat::Matrix3x4);
+		return true;
+	}
+	return false;
+}
+
+void UDeformMeshComponent::SetUseStaticDrawPath(bool bNewUseStaticDrawPath)
+{
+	if (bUseStaticDrawPath != bNewUseStaticDrawPath)
+	{
+		bUseStaticDrawPath = bNewUseStaticDrawPath;
+		MarkRenderStateDirty(); // The scene proxy needs to register its static meshes, or stop using them
+	}
+}
+
+bool UDeformMeshComponent::LineTraceSections(const FVector& Start, const FVector& End, FDeformMeshTraceHit& OutHit) const
+{
+	OutHit = FDeformMeshTraceHit();
+
+	//The sections' boxes are in the local space of the component, so we bring the segment there first
+	const FTransform& ComponentToWorld = GetComponentTransform();
+	const FVector LocalStart = ComponentToWorld.InverseTransformPosition(Start);
+	const FVector LocalEnd = ComponentToWorld.InverseTransformPosition(End);
+	const FVector LocalDir = LocalEnd - LocalStart;
+
+	//The hit time is the fraction of the segment, it's the same in all the spaces since the transforms are affine
+	float BestTime = 1.f;
+	FVector BestLocalNormal = FVector::ZeroVector;
+	TArray<FVector> DeformedPositions;
+	for (int32 SectionIndex = 0; SectionIndex < DeformMeshSections.Num(); SectionIndex++)
+	{
+		const FDeformMeshSection& Section = DeformMeshSections[SectionIndex];
+		if (Section.StaticMesh == nullptr || !Section.bSectionVisible || !Section.SectionLocalBox.IsValid)
+		{
+			continue;
+		}
+
+		//Section level pre-pass, the local box of the section bounds its deformed mesh
+		if (!FMath::LineBoxIntersection(Section.SectionLocalBox, LocalStart, LocalEnd, LocalDir))
+		{
+			continue;
+		}
+
+		//The other sections can't be brought back in their undeformed space, their triangles are deformed on the CPU and all of them are tested in the local space of the component
+		if (!Section.IsRigid())
+		{
+			TSharedPtr<const FDeformMeshBVH> BVH = FDeformMeshBVH::GetOrBuild(Section.StaticMesh);
+			FDeformMeshBVHHit MeshHit;
+			if (BVH.IsValid() && GetDeformedSectionPositions(SectionIndex, DeformedPositions) &&
+				BVH->LineTraceDeformed(DeformedPositions, LocalStart, LocalEnd, MeshHit) && MeshHit.Time < BestTime)
+			{
+				BestTime = MeshHit.Time;
+				BestLocalNormal = MeshHit.Normal;
+				OutHit.SectionIndex = SectionIndex;
+				OutHit.FaceIndex = MeshHit.FaceIndex;
+			}
+			continue;
+		}
+
+		const FMatrix DeformMatrix = Section.DeformTransform.GetTransposed();
+		if (FMath::Abs(DeformMatrix.Determinant()) < SMALL_NUMBER)
+		{
+			continue;
+		}
+		TSharedPtr<const FDeformMeshBVH> BVH = FDeformMeshBVH::GetOrBuild(Section.StaticMesh);
+		if (!BVH.IsValid())
+		{
+			continue;
+		}
+
+		//Trace in the undeformed space of the mesh, where the BVH was built
+		const FMatrix InvDeformMatrix = DeformMatrix.Inverse();
+		FDeformMeshBVHHit MeshHit;
+		if (BVH->LineTrace(InvDeformMatrix.TransformPosition(LocalStart), InvDeformMatrix.TransformPosition(LocalEnd), MeshHit) && MeshHit.Time < BestTime)
+		{
+			BestTime = MeshHit.Time;
+			BestLocalNormal = DeformMatrix.TransposeAdjoint().TransformVector(MeshHit.Normal);
+			OutHit.SectionIndex = SectionIndex;
+			OutHit.FaceIndex = MeshHit.FaceIndex;
+		}
+	}
+
+	if (OutHit.SectionIndex == INDEX_NONE)
+	{
+		return false;
+	}
+
+	const FVector Dir = End - Start;
+	OutHit.Location = Start + Dir * BestTime;
+	OutHit.Distance = Dir.Size() * BestTime;
+	OutHit.Normal = ComponentToWorld.ToMatrixWithScale().TransposeAdjoint().TransformVector(BestLocalNormal).GetSafeNormal();
+	if ((OutHit.Normal | Dir) > 0.f)
+	{
+		OutHit.Normal = -OutHit.Normal;
+	}
+	return true;
+}
+
+bool UDeformMeshComponent::OverlapSphereSections(const FVector& Center, float Radius, TArray<int32>& OutSectionIndices) const
+{
+	OutSectionIndices.Reset();
+
+	const FTransform& ComponentToWorld = GetComponentTransform();
+	const FMatrix ComponentToWorldMatrix = ComponentToWorld.ToMatrixWithScale();
+	const float RadiusSquared = FMath::Square(Radius);
+	TArray<FVector> DeformedPositions;
+
+	for (int32 SectionIndex = 0; SectionIndex < DeformMeshSections.Num(); SectionIndex++)
+	{
+		const FDeformMeshSection& Section = DeformMeshSections[SectionIndex];
+		if (Section.StaticMesh == nullptr || !Section.bSectionVisible || !Section.SectionLocalBox.IsValid)
+		{
+			continue;
+		}
+
+		//Section level pre-pass, the local box of the section bounds its deformed mesh
+		if (!FMath::SphereAABBIntersection(Center, RadiusSquared, Section.SectionLocalBox.TransformBy(ComponentToWorldMatrix)))
+		{
+			continue;
+		}
+
+		TSharedPtr<const FDeformMeshBVH> BVH = FDeformMeshBVH::GetOrBuild(Section.StaticMesh);
+		if (!BVH.IsValid())
+		{
+			continue;
+		}
+
+		//The triangles of the other sections are deformed on the CPU, in the local space of the component, and all of them are tested
+		if (!Section.IsRigid())
+		{
+			if (GetDeformedSectionPositions(SectionIndex, DeformedPositions) && BVH->SphereOverlapDeformed(DeformedPositions, Center, Radius, ComponentToWorldMatrix))
+			{
+				OutSectionIndices.Add(SectionIndex);
+			}
+			continue;
+		}
+
+		//The BVH was built in the undeformed space of the mesh, its triangles are brought in world space, where the sphere stays a sphere
+		const FMatrix MeshToWorld = Section.DeformTransform.GetTransposed() * ComponentToWorldMatrix;
+		if (BVH->SphereOverlap(Center, Radius, MeshToWorld))
+		{
+			OutSectionIndices.Add(SectionIndex);
+		}
+	}
+
+	return OutSectionIndices.Num() > 0;
+}
+
+void UDeformMeshComponent::SetUseCPUDeformation(bool bNewUseCPUDeformation)
+{
+	if (bUseCPUDeformation != bNewUseCPUDeformation)
+	{
+		bUseCPUDeformation = bNewUseCPUDeformation;
+		MarkRenderStateDirty(); // The sections need to create or release their dynamic position buffers
+	}
+}
+
+bool UDeformMeshComponent::GetDeformedSectionPositions(int32 SectionIndex, TArray<FVector>& OutPositions, int32 LODIndex) const
+{
+	OutPositions.Reset();
+	if (!DeformMeshSections.IsValidIndex(SectionIndex))
+	{
+		return false;
+	}
+
+	const FDeformMeshSection& Section = DeformMeshSections[SectionIndex];
+	if (Section.StaticMesh == nullptr || Section.StaticMesh->RenderData == nullptr ||
+		!Section.StaticMesh->RenderData->LODResources.IsValidIndex(LODIndex))
+	{
+		return false;
+	}
+
+	const FPositionVertexBuffer& PositionBuffer = Section.StaticMesh->RenderData->LODResources[LODIndex].VertexBuffers.PositionVertexBuffer;
+	const FVector* SourcePositions = (const FVector*)PositionBuffer.GetVertexData();
+	if (SourcePositions == nullptr)
+	{
+		return false;
+	}
+
+	const int32 NumVertices = PositionBuffer.GetNumVertices();
+	OutPositions.SetNumUninitialized(NumVertices);
+
+	//The lattice and then the deformer move the positions in the space of the static mesh first
+	TArray<FVector> MeshSpacePositions;
+	if (Section.HasLattice())
+	{
+		TArray<FVector4> ControlPoints;
+		ControlPoints.Reserve(Section.LatticePoints.Num());
+		for (const FVector& Point : Section.LatticePoints)
+		{
+			ControlPoints.Add(FVector4(Point, 0.f));
+		}
+		MeshSpacePositions.SetNumUninitialized(NumVertices);
+		FDeformMeshLattice::DeformPositions(Section.LatticeMode == EDeformMeshLatticeMode::Bernstein, Section.LatticeBox, Section.LatticeResolution, ControlPoints, MakeArrayView(SourcePositions, NumVertices), MeshSpacePositions);
+		SourcePositions = MeshSpacePositions.GetData();
+	}
+	if (Section.HasDeformer())
+	{
+		MeshSpacePositions.SetNumUninitialized(NumVertices);
+		FDeformMeshDeformers::DeformPositions(Section.Deformer, Section.DeformerParams, MakeArrayView(SourcePositions, NumVertices), MeshSpacePositions);
+		SourcePositions = MeshSpacePositions.GetData();
+	}
+
+	//A skinned section blends the transforms of other sections, its influences are for LOD 0
+	if (Section.IsSkinned())
+	{
+		if (LODIndex != 0 || Section.SkinWeights->GetNumVertices() != NumVertices)
+		{
+			OutPositions.Reset();
+			return false;
+		}
+		TArray<FMatrix> DeformMatrices;
+		DeformMatrices.Reserve(DeformMeshSections.Num());
+		for (const FDeformMeshSection& OtherSection : DeformMeshSections)
+		{
+			DeformMatrices.Add(OtherSection.DeformTransform.GetTransposed());
+		}
+		FDeformMeshSkinWeights::SkinPositions(Section.SkinningMode == EDeformMeshSkinningMode::DualQuaternion, DeformMatrices, Section.SkinWeights->GetInfluences(), MakeArrayView(SourcePositions, NumVertices), OutPositions);
+		return true;
+	}
+
+	//The game thread section keeps the transposed matrix
+	DeformPositions(Section.DeformTransform.GetTransposed(), MakeArrayView(SourcePositions, NumVertices), OutPositions);
+	return true;
+}
+
+void UDeformMeshComponent::SetForcedLodModel(int32 NewForcedLodModel)
+{
+	NewForcedLodModel = FMath::Max(NewForcedLodModel, 0);
+	if (ForcedLodModel != NewForcedLodModel)
+	{
+		ForcedLodModel = NewForcedLodModel;
+		MarkRenderStateDirty(); // The LOD settings are copied by the scene proxy
+	}
+}
+
+void UDeformMeshComponent::SetMinLOD(int32 NewMinLOD)
+{
+	NewMinLOD = FMath::Max(NewMinLOD, 0);
+	if (MinLOD != NewMinLOD)
+	{
+		MinLOD = NewMinLOD;
+		MarkRenderStateDirty(); // The LOD settings are copied by the scene proxy
+	}
+}
+
+void UDeformMeshComponent::SetInterpolateTransforms(bool bNewInterpolateTransforms)
+{
+	if (bInterpolateTransforms != bNewInterpolateTransforms)
+	{
+		bInterpolateTransforms = bNewInterpolateTransforms;
+		MarkRenderStateDirty(); // The scene proxy needs to keep the interpolation state of the sections
+	}
+}
+
+bool UDeformMeshComponent::SetMeshSectionSkinWeights(int32 SectionIndex, TSharedPtr<const FDeformMeshSkinWeights, ESPMode::ThreadSafe> SkinWeights, EDeformMeshSkinningMode SkinningMode)
+{
+	if (!DeformMeshSections.IsValidIndex(SectionIndex) || DeformMeshSections[SectionIndex].StaticMesh == nullptr)
+	{
+		return false;
+	}
+
+	FDeformMeshSection& Section = DeformMeshSections[SectionIndex];
+	if (SkinningMode != EDeformMeshSkinningMode::Rigid)
+	{
+		//The influences are read per vertex of LOD 0, and they read the transforms of the proxy's range of the pool
+		const FStaticMeshRenderData* RenderData = Section.StaticMesh->RenderData.Get();
+		const int32 NumVertices = RenderData && RenderData->LODResources.Num() > 0 ? RenderData->LODResources[0].VertexBuffers.PositionVertexBuffer.GetNumVertices() : 0;
+		if (!SkinWeights.IsValid() || SkinWeights->GetNumVertices() != NumVertices)
+		{
+			UE_LOG(LogDeformMesh, Warning, TEXT("%s: the skin weights of section %d don't match the %d vertices of the LOD 0 of %s"), *GetPathName(), SectionIndex, NumVertices, *Section.StaticMesh->GetName());
+			return false;
+		}
+		const TArray<int32>& UsedTransformIndices = SkinWeights->GetUsedTransformIndices();
+		if (UsedTransformIndices.Num() > 0 && UsedTransformIndices.Last() >= DeformMeshSections.Num())
+		{
+			UE_LOG(LogDeformMesh, Warning, TEXT("%s: the skin weights of section %d use section %d, which doesn't exist"), *GetPathName(), SectionIndex, UsedTransformIndices.Last());
+			return false;
+		}
+	}
+	else
+	{
+		SkinWeights.Reset();
+	}
 
-		/* Get the transform index from the vertex factory and pass it as the value for TransformIndex */
-		const uint32 Index = DeformMeshVertexFactory->TransformIndex;
-		ShaderBindings.Add(TransformIndex, Index);
-		/* Get tHE SRV from the scen proxy and pass is as the value for TransformsSRV*/
-		ShaderBindings.Add(TransformsSRV, DeformMeshVertexFactory->SceneProxy->GetDeformTransformsSRV());
-	};
-private:
-	LAYOUT_FIELD(FShaderParameter, TransformIndex);
-	LAYOUT_FIELD(FShaderResourceParameter, TransformsSRV);
+	Section.SkinningMode = SkinningMode;
+	Section.SkinWeights = SkinWeights;
 
-};
+	//The box now comes from the transforms that the section blends, or from its own transform again
+	SkinnedSectionIndices.Remove(SectionIndex);
+	if (Section.IsSkinned())
+	{
+		SkinnedSectionIndices.Add(SectionIndex);
+	}
+	UpdateSectionLocalBox(Section, GetDeformedSectionBox(Section));
+	UpdateLocalBounds();
 
-///////////////////////////////////////////////////////////////////////
+	//The section proxy needs the vertex streams of the influences, and only keeps LOD 0 when it's skinned
+	UpdateSectionProxy(SectionIndex);
+	return true;
+}
 
-IMPLEMENT_TYPE_LAYOUT(FDeformMeshVertexFactoryShaderParameters);
+EDeformMeshSkinningMode UDeformMeshComponent::GetMeshSectionSkinningMode(int32 SectionIndex) const
+{
+	return DeformMeshSections.IsValidIndex(SectionIndex) ? DeformMeshSections[SectionIndex].SkinningMode : EDeformMeshSkinningMode::Rigid;
+}
 
-///////////////////////////////////////////////////////////////////////
+bool UDeformMeshComponent::SetMeshSectionLattice(int32 SectionIndex, EDeformMeshLatticeMode LatticeMode, FIntVector Resolution)
+{
+	if (!DeformMeshSections.IsValidIndex(SectionIndex) || DeformMeshSections[SectionIndex].StaticMesh == nullptr)
+	{
+		return false;
+	}
 
-IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FDeformMeshVertexFactory, SF_Vertex, FDeformMeshVertexFactoryShaderParameters);
+	FDeformMeshSection& Section = DeformMeshSections[SectionIndex];
+	if (LatticeMode != EDeformMeshLatticeMode::None)
+	{
+		//The lattice starts at rest around the static mesh, it doesn't move the mesh until its points move
+		Section.LatticeMode = LatticeMode;
+		Section.LatticeResolution = FDeformMeshLattice::ClampResolution(Resolution);
+		Section.LatticeBox = Section.StaticMesh->GetBoundingBox();
+		FDeformMeshLattice::MakeRestPoints(Section.LatticeBox, Section.LatticeResolution, Section.LatticePoints);
+	}
+	else
+	{
+		Section.LatticeMode = EDeformMeshLatticeMode::None;
+		Section.LatticeResolution = FIntVector::ZeroValue;
+		Section.LatticeBox.Init();
+		Section.LatticePoints.Empty();
+	}
 
-///////////////////////////////////////////////////////////////////////
+	//Removing a moved lattice changes the box of the section
+	UpdateSectionLocalBox(Section, GetDeformedSectionBox(Section));
+	UpdateLocalBounds();
 
-IMPLEMENT_VERTEX_FACTORY_TYPE(FDeformMeshVertexFactory, "/CustomShaders/LocalVertexFactory.ush", true, true, true, true, true);
+	//The vertex factories of the section proxy take the lattice when they're created
+	UpdateSectionProxy(SectionIndex);
+	return true;
+}
 
-///////////////////////////////////////////////////////////////////////
+/// <summary>
+/// Move some control points of the lattice of a section
+/// Only the moved points are sent to the render thread, which uploads the ranges of the lattice points buffer that they cover
+/// The box of the section is the box of the points under the deform transform, it's sent with the pending transforms when it changed
+/// </summary>
+void UDeformMeshComponent::SetMeshSectionLatticePoints(int32 SectionIndex, TArrayView<const int32> PointIndices, TArrayView<const FVector> Positions)
+{
+	check(PointIndices.Num() == Positions.Num());
+	if (!DeformMeshSections.IsValidIndex(SectionIndex) || !DeformMeshSections[SectionIndex].HasLattice())
+	{
+		return;
+	}
 
+	FDeformMeshSection& Section = DeformMeshSections[SectionIndex];
+	TArray<int32> UpdatedIndices;
+	TArray<FVector> UpdatedPositions;
+	UpdatedIndices.Reserve(PointIndices.Num());
+	UpdatedPositions.Reserve(Positions.Num());
+	for (int32 UpdateIdx = 0; UpdateIdx < PointIndices.Num(); UpdateIdx++)
+	{
+		if (Section.LatticePoints.IsValidIndex(PointIndices[UpdateIdx]))
+		{
+			Section.LatticePoints[PointIndices[UpdateIdx]] = Positions[UpdateIdx];
+			UpdatedIndices.Add(PointIndices[UpdateIdx]);
+			UpdatedPositions.Add(Positions[UpdateIdx]);
+		}
+	}
+	if (UpdatedIndices.Num() == 0)
+	{
+		return;
+	}
 
+	const FBox PreviousBox = Section.SectionLocalBox;
+	const bool bLocalBoundsGrew = UpdateSectionLocalBox(Section, GetDeformedSectionBox(Section));
 
+	if (SceneProxy)
+	{
+		FDeformMeshSceneProxy* DeformMeshSceneProxy = (FDeformMeshSceneProxy*)SceneProxy;
+		ENQUEUE_RENDER_COMMAND(FDeformMeshLatticePointsUpdate)(
+			[DeformMeshSceneProxy, SectionIndex, UpdatedIndices = MoveTemp(UpdatedIndices), UpdatedPositions = MoveTemp(UpdatedPositions)](FRHICommandListImmediate& RHICmdList)
+			{
+				DeformMeshSceneProxy->UpdateLatticePoints_RenderThread(SectionIndex, UpdatedIndices, UpdatedPositions);
+			});
 
+		if (!(Section.SectionLocalBox == PreviousBox))
+		{
+			QueueSectionTransform(SectionIndex);
+		}
+	}
+	//Like for the transforms, the shrinking is deferred to FinishTransformsUpdate()
+	if (bLocalBoundsGrew)
+	{
+		SendLocalBounds();
+	}
+}
 
+TArrayView<const FVector> UDeformMeshComponent::GetMeshSectionLatticePoints(int32 SectionIndex) const
+{
+	return DeformMeshSections.IsValidIndex(SectionIndex) && DeformMeshSections[SectionIndex].HasLattice() ? TArrayView<const FVector>(DeformMeshSections[SectionIndex].LatticePoints) : TArrayView<const FVector>();
+}
 
+FIntVector UDeformMeshComponent::GetMeshSectionLatticeResolution(int32 SectionIndex) const
+{
+	return DeformMeshSections.IsValidIndex(SectionIndex) && DeformMeshSections[SectionIndex].HasLattice() ? DeformMeshSections[SectionIndex].LatticeResolution : FIntVector::ZeroValue;
+}
 
-///////////////////////////////////////////////////////////////////////
-// The Deform Mesh Component Methods' Definitions
-///////////////////////////////////////////////////////////////////////
-/*
- * Most of ths method below are self explanatory, they make changes to the game thread state and propagate changes to the render thread using the scene proxy
-*/
-void UDeformMeshComponent::CreateMeshSection(int32 SectionIndex, UStaticMesh* Mesh, const FTransform& Transform)
+bool UDeformMeshComponent::SetMeshSectionDeformer(int32 SectionIndex, EDeformMeshDeformer Deformer, const FVector4& Params)
 {
-	// Ensure sections array is long enough
-	if (SectionIndex >= DeformMeshSections.Num())
+	if (!DeformMeshSections.IsValidIndex(SectionIndex) || DeformMeshSections[SectionIndex].StaticMesh == nullptr)
 	{
-		DeformMeshSections.SetNum(SectionIndex + 1, false);
+		return false;
 	}
 
-	// Reset this section (in case it already existed)
-	FDeformMeshSection& NewSection = DeformMeshSections[SectionIndex];
-	NewSection.Reset();
+	//The section would be drawn with a vertex factory that has no shaders
+	if (!FDeformMeshDeformers::IsDeformerCompiled(Deformer))
+	{
+		LogDeformerNotCompiled(SectionIndex, Deformer);
+		return false;
+	}
 
-	// Fill in the mesh section with the needed data
-	// I'm assuming that the StaticMesh has only one section and I'm only using that
-	NewSection.StaticMesh = Mesh;
-	NewSection.DeformTransform = Transform.ToMatrixWithScale().GetTransposed();
+	FDeformMeshSection& Section = DeformMeshSections[SectionIndex];
+	Section.Deformer = Deformer;
+	Section.DeformerParams = Deformer != EDeformMeshDeformer::None ? Params : FVector4(0.f, 0.f, 0.f, 0.f);
 
-	//Update the local bound using the bounds of the static mesh that we're adding
-	//I'm not taking in consideration the deformation here, if the deformation cause the mesh to go outside its bounds
-	NewSection.StaticMesh->CalculateExtendedBounds();
-	NewSection.SectionLocalBox += NewSection.StaticMesh->GetBoundingBox();
+	UpdateSectionLocalBox(Section, GetDeformedSectionBox(Section));
+	UpdateLocalBounds();
 
-	//Add this sections' material to the list of the component's materials, with the same index as the section
-	SetMaterial(SectionIndex, NewSection.StaticMesh->GetMaterial(0));
+	//The section proxy is drawn with the vertex factory type of its deformer
+	UpdateSectionProxy(SectionIndex);
+	return true;
+}
 
+void UDeformMeshComponent::LogDeformerNotCompiled(int32 SectionIndex, EDeformMeshDeformer Deformer) const
+{
+	UE_LOG(LogDeformMesh, Warning, TEXT("%s: the %s deformer of section %d isn't compiled, see DeformMesh.Deformers"), *GetPathName(), *StaticEnum<EDeformMeshDeformer>()->GetNameStringByValue((int64)Deformer), SectionIndex);
+}
 
-	UpdateLocalBounds(); // Update overall bounds
-	MarkRenderStateDirty(); // New section requires recreating scene proxy
+bool UDeformMeshComponent::CheckSectionDeformer(int32 SectionIndex)
+{
+	FDeformMeshSection& Section = DeformMeshSections[SectionIndex];
+	if (Section.HasDeformer() && !FDeformMeshDeformers::IsDeformerCompiled(Section.Deformer))
+	{
+		LogDeformerNotCompiled(SectionIndex, Section.Deformer);
+		Section.Deformer = EDeformMeshDeformer::None;
+		Section.DeformerParams = FVector4(0.f, 0.f, 0.f, 0.f);
+		return true;
+	}
+	return false;
 }
 
 /// <summary>
-/// Update the Transform Matrix that we use to deform the mesh
-/// The update of the state in the game thread is simple, but for the scene proxy update, we need to enqueue a render command
+/// Change the parameters of the deformer of a section
+/// They're queued with the pending transforms, and the render thread writes them after the section's transform in the transforms pool
+/// The box of the section follows the deformation, it's queued with the section's transform when it changed
 /// </summary>
-/// <param name="SectionIndex"> The index for the section that we want to update its DeformTransform </param>
-/// <param name="Transform"> The new Transform Matrix </param>
-void UDeformMeshComponent::UpdateMeshSectionTransform(int32 SectionIndex, const FTransform& Transform)
+void UDeformMeshComponent::SetMeshSectionDeformerParams(int32 SectionIndex, const FVector4& Params)
 {
-	if (SectionIndex < DeformMeshSections.Num())
+	if (!DeformMeshSections.IsValidIndex(SectionIndex) || !DeformMeshSections[SectionIndex].HasDeformer())
 	{
-		//Set game thread state
-		const FMatrix TransformMatrix = Transform.ToMatrixWithScale().GetTransposed();
-		DeformMeshSections[SectionIndex].DeformTransform = TransformMatrix;
+		return;
+	}
 
-		DeformMeshSections[SectionIndex].SectionLocalBox += DeformMeshSections[SectionIndex].StaticMesh->GetBoundingBox().TransformBy(Transform);
+	FDeformMeshSection& Section = DeformMeshSections[SectionIndex];
+	Section.DeformerParams = Params;
 
+	const FBox PreviousBox = Section.SectionLocalBox;
+	const bool bLocalBoundsGrew = UpdateSectionLocalBox(Section, GetDeformedSectionBox(Section));
 
-		if (SceneProxy)
+	if (SceneProxy)
+	{
+		PendingDeformerSectionIndices.Add(SectionIndex);
+		PendingDeformerParams.Add(Params);
+		if (!(Section.SectionLocalBox == PreviousBox))
 		{
-			// Enqueue command to modify render thread info
-			FDeformMeshSceneProxy* DeformMeshSceneProxy = (FDeformMeshSceneProxy*)SceneProxy;
-			ENQUEUE_RENDER_COMMAND(FDeformMeshTransformsUpdate)(
-				[DeformMeshSceneProxy, SectionIndex, TransformMatrix](FRHICommandListImmediate& RHICmdList)
-				{
-					DeformMeshSceneProxy->UpdateDeformTransform_RenderThread(SectionIndex, TransformMatrix);
-				});
+			QueueSectionTransform(SectionIndex);
+		}
+		else
+		{
+			//Without a subsystem, FinishTransformsUpdate() sends them
+			QueuePendingTransforms();
 		}
-		UpdateLocalBounds();		 // Update overall bounds
-		MarkRenderTransformDirty();  // Need to send new bounds to render thread
 	}
-}
-
-void UDeformMeshComponent::ClearMeshSection(int32 SectionIndex)
-{
-	if (SectionIndex < DeformMeshSections.Num())
+	//Like for the transforms, the shrinking is deferred to FinishTransformsUpdate()
+	if (bLocalBoundsGrew)
 	{
-		DeformMeshSections[SectionIndex].Reset();
-		UpdateLocalBounds();
-		MarkRenderStateDirty();
+		SendLocalBounds();
 	}
 }
 
-/// <summary>
-/// This method is called after we finished updating all the section transforms that we want to update
-/// This will update the structured buffer with the new transforms
-/// </summary>
-void UDeformMeshComponent::FinishTransformsUpdate()
+EDeformMeshDeformer UDeformMeshComponent::GetMeshSectionDeformer(int32 SectionIndex) const
 {
-	if (SceneProxy)
-	{
-		// Enqueue command to modify render thread info
-		FDeformMeshSceneProxy* DeformMeshSceneProxy = (FDeformMeshSceneProxy*)SceneProxy;
-		ENQUEUE_RENDER_COMMAND(FDeformMeshAllTransformsSBUpdate)(
-			[DeformMeshSceneProxy](FRHICommandListImmediate& RHICmdList)
-			{
-				DeformMeshSceneProxy->UpdateDeformTransformsSB_RenderThread();
-			});
-	}
+	return DeformMeshSections.IsValidIndex(SectionIndex) ? DeformMeshSections[SectionIndex].Deformer : EDeformMeshDeformer::None;
 }
 
-void UDeformMeshComponent::ClearAllMeshSections()
+bool UDeformMeshComponent::HasSectionDeformers() const
 {
-	DeformMeshSections.Empty();
-	UpdateLocalBounds();
-	MarkRenderStateDirty();
+	return DeformMeshSections.ContainsByPredicate([](const FDeformMeshSection& Section) { return Section.StaticMesh != nullptr && Section.HasDeformer(); });
 }
 
-void UDeformMeshComponent::SetMeshSectionVisible(int32 SectionIndex, bool bNewVisibility)
+bool UDeformMeshComponent::HasLitSections() const
 {
-	if (SectionIndex < DeformMeshSections.Num())
+	for (int32 SectionIdx = 0; SectionIdx < DeformMeshSections.Num(); SectionIdx++)
 	{
-		// Set game thread state
-		DeformMeshSections[SectionIndex].bSectionVisible = bNewVisibility;
-
-		if (SceneProxy)
+		if (DeformMeshSections[SectionIdx].StaticMesh != nullptr && UsesDeformMeshLitShading(GetMaterial(SectionIdx)))
 		{
-			// Enqueue command to modify render thread info
-			FDeformMeshSceneProxy* DeformMeshSceneProxy = (FDeformMeshSceneProxy*)SceneProxy;
-			ENQUEUE_RENDER_COMMAND(FDeformMeshSectionVisibilityUpdate)(
-				[DeformMeshSceneProxy, SectionIndex, bNewVisibility](FRHICommandListImmediate& RHICmdList)
-				{
-					DeformMeshSceneProxy->SetSectionVisibility_RenderThread(SectionIndex, bNewVisibility);
-				});
+			return true;
 		}
 	}
+	return false;
 }
 
-bool UDeformMeshComponent::IsMeshSectionVisible(int32 SectionIndex) const
-{
-	return (SectionIndex < DeformMeshSections.Num()) ? DeformMeshSections[SectionIndex].bSectionVisible : false;
-}
-
-int32 UDeformMeshComponent::GetNumSections() const
+void UDeformMeshComponent::SetUseInstancedRendering(bool bNewUseInstancedRendering)
 {
-	return DeformMeshSections.Num();
+	if (bUseInstancedRendering != bNewUseInstancedRendering)
+	{
+		bUseInstancedRendering = bNewUseInstancedRendering;
+		MarkRenderStateDirty(); // The scene proxy needs to build the instance groups
+	}
 }
 
 
@@ -754,15 +4756,92 @@ void UDeformMeshComponent::SetDeformMeshSection(int32 SectionIndex, const FDefor
 	}
 
 	DeformMeshSections[SectionIndex] = Section;
+	//The deformer isn't checked by SetMeshSectionDeformer() here, the section is drawn without it when it isn't compiled
+	CheckSectionDeformer(SectionIndex);
+	//The parent is checked like any other, so the hierarchy never has cycles
+	DeformMeshSections[SectionIndex].ParentIndex = INDEX_NONE;
+	SetMeshSectionParent(SectionIndex, Section.ParentIndex);
+	bSectionHierarchyNeedsBuild = true;
+
+	//Recompute the local box of the section from its deform transform, or from the transforms that it blends
+	FDeformMeshSection& NewSection = DeformMeshSections[SectionIndex];
+	SkinnedSectionIndices.Remove(SectionIndex);
+	if (NewSection.StaticMesh)
+	{
+		NewSection.SectionLocalBox.Init();
+		if (NewSection.IsSkinned())
+		{
+			SkinnedSectionIndices.Add(SectionIndex);
+		}
+		UpdateSectionLocalBox(NewSection, GetDeformedSectionBox(NewSection));
+	}
 
 	UpdateLocalBounds(); // Update overall bounds
-	MarkRenderStateDirty(); // New section requires recreating scene proxy
+	UpdateSectionProxy(SectionIndex); // Replace the section in the scene proxy
+}
+
+/// <summary>
+/// Propagate the creation, replacement or removal of one section to the scene proxy, without recreating the whole proxy
+/// The section proxy is created here, it only enqueues the initialization of its vertex factory, and the render thread inserts it in place
+/// </summary>
+/// <param name="SectionIndex"> The index of the section that changed </param>
+void UDeformMeshComponent::UpdateSectionProxy(int32 SectionIndex)
+{
+	if (!SceneProxy)
+	{
+		return;
+	}
+
+	FDeformMeshSceneProxy* DeformMeshSceneProxy = (FDeformMeshSceneProxy*)SceneProxy;
+	const FDeformMeshSection& Section = DeformMeshSections[SectionIndex];
+
+	//A proxy created without deformers has no room for their parameters after the transforms, it's recreated with it
+	if (Section.StaticMesh != nullptr && Section.HasDeformer() && !DeformMeshSceneProxy->HasDeformerParams())
+	{
+		MarkRenderStateDirty();
+		return;
+	}
+	//Same for the normal matrices of the lit sections
+	if (Section.StaticMesh != nullptr && !DeformMeshSceneProxy->HasLitSections() && UsesDeformMeshLitShading(GetMaterial(SectionIndex)))
+	{
+		MarkRenderStateDirty();
+		return;
+	}
+
+	//A section without a static mesh was cleared
+	if (Section.StaticMesh == nullptr)
+	{
+		ENQUEUE_RENDER_COMMAND(FDeformMeshRemoveSection)(
+			[DeformMeshSceneProxy, SectionIndex](FRHICommandListImmediate& RHICmdList)
+			{
+				DeformMeshSceneProxy->RemoveSection_RenderThread(SectionIndex);
+			});
+		return;
+	}
+
+	FDeformMeshSectionProxy* NewSection = DeformMeshSceneProxy->CreateSectionProxy(SectionIndex, Section, GetMaterial(SectionIndex));
+
+	//Pack the transform in the format used by the scene proxy
+	FDeformMeshPackedTransform PackedTransform;
+	PackDeformTransform(Section.DeformTransform, TransformFormat, PackedTransform.Data);
+	const EDeformMeshTransformFormat Format = TransformFormat;
+
+	ENQUEUE_RENDER_COMMAND(FDeformMeshSetSection)(
+		[DeformMeshSceneProxy, SectionIndex, NewSection, Format, PackedTransform](FRHICommandListImmediate& RHICmdList)
+		{
+			DeformMeshSceneProxy->SetSection_RenderThread(SectionIndex, NewSection, Format, PackedTransform);
+		});
 }
 
 FPrimitiveSceneProxy* UDeformMeshComponent::CreateSceneProxy()
 {
+	DEFORMMESH_SCOPE_CYCLE_COUNTER(STAT_DeformMesh_CreateSceneProxy);
+
 	if (!SceneProxy)
+	{
+		INC_DWORD_STAT(STAT_DeformMesh_ProxyRebuilds);
 		return new FDeformMeshSceneProxy(this);
+	}
 	else
 		return SceneProxy;
 }
@@ -772,6 +4851,18 @@ int32 UDeformMeshComponent::GetNumMaterials() const
 	return DeformMeshSections.Num();
 }
 
+//Like the static mesh component, a section without an override material uses the material of its static mesh
+//The overrides are only written by UMeshComponent::SetMaterial(), so adding a section doesn't need to touch them or recreate the scene proxy
+UMaterialInterface* UDeformMeshComponent::GetMaterial(int32 ElementIndex) const
+{
+	UMaterialInterface* OverrideMaterial = Super::GetMaterial(ElementIndex);
+	if (OverrideMaterial == nullptr && DeformMeshSections.IsValidIndex(ElementIndex) && DeformMeshSections[ElementIndex].StaticMesh != nullptr)
+	{
+		return DeformMeshSections[ElementIndex].StaticMesh->GetMaterial(0);
+	}
+	return OverrideMaterial;
+}
+
 
 //Use this to update the Bounds by taking in consideration the deform transform
 FBoxSphereBounds UDeformMeshComponent::CalcBounds(const FTransform& LocalToWorld) const
@@ -784,16 +4875,41 @@ FBoxSphereBounds UDeformMeshComponent::CalcBounds(const FTransform& LocalToWorld
 	return Ret;
 }
 
+void UDeformMeshComponent::PostLoad()
+{
+	Super::PostLoad();
+
+	//The deformers disabled by DeformMesh.Deformers since the component was saved have no shaders, the sections keep their boxes, they're just larger than needed
+	for (int32 SectionIndex = 0; SectionIndex < DeformMeshSections.Num(); SectionIndex++)
+	{
+		CheckSectionDeformer(SectionIndex);
+	}
+
+	//The cached union of the sections' boxes isn't serialized
+	CachedLocalBox.Init();
+	for (const FDeformMeshSection& Section : DeformMeshSections)
+	{
+		CachedLocalBox += Section.SectionLocalBox;
+	}
+}
+
 void UDeformMeshComponent::UpdateLocalBounds()
 {
-	FBox LocalBox(ForceInit);
+	//Full rescan of the sections, this also shrinks the cached union
+	CachedLocalBox.Init();
 
 	for (const FDeformMeshSection& Section : DeformMeshSections)
 	{
-		LocalBox += Section.SectionLocalBox;
+		CachedLocalBox += Section.SectionLocalBox;
 	}
+	bLocalBoundsNeedShrink = false;
+
+	SendLocalBounds();
+}
 
-	LocalBounds = LocalBox.IsValid ? FBoxSphereBounds(LocalBox) : FBoxSphereBounds(FVector(0, 0, 0), FVector(0, 0, 0), 0); // fallback to reset box sphere bounds
+void UDeformMeshComponent::SendLocalBounds()
+{
+	LocalBounds = CachedLocalBox.IsValid ? FBoxSphereBounds(CachedLocalBox) : FBoxSphereBounds(FVector(0, 0, 0), FVector(0, 0, 0), 0); // fallback to reset box sphere bounds
 
 	// Update global bounds
 	UpdateBounds();
@@ -801,3 +4917,93 @@ void UDeformMeshComponent::UpdateLocalBounds()
 	MarkRenderTransformDirty();
 }
 
+/* Returns whether the box Inner is inside the box Outer, or on its border*/
+static inline bool IsBoxInsideOrOn(const FBox& Outer, const FBox& Inner)
+{
+	return Outer.IsValid && Inner.IsValid && Outer.IsInsideOrOn(Inner.Min) && Outer.IsInsideOrOn(Inner.Max);
+}
+
+bool UDeformMeshComponent::UpdateSectionLocalBox(FDeformMeshSection& Section, const FBox& DeformedMeshBox)
+{
+	//With some padding, small movements that keep the deformed mesh inside the padded box don't change anything
+	if (BoundsPadding > 0.f && IsBoxInsideOrOn(Section.SectionLocalBox, DeformedMeshBox))
+	{
+		return false;
+	}
+
+	//A section touching the border of the union can make it smaller when it moves, we'll rescan the sections later instead of doing it for each update
+	if (Section.SectionLocalBox.IsValid && !CachedLocalBox.IsInside(Section.SectionLocalBox))
+	{
+		bLocalBoundsNeedShrink = true;
+	}
+
+	Section.SectionLocalBox = DeformedMeshBox.ExpandBy(BoundsPadding);
+
+	//The union only needs to grow when the new box goes outside of it
+	if (!IsBoxInsideOrOn(CachedLocalBox, Section.SectionLocalBox))
+	{
+		CachedLocalBox += Section.SectionLocalBox;
+		return true;
+	}
+	return false;
+}
+
+FBox UDeformMeshComponent::GetSkinnedSectionBox(const FDeformMeshSection& Section) const
+{
+	//A linearly blended vertex is inside the convex hull of its positions deformed by each transform, so inside the union of the deformed boxes
+	//The dual quaternion blend can go a bit outside of it when the blended transforms have different scales, BoundsPadding covers that
+	const FBox MeshBox = GetSectionMeshBox(Section);
+	FBox SkinnedBox(ForceInit);
+	for (int32 TransformIndex : Section.SkinWeights->GetUsedTransformIndices())
+	{
+		if (DeformMeshSections.IsValidIndex(TransformIndex))
+		{
+			SkinnedBox += MeshBox.TransformBy(DeformMeshSections[TransformIndex].DeformTransform.GetTransposed());
+		}
+	}
+	return SkinnedBox;
+}
+
+bool UDeformMeshComponent::UpdateSkinnedSectionBoxes()
+{
+	bSkinnedSectionBoxesDirty = false;
+	bool bLocalBoundsGrew = false;
+	for (int32 SectionIndex : SkinnedSectionIndices)
+	{
+		FDeformMeshSection& Section = DeformMeshSections[SectionIndex];
+		const FBox PreviousBox = Section.SectionLocalBox;
+		bLocalBoundsGrew |= UpdateSectionLocalBox(Section, GetSkinnedSectionBox(Section));
+
+		//The render thread culls the section with its box, it's sent along with the section's own transform
+		if (!(Section.SectionLocalBox == PreviousBox))
+		{
+			QueueSectionTransform(SectionIndex);
+		}
+	}
+	return bLocalBoundsGrew;
+}
+
+FBox UDeformMeshComponent::GetSectionMeshBox(const FDeformMeshSection& Section) const
+{
+	//Both interpolations are weighted averages of the control points, the moved mesh stays inside their bounding box
+	const FBox MeshBox = Section.HasLattice() ? FBox(Section.LatticePoints) : Section.StaticMesh->GetBoundingBox();
+	return Section.HasDeformer() ? FDeformMeshDeformers::GetDeformedBox(Section.Deformer, Section.DeformerParams, MeshBox) : MeshBox;
+}
+
+FBox UDeformMeshComponent::GetDeformedSectionBox(const FDeformMeshSection& Section) const
+{
+	return Section.IsSkinned() ? GetSkinnedSectionBox(Section) : GetSectionMeshBox(Section).TransformBy(Section.DeformTransform.GetTransposed());
+}
+
+void UDeformMeshComponent::QueueSectionTransform(int32 SectionIndex)
+{
+	if (SceneProxy)
+	{
+		PendingSectionIndices.Add(SectionIndex);
+		const int32 FirstElement = PendingTransforms.AddUninitialized(GetDeformTransformStride(TransformFormat));
+		PackDeformTransform(DeformMeshSections[SectionIndex].DeformTransform, TransformFormat, &PendingTransforms[FirstElement]);
+		PendingSectionBoxes.Add(DeformMeshSections[SectionIndex].SectionLocalBox);
+		//Without a subsystem, FinishTransformsUpdate() sends them
+		QueuePendingTransforms();
+	}
+}
@@ -8,12 +8,50 @@
 #include "Components/MeshComponent.h"
 #include "PhysicsEngine/ConvexElem.h"
 #include "Engine/StaticMesh.h"
+#include "DeformMeshHierarchy.h"
+#include "DeformMeshSkinning.h"
+#include "DeformMeshLattice.h"
+#include "DeformMeshDeformers.h"
 #include "DeformMeshComponent.generated.h"
 
 //Forward declarations
 class FPrimitiveSceneProxy;
 
 
+/** How the deform transforms are stored in the render thread array and in the structured buffer that is bound to the vertex factory */
+UENUM()
+enum class EDeformMeshTransformFormat : uint8
+{
+	/** Full 4x4 matrix, 64 bytes per section */
+	Matrix4x4,
+	/** The 3 first rows of the transposed matrix, the last one is always (0,0,0,1) for an affine transform, 48 bytes per section */
+	Matrix3x4,
+	/** Rotation quaternion + translation + uniform scale, 32 bytes per section. A non uniform or negative scale switches the component to Matrix3x4 */
+	QuatTranslationScale
+};
+
+UENUM()
+enum class EDeformMeshSkinningMode : uint8
+{
+	/** The whole section is deformed by its own deform transform */
+	Rigid,
+	/** Each vertex is deformed by a weighted average of up to 4 deform transforms */
+	LinearBlend,
+	/** Each vertex is deformed by a dual quaternion blend of up to 4 deform transforms, it keeps the volume of twisted parts. The scales are blended linearly */
+	DualQuaternion
+};
+
+UENUM()
+enum class EDeformMeshLatticeMode : uint8
+{
+	/** The section has no lattice */
+	None,
+	/** Each vertex is interpolated from the 8 control points of its cell, moving a point only moves the vertices of the cells around it */
+	Trilinear,
+	/** Each vertex is a Bernstein polynomial blend of all the control points, the deformation is smoother but costs more per vertex */
+	Bernstein
+};
+
 
 /** Mesh section of the DeformMesh. A mesh section is a part of the mesh that is rendered with one material (1 material per section)*/
 USTRUCT()
@@ -38,20 +76,111 @@ public:
 	UPROPERTY()
 	bool bSectionVisible;
 
+	/** The section this section is attached to, INDEX_NONE for the sections without a parent */
+	UPROPERTY()
+	int32 ParentIndex;
+
+	/** The transform of this section relative to its parent, it's the deform transform for the sections without a parent */
+	UPROPERTY()
+	FTransform LocalTransform;
+
+	/** How the vertices of this section are deformed, the blending modes need SkinWeights */
+	UPROPERTY()
+	EDeformMeshSkinningMode SkinningMode;
+
+	/** The transforms blending each vertex of a skinned section, they're set at runtime and not saved */
+	TSharedPtr<const FDeformMeshSkinWeights, ESPMode::ThreadSafe> SkinWeights;
+
+	/** How the lattice moves the vertices, before the deform transform (or the skinning) is applied */
+	UPROPERTY()
+	EDeformMeshLatticeMode LatticeMode;
+
+	/** Number of control points of the lattice on each axis */
+	UPROPERTY()
+	FIntVector LatticeResolution;
+
+	/** The box of the static mesh covered by the lattice, in the space of the static mesh */
+	UPROPERTY()
+	FBox LatticeBox;
+
+	/** The control points of the lattice in the space of the static mesh, the point (X, Y, Z) is at X + LatticeResolution.X * (Y + LatticeResolution.Y * Z) */
+	UPROPERTY()
+	TArray<FVector> LatticePoints;
+
+	/** The analytic deformer that moves the vertices, after the lattice and before the deform transform (or the skinning) */
+	UPROPERTY()
+	EDeformMeshDeformer Deformer;
+
+	/** The parameters of the deformer, their meaning depends on the deformer (see EDeformMeshDeformer) */
+	UPROPERTY()
+	FVector4 DeformerParams;
+
 	FDeformMeshSection()
 		: SectionLocalBox(ForceInit)
 		, bSectionVisible(true)
+		, ParentIndex(INDEX_NONE)
+		, SkinningMode(EDeformMeshSkinningMode::Rigid)
+		, LatticeMode(EDeformMeshLatticeMode::None)
+		, LatticeResolution(ForceInit)
+		, LatticeBox(ForceInit)
+		, Deformer(EDeformMeshDeformer::None)
+		, DeformerParams(ForceInitToZero)
 	{}
 
+	/** Whether the vertices are blended between the deform transforms of other sections, instead of following this section's deform transform */
+	bool IsSkinned() const { return SkinningMode != EDeformMeshSkinningMode::Rigid && SkinWeights.IsValid(); }
+
+	/** Whether the vertices are moved by a lattice, the control points need to match the resolution */
+	bool HasLattice() const
+	{
+		return LatticeMode != EDeformMeshLatticeMode::None && LatticeResolution == FDeformMeshLattice::ClampResolution(LatticeResolution) &&
+			LatticePoints.Num() == LatticeResolution.X * LatticeResolution.Y * LatticeResolution.Z;
+	}
+
+	/** Whether the vertices are moved by an analytic deformer */
+	bool HasDeformer() const { return Deformer != EDeformMeshDeformer::None; }
+
+	/** Whether the section only follows its deform transform, so its undeformed space can be found back with the inverse transform */
+	bool IsRigid() const { return !IsSkinned() && !HasLattice() && !HasDeformer(); }
+
 	/** Reset this section, clear all mesh info. */
 	void Reset()
 	{
 		StaticMesh = nullptr;
 		SectionLocalBox.Init();
 		bSectionVisible = true;
+		ParentIndex = INDEX_NONE;
+		LocalTransform = FTransform::Identity;
+		SkinningMode = EDeformMeshSkinningMode::Rigid;
+		SkinWeights.Reset();
+		LatticeMode = EDeformMeshLatticeMode::None;
+		LatticeResolution = FIntVector::ZeroValue;
+		LatticeBox.Init();
+		LatticePoints.Empty();
+		Deformer = EDeformMeshDeformer::None;
+		DeformerParams = FVector4(0.f, 0.f, 0.f, 0.f);
 	}
 };
 
+/** Result of a line trace against the deformed sections of a DeformMesh, in world space */
+struct FDeformMeshTraceHit
+{
+	/** Index of the hit section */
+	int32 SectionIndex = INDEX_NONE;
+
+	/** Index of the hit triangle in the first LOD of the section's static mesh */
+	int32 FaceIndex = INDEX_NONE;
+
+	/** Location of the hit */
+	FVector Location = FVector::ZeroVector;
+
+	/** Normal of the hit triangle, facing the start of the trace */
+	FVector Normal = FVector::ZeroVector;
+
+	/** Distance from the start of the trace to the hit */
+	float Distance = 0.f;
+};
+
 /**
 *	Component that allows you deform the vertices of a mesh by supplying a secondary deform transform
 */
@@ -63,10 +192,95 @@ public:
 
 	void CreateMeshSection(int32 SectionIndex, UStaticMesh* Mesh, const FTransform& DeformTransform);
 
+	/**
+	 *	Update the deform transform of one section.
+	 *	The transform is queued on the game thread, the DeformMesh world subsystem sends the transforms of all the components to the render thread at the end of the world tick.
+	 *	Before sending them, the subsystem also moves the children of the section and the skinned sections that blend its transform, and shrinks the bounds.
+	 *	Without a subsystem, FinishTransformsUpdate() does that and sends the transforms.
+	 */
 	void UpdateMeshSectionTransform(int32 SectionIndex, const FTransform& DeformTransform);
 
+	/**
+	 *	Update the deform transforms of several sections at once.
+	 *	Transforms are converted in one pass and the bounds are recomputed once, they're sent with the other queued updates at the end of the world tick.
+	 *	There's no need to call FinishTransformsUpdate() after this.
+	 */
+	void UpdateMeshSectionTransforms(TArrayView<const int32> SectionIndices, TArrayView<const FTransform> DeformTransforms);
+
+	/** Update the deform transforms of all the sections, the transform at index i is used for the section i */
+	void UpdateMeshSectionTransforms(TArrayView<const FTransform> DeformTransforms);
+
+	/**
+	 *	Shrink the bounds after a series of UpdateMeshSectionTransform(), the transforms are sent right away when the component has no DeformMesh world subsystem.
+	 *	The sections with a parent get their deform transforms here, only the subtrees that changed are evaluated, and the boxes of the skinned sections are recomputed.
+	 *	The subsystem does the same when it flushes the component, calling this is only needed to get the children and the bounds before the end of the tick.
+	 */
 	void FinishTransformsUpdate();
 
+	/**
+	 *	Attach a section to another section, its local transform is then relative to the deform transform of its parent. INDEX_NONE detaches it.
+	 *	Returns false when one of the sections doesn't exist, or when the parent is one of the section's children.
+	 */
+	bool SetMeshSectionParent(int32 SectionIndex, int32 ParentIndex);
+
+	int32 GetMeshSectionParent(int32 SectionIndex) const;
+
+	/**
+	 *	Set the transform of a section relative to its parent, the section and its children are evaluated by the next FinishTransformsUpdate(), or by the subsystem at the end of the tick.
+	 *	For a section without a parent it's the same as UpdateMeshSectionTransform(), which also moves the children of the section.
+	 *	Setting the deform transform of a section that has a parent with UpdateMeshSectionTransform() only lasts until its parent moves.
+	 */
+	void SetMeshSectionLocalTransform(int32 SectionIndex, const FTransform& LocalTransform);
+
+	/** Set the local transforms of several sections and evaluate the hierarchy, there's no need to call FinishTransformsUpdate() after this */
+	void SetMeshSectionLocalTransforms(TArrayView<const int32> SectionIndices, TArrayView<const FTransform> LocalTransforms);
+
+	/**
+	 *	Blend the vertices of a section between the deform transforms of other sections, with up to 4 weighted transforms per vertex.
+	 *	The influences are given for the vertices of the first LOD of the section's static mesh, a skinned section always draws that LOD.
+	 *	The sections used as bones can be hidden, they only need to exist. Pass the Rigid mode to go back to the section's own deform transform.
+	 *	Returns false when the vertex count doesn't match, or when an influence references a section that doesn't exist. This recreates the section proxy
+	 */
+	bool SetMeshSectionSkinWeights(int32 SectionIndex, TSharedPtr<const FDeformMeshSkinWeights, ESPMode::ThreadSafe> SkinWeights, EDeformMeshSkinningMode SkinningMode);
+
+	/** Returns how the vertices of a section are deformed */
+	EDeformMeshSkinningMode GetMeshSectionSkinningMode(int32 SectionIndex) const;
+
+	/**
+	 *	Give a section a lattice of Resolution control points (2 to 16 per axis) around the bounding box of its static mesh, the points start as a regular grid that doesn't move the mesh.
+	 *	The vertices are moved by the lattice in the space of the static mesh, before the deform transform or the skinning. The None mode removes the lattice.
+	 *	Returns false when the section doesn't exist. This recreates the section proxy
+	 */
+	bool SetMeshSectionLattice(int32 SectionIndex, EDeformMeshLatticeMode LatticeMode, FIntVector Resolution);
+
+	/**
+	 *	Move control points of the lattice of a section, in the space of the static mesh. Only these points are sent to the render thread and uploaded.
+	 *	The box of the section follows the points, it's sent with the pending transforms (like UpdateMeshSectionTransform(), FinishTransformsUpdate() sends it when there's no subsystem).
+	 */
+	void SetMeshSectionLatticePoints(int32 SectionIndex, TArrayView<const int32> PointIndices, TArrayView<const FVector> Positions);
+
+	/** Returns the control points of the lattice of a section, empty when it has no lattice */
+	TArrayView<const FVector> GetMeshSectionLatticePoints(int32 SectionIndex) const;
+
+	/** Returns the number of control points of the lattice of a section on each axis, zero when it has no lattice */
+	FIntVector GetMeshSectionLatticeResolution(int32 SectionIndex) const;
+
+	/**
+	 *	Bend, twist, taper or wave the vertices of a section along the Z axis of its static mesh, after the lattice and before the deform transform or the skinning.
+	 *	Each deformer is its own vertex factory permutation, the deformers disabled by the DeformMesh.Deformers console variable aren't compiled and are refused.
+	 *	Returns false when the section doesn't exist or when the deformer isn't compiled. This recreates the section proxy, or the scene proxy for the first deformer of the component
+	 */
+	bool SetMeshSectionDeformer(int32 SectionIndex, EDeformMeshDeformer Deformer, const FVector4& Params);
+
+	/**
+	 *	Change the parameters of the deformer of a section, to animate it. They're sent with the pending transforms (like UpdateMeshSectionTransform(), FinishTransformsUpdate() sends them when there's no subsystem).
+	 *	The parameters are stored next to the deform transform of the section, so this doesn't recreate anything.
+	 */
+	void SetMeshSectionDeformerParams(int32 SectionIndex, const FVector4& Params);
+
+	/** Returns the deformer of a section */
+	EDeformMeshDeformer GetMeshSectionDeformer(int32 SectionIndex) const;
+
 	/** Clear a section of the DeformMesh. Other sections do not change index. */
 	void ClearMeshSection(int32 SectionIndex);
 
@@ -82,6 +296,73 @@ public:
 	/** Returns number of sections currently created for this component */
 	int32 GetNumSections() const;
 
+	/** Change the storage format of the deform transforms, this recreates the scene proxy */
+	void SetTransformFormat(EDeformMeshTransformFormat NewFormat);
+
+	/** Returns the storage format of the deform transforms */
+	EDeformMeshTransformFormat GetTransformFormat() const { return TransformFormat; }
+
+	/** Enable or disable the instanced rendering of the sections sharing the same static mesh and material, this recreates the scene proxy */
+	void SetUseInstancedRendering(bool bNewUseInstancedRendering);
+
+	/** Returns whether the sections sharing the same static mesh and material are drawn with one instanced draw call */
+	bool GetUseInstancedRendering() const { return bUseInstancedRendering; }
+
+	/** Enable or disable the static draw path, this recreates the scene proxy */
+	void SetUseStaticDrawPath(bool bNewUseStaticDrawPath);
+
+	/** Returns whether the sections are drawn with cached mesh draw commands */
+	bool GetUseStaticDrawPath() const { return bUseStaticDrawPath; }
+
+	/**
+	 *	Find the closest triangle of the visible sections hit by the segment from Start to End, in world space.
+	 *	The segment is brought in the undeformed space of each section with the inverse of its deform transform, and traced against the BVH of its static mesh (First LOD).
+	 *	The static meshes need Allow CPU Access in cooked builds. Triangles are hit from both sides. Skinned sections and sections with a lattice or a deformer can't be brought back in their undeformed space,
+	 *	their first LOD is deformed with GetDeformedSectionPositions() and all its triangles are tested, which is much slower than the BVH.
+	 */
+	bool LineTraceSections(const FVector& Start, const FVector& End, FDeformMeshTraceHit& OutHit) const;
+
+	/**
+	 *	Find the visible sections with a triangle closer than Radius to Center, in world space.
+	 *	The triangles are moved by the deform transform and the component transform, so the test is exact in world space, also under non uniform scales.
+	 *	Skinned sections and sections with a lattice or a deformer are deformed on the CPU and all their triangles are tested, like in LineTraceSections().
+	 */
+	bool OverlapSphereSections(const FVector& Center, float Radius, TArray<int32>& OutSectionIndices) const;
+
+	/** Enable or disable the CPU deformation of the sections, this recreates the scene proxy */
+	void SetUseCPUDeformation(bool bNewUseCPUDeformation);
+
+	/** Returns whether the sections are deformed on the CPU instead of in the vertex shader */
+	bool GetUseCPUDeformation() const { return bUseCPUDeformation; }
+
+	/**
+	 *	Get the positions of a section's static mesh LOD, deformed by the section's deform transform, in the local space of the component.
+	 *	This runs the same kernel as the CPU deformation. Returns false if the section doesn't exist or if the static mesh doesn't keep its positions on the CPU (Allow CPU Access is needed in cooked builds).
+	 *	Skinned sections are blended with the skinning kernel, only for LOD 0. The lattice and the deformer of a section are applied first, for any LOD.
+	 */
+	bool GetDeformedSectionPositions(int32 SectionIndex, TArray<FVector>& OutPositions, int32 LODIndex = 0) const;
+
+	/** Transform the positions by DeformMatrix (a regular, non transposed matrix), split into parallel tasks for large arrays. OutPositions must have the same size as InPositions */
+	static void DeformPositions(const FMatrix& DeformMatrix, TArrayView<const FVector> InPositions, TArrayView<FVector> OutPositions);
+
+	/** Force all the sections to use one LOD, 0 selects the LOD of each section from its screen size, 1 forces LOD 0, 2 forces LOD 1 and so on. This recreates the scene proxy */
+	void SetForcedLodModel(int32 NewForcedLodModel);
+
+	/** Returns the forced LOD, 0 when the LOD is selected from the screen size */
+	int32 GetForcedLodModel() const { return ForcedLodModel; }
+
+	/** Set the most detailed LOD that the sections can use, this recreates the scene proxy */
+	void SetMinLOD(int32 NewMinLOD);
+
+	/** Returns the most detailed LOD that the sections can use */
+	int32 GetMinLOD() const { return MinLOD; }
+
+	/** Enable or disable the interpolation of the deform transforms on the render thread, this recreates the scene proxy */
+	void SetInterpolateTransforms(bool bNewInterpolateTransforms);
+
+	/** Returns whether the deform transforms are interpolated on the render thread */
+	bool GetInterpolateTransforms() const { return bInterpolateTransforms; }
+
 	/**
 	 *	Get pointer to internal data for one section of this Puzzle mesh component.
 	 *	Note that pointer will becomes invalid if sections are added or removed.
@@ -110,6 +391,8 @@ public:
 	/* MeshComponent is an abstract base for any component that is an instance of a renderable collection of triangles. (UE4 docs)
 	*/
 	virtual int32 GetNumMaterials() const override;
+	/* The override material of a section, or the material of its static mesh*/
+	virtual UMaterialInterface* GetMaterial(int32 ElementIndex) const override;
 	//~ End UMeshComponent Interface.
 
 
@@ -125,10 +408,84 @@ private:
 	virtual FBoxSphereBounds CalcBounds(const FTransform& LocalToWorld) const override;
 	//~ Begin USceneComponent Interface.
 
+	//~ Begin UObject Interface.
+	virtual void PostLoad() override;
+	//~ End UObject Interface.
+
 
 	/** Update LocalBounds member from the local box of each section */
 	void UpdateLocalBounds();
 
+	/** Update LocalBounds from the cached union of the sections' boxes, and send it to the render thread */
+	void SendLocalBounds();
+
+	/**
+	 *	Set the local box of a section from the bounding box of its deformed static mesh, padded by BoundsPadding.
+	 *	Returns true when the cached union of the sections' boxes grew, and needs to be sent.
+	 */
+	bool UpdateSectionLocalBox(FDeformMeshSection& Section, const FBox& DeformedMeshBox);
+
+	/** The box of a section before its deform transform, the bounding box of its lattice points or of its static mesh, moved by its deformer */
+	FBox GetSectionMeshBox(const FDeformMeshSection& Section) const;
+
+	/** The local box of a skinned section, the union of its mesh box deformed by each transform that it blends */
+	FBox GetSkinnedSectionBox(const FDeformMeshSection& Section) const;
+
+	/** The local box of a section under its current deform transform, or under the transforms that it blends */
+	FBox GetDeformedSectionBox(const FDeformMeshSection& Section) const;
+
+	/**
+	 *	The quaternion format only stores a positive uniform scale, any other scale switches the component to Matrix3x4 with a warning.
+	 *	Returns true when the format changed, the transforms packed before that are dropped and the new scene proxy takes them from the sections.
+	 */
+	bool CheckTransformFormatScale(const FVector& Scale);
+
+	/** Drop the deformer of a section when it isn't compiled, with a warning, it's drawn without it. Returns true when the deformer was dropped */
+	bool CheckSectionDeformer(int32 SectionIndex);
+
+	/** Warn that a deformer can't be used because its vertex factory isn't compiled */
+	void LogDeformerNotCompiled(int32 SectionIndex, EDeformMeshDeformer Deformer) const;
+
+	/** Queue the current deform transform of a section with its local box, when only the box changed */
+	void QueueSectionTransform(int32 SectionIndex);
+
+	/** Whether a section has a deformer, the scene proxy then keeps room for the parameters of the deformers after the transforms */
+	bool HasSectionDeformers() const;
+
+	/** Whether a section is drawn with a lit material, or with the default material in its place, the scene proxy then keeps room for the normal matrices after the transforms */
+	bool HasLitSections() const;
+
+	/**
+	 *	Recompute the boxes of the skinned sections after their transforms moved, the boxes that changed are queued with the pending transforms.
+	 *	Returns true when the cached union of the sections' boxes grew, and needs to be sent.
+	 */
+	bool UpdateSkinnedSectionBoxes();
+
+	/** Insert, replace or remove the proxy of one section in the scene proxy, instead of recreating the scene proxy */
+	void UpdateSectionProxy(int32 SectionIndex);
+
+	/** Set the deform transforms of sections, from the transforms set by the user or the matrices computed by the hierarchy, and queue them */
+	template<typename TransformType>
+	void UpdateMeshSectionTransformsImpl(TArrayView<const int32> SectionIndices, TArrayView<const TransformType> Transforms);
+
+	/** Rebuild the hierarchy of sections if the parents changed, then send the deform transforms of the dirty subtrees */
+	void EvaluateSectionHierarchy();
+
+	/** Evaluate the dirty subtrees of the hierarchy and the boxes of the skinned sections, and shrink the bounds if needed. Their transforms are added to the pending ones */
+	void EvaluatePendingTransforms();
+
+	/** Add this component to the queue of the DeformMesh world subsystem, returns false when there's no subsystem to flush it */
+	bool QueuePendingTransforms();
+
+	/**
+	 *	Send the pending transforms of the components to their scene proxies, then move the interpolated transforms of InterpolatedComponents to the world time Time.
+	 *	A single render command does it for all of them.
+	 */
+	static void FlushPendingTransforms(TArrayView<UDeformMeshComponent* const> Components, TArrayView<UDeformMeshComponent* const> InterpolatedComponents = TArrayView<UDeformMeshComponent* const>(), float Time = 0.f);
+
+	/** Flush the pool of transforms shared by the scene proxies of a world's scene, so its previous buffer catches up on a frame without new transforms */
+	static void FlushTransformsPool(UWorld* World);
+
 	/** Array of sections of mesh */
 	UPROPERTY()
 	TArray<FDeformMeshSection> DeformMeshSections;
@@ -137,6 +494,91 @@ private:
 	UPROPERTY()
 	FBoxSphereBounds LocalBounds;
 
+	/** Union of the local boxes of the sections, it grows with each update and is only rescanned when it needs to shrink */
+	FBox CachedLocalBox = FBox(ForceInit);
+
+	/** Set when a section on the border of CachedLocalBox moved, so the union may be smaller than it is */
+	bool bLocalBoundsNeedShrink = false;
+
+	/** The sections updated since the last flush, with their transforms packed in TransformFormat and their new local boxes */
+	TArray<int32> PendingSectionIndices;
+	TArray<FVector4> PendingTransforms;
+	TArray<FBox> PendingSectionBoxes;
+
+	/** The sections whose deformer parameters changed since the last flush, sent with the pending transforms */
+	TArray<int32> PendingDeformerSectionIndices;
+	TArray<FVector4> PendingDeformerParams;
+
+	/** The sections that are skinned, their boxes depend on the transforms of other sections */
+	TArray<int32> SkinnedSectionIndices;
+
+	/** Parent / child relations of the sections, in a flat layout for the evaluation. Empty when no section has a parent */
+	FDeformMeshHierarchy SectionHierarchy;
+
+	/** Set when sections or parents changed, the hierarchy is rebuilt on the next evaluation */
+	bool bSectionHierarchyNeedsBuild = true;
+
+	/** Set when a transform blended by a skinned section changed without updating the boxes of the skinned sections */
+	bool bSkinnedSectionBoxesDirty = false;
+
+	/** Whether this component is in the queue of the DeformMesh world subsystem */
+	bool bPendingTransformsQueued = false;
+
+	/** World time of the last transforms sent to the scene proxy, the subsystem interpolates the component until MaxInterpolationInterval after it */
+	float LastTransformsFlushTime = 0.f;
+
+	/** Padding added to the bounds of each section, deformations that stay inside the padded bounds don't need to send new bounds to the render thread */
+	UPROPERTY(EditAnywhere, Category = "DeformMesh", meta = (ClampMin = "0.0"))
+	float BoundsPadding = 0.f;
+
+	/** Storage format of the deform transforms on the render thread, the compact formats save memory and upload bandwidth when there's a lot of sections */
+	UPROPERTY(EditAnywhere, Category = "DeformMesh")
+	EDeformMeshTransformFormat TransformFormat = EDeformMeshTransformFormat::Matrix4x4;
+
+	/** Draw the visible sections that share the same static mesh and material with one instanced draw call, instead of one draw call per section */
+	UPROPERTY(EditAnywhere, Category = "DeformMesh")
+	bool bUseInstancedRendering = false;
+
+	/**
+	 *	Register the sections once as static meshes so the renderer caches their mesh draw commands, the deformation still comes from the transforms buffer.
+	 *	Best for components whose sections are rarely added or removed, the dynamic path is used while they change. Sections aren't frustum culled individually on this path.
+	 *	Moving the sections keeps the cached draw commands, they're only rebuilt when the transforms pool of the scene grows.
+	 */
+	UPROPERTY(EditAnywhere, Category = "DeformMesh")
+	bool bUseStaticDrawPath = false;
+
+	/**
+	 *	Deform the positions of the sections on the CPU, into a dynamic vertex buffer per section, instead of reading the transforms in the vertex shader.
+	 *	This is always used on the feature levels that can't read a structured buffer in the vertex shader. Each section only deforms one LOD (the forced LOD or MinLOD), and instancing is disabled.
+	 *	The static meshes need Allow CPU Access in cooked builds.
+	 */
+	UPROPERTY(EditAnywhere, Category = "DeformMesh")
+	bool bUseCPUDeformation = false;
+
+	/**
+	 *	If greater than 0, all the sections use the LOD ForcedLodModel - 1, instead of selecting it from the screen size of their deformed bounds.
+	 *	The instanced and static draw paths don't select the LOD per view, they always use the forced LOD or MinLOD.
+	 */
+	UPROPERTY(EditAnywhere, Category = "DeformMesh", meta = (ClampMin = "0"))
+	int32 ForcedLodModel = 0;
+
+	/** The most detailed LOD that the sections can use, it's clamped to the LOD count of each section's static mesh */
+	UPROPERTY(EditAnywhere, Category = "DeformMesh", meta = (ClampMin = "0"))
+	int32 MinLOD = 0;
+
+	/**
+	 *	Interpolate the deform transforms on the render thread, so the sections move smoothly when their transforms are updated less often than the frame rate.
+	 *	Each section goes from its displayed transform to the new one over the time between its last two updates (Translation and scale are lerped, rotation is slerped).
+	 *	This delays each update by one update interval. Needs the DeformMesh world subsystem.
+	 */
+	UPROPERTY(EditAnywhere, Category = "DeformMesh")
+	bool bInterpolateTransforms = false;
+
+	/** Updates further apart than this, in seconds, aren't interpolated, the section snaps to its new transform */
+	UPROPERTY(EditAnywhere, Category = "DeformMesh", meta = (ClampMin = "0.0", EditCondition = "bInterpolateTransforms"))
+	float MaxInterpolationInterval = 0.1f;
+
 	friend class FDeformMeshSceneProxy;
+	friend class UDeformMeshSubsystem;
 };
 
@@ -0,0 +1,352 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "DeformMeshDeformers.h"
+#include "DeformMesh.h"
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/AutomationTest.h"
+
+/* Number of vertices that each task of the deformers processes*/
+static constexpr int32 DeformerPositionsChunkSize = 4096;
+
+static TAutoConsoleVariable<int32> CVarDeformMeshDeformers(
+	TEXT("DeformMesh.Deformers"),
+	0xF,
+	TEXT("Bitmask of the analytic deformers that have a shader permutation: 1 = bend, 2 = twist, 4 = taper, 8 = wave.\n")
+	TEXT("The shaders of the other deformers aren't compiled and the sections can't use them. Set it in the ini files, it is read when the shaders are compiled.\n")
+	TEXT("It only decides which deformer vertex factory types compile the materials, those types are part of the shader map id so changing it rebuilds the shader maps."),
+	ECVF_ReadOnly | ECVF_RenderThreadSafe);
+
+
+bool FDeformMeshDeformers::IsDeformerCompiled(EDeformMeshDeformer Deformer)
+{
+	if (Deformer == EDeformMeshDeformer::None)
+	{
+		return true;
+	}
+	const int32 Bit = 1 << ((int32)Deformer - 1);
+	return (CVarDeformMeshDeformers.GetValueOnAnyThread() & Bit) != 0;
+}
+
+bool FDeformMeshDeformers::IsIdentity(EDeformMeshDeformer Deformer, const FVector4& Params)
+{
+	switch (Deformer)
+	{
+	case EDeformMeshDeformer::Bend:
+		//The radius of the bend is Length / Angle, a straight or empty range doesn't bend anything
+		return FMath::Abs(Params.X) < KINDA_SMALL_NUMBER || Params.Z - Params.Y < KINDA_SMALL_NUMBER;
+	case EDeformMeshDeformer::Twist:
+	case EDeformMeshDeformer::Taper:
+	case EDeformMeshDeformer::Wave:
+		return FMath::Abs(Params.X) < KINDA_SMALL_NUMBER;
+	default:
+		return true;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////
+// The kernels
+// One struct per deformer, the constructor reads the parameters once and Apply() moves one position
+// The loop is instantiated for each one, so there is no switch in the inner loop
+
+/* Where Z is in the range of a deformer, 0 at Start and 1 at End. An empty range is a step at Start*/
+static FORCEINLINE float GetDeformerRangeAlpha(float Z, float Start, float InvLength)
+{
+	return FMath::Clamp((Z - Start) * InvLength, 0.f, 1.f);
+}
+
+static FORCEINLINE float GetDeformerInvLength(const FVector4& Params)
+{
+	return 1.f / FMath::Max(Params.Z - Params.Y, SMALL_NUMBER);
+}
+
+template<EDeformMeshDeformer Deformer>
+struct TDeformMeshDeformerKernel;
+
+template<>
+struct TDeformMeshDeformerKernel<EDeformMeshDeformer::Bend>
+{
+	float Start;
+	float End;
+	float Curvature;
+	float Radius;
+
+	explicit TDeformMeshDeformerKernel(const FVector4& Params)
+		: Start(Params.Y)
+		, End(Params.Z)
+		, Curvature(Params.X / (Params.Z - Params.Y))
+		, Radius((Params.Z - Params.Y) / Params.X)
+	{
+	}
+
+	FORCEINLINE FVector Apply(const FVector& Position) const
+	{
+		//The bent part is an arc around (Radius, Start) on the XZ plane
+		const float ClampedZ = FMath::Clamp(Position.Z, Start, End);
+		float Sin, Cos;
+		FMath::SinCos(&Sin, &Cos, Curvature * (ClampedZ - Start));
+		const float ArcRadius = Radius - Position.X;
+
+		//Below Start the angle is 0 and this is the identity, above End the mesh continues along the tangent of the arc
+		const float Beyond = Position.Z - ClampedZ;
+		return FVector(Radius - ArcRadius * Cos + Beyond * Sin, Position.Y, Start + ArcRadius * Sin + Beyond * Cos);
+	}
+};
+
+template<>
+struct TDeformMeshDeformerKernel<EDeformMeshDeformer::Twist>
+{
+	float Angle;
+	float Start;
+	float InvLength;
+
+	explicit TDeformMeshDeformerKernel(const FVector4& Params)
+		: Angle(Params.X)
+		, Start(Params.Y)
+		, InvLength(GetDeformerInvLength(Params))
+	{
+	}
+
+	FORCEINLINE FVector Apply(const FVector& Position) const
+	{
+		float Sin, Cos;
+		FMath::SinCos(&Sin, &Cos, Angle * GetDeformerRangeAlpha(Position.Z, Start, InvLength));
+		return FVector(Position.X * Cos - Position.Y * Sin, Position.X * Sin + Position.Y * Cos, Position.Z);
+	}
+};
+
+template<>
+struct TDeformMeshDeformerKernel<EDeformMeshDeformer::Taper>
+{
+	float Amount;
+	float Start;
+	float InvLength;
+
+	explicit TDeformMeshDeformerKernel(const FVector4& Params)
+		: Amount(Params.X)
+		, Start(Params.Y)
+		, InvLength(GetDeformerInvLength(Params))
+	{
+	}
+
+	FORCEINLINE FVector Apply(const FVector& Position) const
+	{
+		const float Scale = 1.f + Amount * GetDeformerRangeAlpha(Position.Z, Start, InvLength);
+		return FVector(Position.X * Scale, Position.Y * Scale, Position.Z);
+	}
+};
+
+template<>
+struct TDeformMeshDeformerKernel<EDeformMeshDeformer::Wave>
+{
+	float Amplitude;
+	float Frequency;
+	float Phase;
+
+	explicit TDeformMeshDeformerKernel(const FVector4& Params)
+		: Amplitude(Params.X)
+		, Frequency(Params.Y)
+		, Phase(Params.Z)
+	{
+	}
+
+	FORCEINLINE FVector Apply(const FVector& Position) const
+	{
+		return FVector(Position.X + Amplitude * FMath::Sin(Frequency * Position.Z + Phase), Position.Y, Position.Z);
+	}
+};
+
+/* The positions are read before being written, so InPositions and OutPositions can alias*/
+template<EDeformMeshDeformer Deformer>
+static void DeformPositionsRange(const FVector4& Params, const FVector* InPositions, FVector* OutPositions, int32 NumPositions)
+{
+	const TDeformMeshDeformerKernel<Deformer> Kernel(Params);
+	for (int32 Index = 0; Index < NumPositions; Index++)
+	{
+		OutPositions[Index] = Kernel.Apply(InPositions[Index]);
+	}
+}
+
+template<EDeformMeshDeformer Deformer>
+static void DeformPositionsParallel(const FVector4& Params, TArrayView<const FVector> InPositions, TArrayView<FVector> OutPositions)
+{
+	const int32 NumPositions = InPositions.Num();
+	const int32 NumTasks = FMath::DivideAndRoundUp(NumPositions, DeformerPositionsChunkSize);
+	ParallelFor(NumTasks, [&](int32 TaskIndex)
+	{
+		const int32 First = TaskIndex * DeformerPositionsChunkSize;
+		DeformPositionsRange<Deformer>(Params, &InPositions[First], &OutPositions[First], FMath::Min(DeformerPositionsChunkSize, NumPositions - First));
+	}, NumTasks <= 1);
+}
+
+void FDeformMeshDeformers::DeformPositions(EDeformMeshDeformer Deformer, const FVector4& Params, TArrayView<const FVector> InPositions, TArrayView<FVector> OutPositions)
+{
+	check(InPositions.Num() == OutPositions.Num());
+
+	if (IsIdentity(Deformer, Params))
+	{
+		if (InPositions.GetData() != OutPositions.GetData())
+		{
+			FMemory::Memcpy(OutPositions.GetData(), InPositions.GetData(), InPositions.Num() * sizeof(FVector));
+		}
+		return;
+	}
+
+	switch (Deformer)
+	{
+	case EDeformMeshDeformer::Bend:
+		DeformPositionsParallel<EDeformMeshDeformer::Bend>(Params, InPositions, OutPositions);
+		break;
+	case EDeformMeshDeformer::Twist:
+		DeformPositionsParallel<EDeformMeshDeformer::Twist>(Params, InPositions, OutPositions);
+		break;
+	case EDeformMeshDeformer::Taper:
+		DeformPositionsParallel<EDeformMeshDeformer::Taper>(Params, InPositions, OutPositions);
+		break;
+	case EDeformMeshDeformer::Wave:
+		DeformPositionsParallel<EDeformMeshDeformer::Wave>(Params, InPositions, OutPositions);
+		break;
+	default:
+		break;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////
+// The bounds
+
+/* The bend is affine in X for a given Z, so the deformed box is the box of its two edges at Min.X and Max.X*/
+/* Along an edge the path is a line, an arc and a line, its box is reached at the ends of the pieces or where the arc crosses an axis*/
+static FBox GetBentBox(const FVector4& Params, const FBox& Box)
+{
+	const TDeformMeshDeformerKernel<EDeformMeshDeformer::Bend> Kernel(Params);
+
+	TArray<float, TInlineAllocator<16>> Heights;
+	Heights.Add(Box.Min.Z);
+	Heights.Add(Box.Max.Z);
+	auto AddHeight = [&](float Z)
+	{
+		if (Z > Box.Min.Z && Z < Box.Max.Z)
+		{
+			Heights.Add(Z);
+		}
+	};
+	AddHeight(Kernel.Start);
+	AddHeight(Kernel.End);
+
+	//Angles of the arc where its X or Z is extreme, the multiples of 90 degrees
+	const float MinAngle = FMath::Min(0.f, Params.X);
+	const float MaxAngle = FMath::Max(0.f, Params.X);
+	for (float Angle = FMath::CeilToFloat(MinAngle / HALF_PI) * HALF_PI; Angle < MaxAngle; Angle += HALF_PI)
+	{
+		AddHeight(Kernel.Start + Angle / Kernel.Curvature);
+	}
+
+	FBox Result(ForceInit);
+	for (float Z : Heights)
+	{
+		Result += Kernel.Apply(FVector(Box.Min.X, Box.Min.Y, Z));
+		Result += Kernel.Apply(FVector(Box.Max.X, Box.Max.Y, Z));
+	}
+	return Result;
+}
+
+FBox FDeformMeshDeformers::GetDeformedBox(EDeformMeshDeformer Deformer, const FVector4& Params, const FBox& Box)
+{
+	if (!Box.IsValid || IsIdentity(Deformer, Params))
+	{
+		return Box;
+	}
+
+	switch (Deformer)
+	{
+	case EDeformMeshDeformer::Bend:
+		return GetBentBox(Params, Box);
+	case EDeformMeshDeformer::Twist:
+	{
+		//Any rotation around Z stays in the circle through the farthest corner
+		const float Radius = FMath::Sqrt(FMath::Max(FMath::Square(Box.Min.X), FMath::Square(Box.Max.X)) + FMath::Max(FMath::Square(Box.Min.Y), FMath::Square(Box.Max.Y)));
+		return FBox(FVector(-Radius, -Radius, Box.Min.Z), FVector(Radius, Radius, Box.Max.Z));
+	}
+	case EDeformMeshDeformer::Taper:
+	{
+		//The scale is between 1 and 1 + Amount and the deformation is linear in it
+		const float Scale = 1.f + Params.X;
+		FBox Result = Box;
+		Result += FVector(Box.Min.X * Scale, Box.Min.Y * Scale, Box.Min.Z);
+		Result += FVector(Box.Max.X * Scale, Box.Max.Y * Scale, Box.Max.Z);
+		return Result;
+	}
+	case EDeformMeshDeformer::Wave:
+		return Box.ExpandBy(FVector(FMath::Abs(Params.X), 0.f, 0.f), FVector(FMath::Abs(Params.X), 0.f, 0.f));
+	default:
+		return Box;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////
+// Automation tests
+///////////////////////////////////////////////////////////////////////
+#if WITH_DEV_AUTOMATION_TESTS
+
+/* Tie the parameters of each deformer to a closed form result: a 90 degrees bend over a length L puts the end of the range at (2L / PI, 0, 2L / PI) and leaves what is below it,*/
+/* a 180 degrees twist flips X and Y at the end of the range, and a taper of -0.5 halves them there*/
+/* GetDeformedBox() gives the culling bounds of the sections, so the random positions deformed by every deformer must stay inside the box that it returns*/
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDeformMeshDeformersTest, "DeformMesh.DeformerKernels", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FDeformMeshDeformersTest::RunTest(const FString& Parameters)
+{
+	auto DeformOne = [](EDeformMeshDeformer Deformer, const FVector4& Params, const FVector& Position)
+	{
+		FVector Result;
+		FDeformMeshDeformers::DeformPositions(Deformer, Params, MakeArrayView(&Position, 1), MakeArrayView(&Result, 1));
+		return Result;
+	};
+
+	const float Length = 100.f;
+	const FVector4 BendParams(HALF_PI, 0.f, Length, 0.f);
+	const float BendRadius = 2.f * Length / PI;
+	TestTrue(TEXT("Bend, end of the range"), DeformOne(EDeformMeshDeformer::Bend, BendParams, FVector(0.f, 0.f, Length)).Equals(FVector(BendRadius, 0.f, BendRadius), 0.01f));
+	TestTrue(TEXT("Bend, above the range"), DeformOne(EDeformMeshDeformer::Bend, BendParams, FVector(0.f, 0.f, Length + 10.f)).Equals(FVector(BendRadius + 10.f, 0.f, BendRadius), 0.01f));
+	TestTrue(TEXT("Bend, below the range"), DeformOne(EDeformMeshDeformer::Bend, BendParams, FVector(5.f, 3.f, -10.f)).Equals(FVector(5.f, 3.f, -10.f), 0.01f));
+	TestTrue(TEXT("Twist, end of the range"), DeformOne(EDeformMeshDeformer::Twist, FVector4(PI, 0.f, Length, 0.f), FVector(10.f, 5.f, Length)).Equals(FVector(-10.f, -5.f, Length), 0.01f));
+	TestTrue(TEXT("Taper, end of the range"), DeformOne(EDeformMeshDeformer::Taper, FVector4(-0.5f, 0.f, Length, 0.f), FVector(10.f, 5.f, Length)).Equals(FVector(5.f, 2.5f, Length), 0.01f));
+
+	const FBox Box(FVector(-30.f, -20.f, -20.f), FVector(40.f, 20.f, 150.f));
+	FRandomStream Random(11);
+	TArray<FVector> Positions;
+	for (int32 PositionIdx = 0; PositionIdx < 256; PositionIdx++)
+	{
+		Positions.Add(FVector(Random.FRandRange(Box.Min.X, Box.Max.X), Random.FRandRange(Box.Min.Y, Box.Max.Y), Random.FRandRange(Box.Min.Z, Box.Max.Z)));
+	}
+	TArray<FVector> Deformed;
+	Deformed.SetNumUninitialized(Positions.Num());
+
+	struct FDeformerCase
+	{
+		EDeformMeshDeformer Deformer;
+		FVector4 Params;
+	};
+	const FDeformerCase Cases[] =
+	{
+		{ EDeformMeshDeformer::Bend, FVector4(2.5f, 10.f, 90.f, 0.f) },
+		{ EDeformMeshDeformer::Bend, FVector4(-4.f, 0.f, 60.f, 0.f) },
+		{ EDeformMeshDeformer::Twist, FVector4(1.2f, 0.f, 100.f, 0.f) },
+		{ EDeformMeshDeformer::Taper, FVector4(-1.5f, 20.f, 80.f, 0.f) },
+		{ EDeformMeshDeformer::Wave, FVector4(12.f, 0.05f, 1.f, 0.f) },
+	};
+	for (const FDeformerCase& Case : Cases)
+	{
+		FDeformMeshDeformers::DeformPositions(Case.Deformer, Case.Params, Positions, Deformed);
+		const FBox DeformedBox = FDeformMeshDeformers::GetDeformedBox(Case.Deformer, Case.Params, Box).ExpandBy(0.01f);
+		bool bInside = true;
+		for (const FVector& Position : Deformed)
+		{
+			bInside &= DeformedBox.IsInsideOrOn(Position);
+		}
+		TestTrue(FString::Printf(TEXT("%s, deformed box"), *StaticEnum<EDeformMeshDeformer>()->GetNameStringByValue((int64)Case.Deformer)), bInside);
+	}
+
+	return true;
+}
+
+#endif //WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,50 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/ObjectMacros.h"
+#include "DeformMeshDeformers.generated.h"
+
+
+/**
+ *	Analytic deformers that move the vertices of a section in the space of its static mesh, along the Z axis of the mesh.
+ *	Each one has its own vertex factory type (so its own shader permutation) and its own CPU kernel, a section only pays for the deformer it uses.
+ *	The parameters are one float4 per section, stored after the deform transform of the section in the transforms buffer.
+ */
+UENUM()
+enum class EDeformMeshDeformer : uint8
+{
+	/** No analytic deformation */
+	None,
+	/** Bend the mesh around the Y axis towards +X, the part between Start Z and End Z becomes an arc of Angle radians and the part above End Z follows the bent direction. Params: (Angle, Start Z, End Z, unused) */
+	Bend,
+	/** Rotate the mesh around the Z axis, by an angle going from 0 at Start Z to Angle radians at End Z. Params: (Angle, Start Z, End Z, unused) */
+	Twist,
+	/** Scale the mesh on X and Y, by a factor going from 1 at Start Z to 1 + Amount at End Z. Params: (Amount, Start Z, End Z, unused) */
+	Taper,
+	/** Offset the mesh on X by Amplitude * sin(Frequency * Z + Phase). Params: (Amplitude, Frequency, Phase, unused) */
+	Wave,
+
+	Num UMETA(Hidden)
+};
+
+class DEFORMMESH_API FDeformMeshDeformers
+{
+public:
+
+	/** Whether the shader permutation of a deformer is compiled, from the DeformMesh.Deformers console variable. The sections can't use the other ones */
+	static bool IsDeformerCompiled(EDeformMeshDeformer Deformer);
+
+	/** Whether the parameters don't move the vertices, a bend of 0 radians or over an empty range for example. The vertex shader skips these too */
+	static bool IsIdentity(EDeformMeshDeformer Deformer, const FVector4& Params);
+
+	/**
+	 *	Reference kernels of the deformers, the vertex shader does the same math on the GPU. Each deformer runs its own specialized loop.
+	 *	InPositions and OutPositions can be the same array.
+	 */
+	static void DeformPositions(EDeformMeshDeformer Deformer, const FVector4& Params, TArrayView<const FVector> InPositions, TArrayView<FVector> OutPositions);
+
+	/** The bounding box of Box after the deformation, it contains the deformed mesh when Box contains the mesh */
+	static FBox GetDeformedBox(EDeformMeshDeformer Deformer, const FVector4& Params, const FBox& Box);
+};
@@ -0,0 +1,127 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "DeformMeshDriverComponent.h"
+#include "DeformMeshComponent.h"
+#include "Components/SceneComponent.h"
+
+
+UDeformMeshDriverComponent::UDeformMeshDriverComponent()
+{
+	//The tick is only enabled when the source moved, and it disables itself once the transform is submitted
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = false;
+}
+
+void UDeformMeshDriverComponent::SetTarget(UDeformMeshComponent* NewDeformMesh, int32 NewSectionIndex)
+{
+	DeformMesh = NewDeformMesh;
+	SectionIndex = NewSectionIndex;
+	bHasSubmittedTransform = false;
+	SetComponentTickEnabled(true);
+}
+
+void UDeformMeshDriverComponent::SetSource(USceneComponent* NewSource)
+{
+	UnbindSource();
+	Source = NewSource;
+	//An unregistered driver binds its source in OnRegister()
+	if (IsRegistered())
+	{
+		BindSource();
+	}
+	SetComponentTickEnabled(true);
+}
+
+void UDeformMeshDriverComponent::BindSource()
+{
+	if (Source != nullptr && !SourceTransformUpdatedHandle.IsValid())
+	{
+		SourceTransformUpdatedHandle = Source->TransformUpdated.AddUObject(this, &UDeformMeshDriverComponent::OnSourceTransformUpdated);
+	}
+}
+
+void UDeformMeshDriverComponent::UnbindSource()
+{
+	if (Source != nullptr && SourceTransformUpdatedHandle.IsValid())
+	{
+		Source->TransformUpdated.Remove(SourceTransformUpdatedHandle);
+	}
+	SourceTransformUpdatedHandle.Reset();
+}
+
+void UDeformMeshDriverComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	//The source and the target may have been set in the editor, the source is already bound so we only sync the section once
+	SetComponentTickEnabled(true);
+}
+
+void UDeformMeshDriverComponent::OnRegister()
+{
+	Super::OnRegister();
+	//Symmetric with OnUnregister(), so a driver that is unregistered and registered again (Re-running the construction script, undo) keeps following its source
+	BindSource();
+}
+
+void UDeformMeshDriverComponent::OnUnregister()
+{
+	UnbindSource();
+	Super::OnUnregister();
+}
+
+#if WITH_EDITOR
+void UDeformMeshDriverComponent::PreEditChange(FProperty* PropertyAboutToChange)
+{
+	//The handle belongs to the delegate of the previous source, it's removed before the property changes
+	if (PropertyAboutToChange != nullptr && PropertyAboutToChange->GetFName() == GET_MEMBER_NAME_CHECKED(UDeformMeshDriverComponent, Source))
+	{
+		UnbindSource();
+	}
+	Super::PreEditChange(PropertyAboutToChange);
+}
+
+void UDeformMeshDriverComponent::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+
+	const FName PropertyName = PropertyChangedEvent.GetPropertyName();
+	if (PropertyName == GET_MEMBER_NAME_CHECKED(UDeformMeshDriverComponent, Source) && IsRegistered())
+	{
+		BindSource();
+		SetComponentTickEnabled(true);
+	}
+	else if (PropertyName == GET_MEMBER_NAME_CHECKED(UDeformMeshDriverComponent, DeformMesh) || PropertyName == GET_MEMBER_NAME_CHECKED(UDeformMeshDriverComponent, SectionIndex))
+	{
+		//Same as SetTarget(), the new section is synced on the next tick
+		bHasSubmittedTransform = false;
+		SetComponentTickEnabled(true);
+	}
+}
+#endif
+
+void UDeformMeshDriverComponent::OnSourceTransformUpdated(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport)
+{
+	SetComponentTickEnabled(true);
+}
+
+void UDeformMeshDriverComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	if (Source != nullptr && DeformMesh != nullptr)
+	{
+		const FTransform& Transform = Source->GetComponentTransform();
+		//Nothing to send if the source didn't really move, the update would only cost render commands and a bounds update
+		if (!bHasSubmittedTransform || !Transform.Equals(LastSubmittedTransform, Tolerance))
+		{
+			DeformMesh->UpdateMeshSectionTransform(SectionIndex, Transform);
+			DeformMesh->FinishTransformsUpdate();
+			LastSubmittedTransform = Transform;
+			bHasSubmittedTransform = true;
+		}
+	}
+
+	//Sleep until the source moves again
+	SetComponentTickEnabled(false);
+}
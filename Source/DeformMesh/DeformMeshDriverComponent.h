@@ -0,0 +1,76 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "DeformMeshDriverComponent.generated.h"
+
+//Forward declarations
+class UDeformMeshComponent;
+class USceneComponent;
+
+/**
+ *	Drives the deform transform of one section of a DeformMeshComponent from the transform of a scene component.
+ *	The section is only updated when the source moved by more than Tolerance since the last submitted transform.
+ *	The component doesn't tick while the source is idle, it's woken up by the TransformUpdated event of the source, so an idle driver costs nothing per frame.
+ */
+UCLASS(meta = (BlueprintSpawnableComponent), ClassGroup = Rendering)
+class DEFORMMESH_API UDeformMeshDriverComponent : public UActorComponent
+{
+	GENERATED_BODY()
+public:
+
+	UDeformMeshDriverComponent();
+
+	/** Set the deform mesh and the section that this driver updates */
+	void SetTarget(UDeformMeshComponent* NewDeformMesh, int32 NewSectionIndex);
+
+	/** Set the scene component whose transform is used as deform transform, the section is synced on the next tick */
+	void SetSource(USceneComponent* NewSource);
+
+	/** Largest difference of location, rotation and scale components that is considered as no change */
+	UPROPERTY(EditAnywhere, Category = "DeformMesh", meta = (ClampMin = "0.0"))
+	float Tolerance = KINDA_SMALL_NUMBER;
+
+	//~ Begin UActorComponent Interface.
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+protected:
+	virtual void BeginPlay() override;
+	virtual void OnRegister() override;
+	virtual void OnUnregister() override;
+	//~ End UActorComponent Interface.
+
+public:
+#if WITH_EDITOR
+	//~ Begin UObject Interface.
+	virtual void PreEditChange(FProperty* PropertyAboutToChange) override;
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+	//~ End UObject Interface.
+#endif
+
+private:
+
+	/** Called when the source moved, we wait for the next tick to submit the transform, so multiple moves in a frame only send one update */
+	void OnSourceTransformUpdated(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport);
+
+	void BindSource();
+	void UnbindSource();
+
+	UPROPERTY(EditAnywhere, Category = "DeformMesh")
+	UDeformMeshComponent* DeformMesh = nullptr;
+
+	UPROPERTY(EditAnywhere, Category = "DeformMesh")
+	int32 SectionIndex = 0;
+
+	UPROPERTY(EditAnywhere, Category = "DeformMesh")
+	USceneComponent* Source = nullptr;
+
+	/** The last transform sent to the deform mesh */
+	FTransform LastSubmittedTransform;
+
+	/** Whether LastSubmittedTransform was sent to the current target */
+	bool bHasSubmittedTransform = false;
+
+	FDelegateHandle SourceTransformUpdatedHandle;
+};
@@ -0,0 +1,219 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "DeformMeshHierarchy.h"
+#include "Async/ParallelFor.h"
+
+/* Below this number of dirty sections, the evaluation runs on the calling thread, the tasks would cost more than the matrix multiplies*/
+static constexpr int32 DeformMeshHierarchyMinParallelSlots = 1024;
+
+
+void FDeformMeshHierarchy::Build(TArrayView<const int32> ParentIndices, TArrayView<const FTransform> LocalTransforms)
+{
+	check(ParentIndices.Num() == LocalTransforms.Num());
+	Reset();
+
+	const int32 NumSections = ParentIndices.Num();
+
+	//The children of each section, as ranges of one array
+	TArray<int32> FirstChild;
+	TArray<int32> NumChildren;
+	FirstChild.Init(0, NumSections + 1);
+	NumChildren.Init(0, NumSections);
+	for (int32 SectionIndex = 0; SectionIndex < NumSections; SectionIndex++)
+	{
+		if (ParentIndices.IsValidIndex(ParentIndices[SectionIndex]))
+		{
+			NumChildren[ParentIndices[SectionIndex]]++;
+		}
+	}
+	for (int32 SectionIndex = 0; SectionIndex < NumSections; SectionIndex++)
+	{
+		FirstChild[SectionIndex + 1] = FirstChild[SectionIndex] + NumChildren[SectionIndex];
+		NumChildren[SectionIndex] = 0;
+	}
+	TArray<int32> Children;
+	Children.SetNumUninitialized(FirstChild[NumSections]);
+	for (int32 SectionIndex = 0; SectionIndex < NumSections; SectionIndex++)
+	{
+		const int32 ParentIndex = ParentIndices[SectionIndex];
+		if (ParentIndices.IsValidIndex(ParentIndex))
+		{
+			Children[FirstChild[ParentIndex] + NumChildren[ParentIndex]++] = SectionIndex;
+		}
+	}
+
+	SlotSectionIndices.Reserve(NumSections);
+	SlotParents.Reserve(NumSections);
+	SlotSubtreeEnds.SetNumUninitialized(NumSections);
+	SlotRoots.Reserve(NumSections);
+	SectionSlots.Init(INDEX_NONE, NumSections);
+
+	//Depth first from each root, with an explicit stack so deep chains don't overflow
+	TArray<TPair<int32, int32>> Stack;
+	for (int32 RootIndex = 0; RootIndex < NumSections; RootIndex++)
+	{
+		if (ParentIndices.IsValidIndex(ParentIndices[RootIndex]))
+		{
+			continue;
+		}
+
+		const int32 RootNumber = RootSlots.Add(SlotSectionIndices.Num());
+		Stack.Add(TPair<int32, int32>(RootIndex, INDEX_NONE));
+		while (Stack.Num() > 0)
+		{
+			const TPair<int32, int32> Entry = Stack.Pop(false);
+			const int32 SectionIndex = Entry.Key;
+			const int32 Slot = SlotSectionIndices.Add(SectionIndex);
+			SlotParents.Add(Entry.Value);
+			SlotRoots.Add(RootNumber);
+			SectionSlots[SectionIndex] = Slot;
+
+			//Pushed in reverse so the children keep their order
+			for (int32 ChildIdx = FirstChild[SectionIndex + 1] - 1; ChildIdx >= FirstChild[SectionIndex]; ChildIdx--)
+			{
+				Stack.Add(TPair<int32, int32>(Children[ChildIdx], Slot));
+			}
+		}
+	}
+	//The sections in a cycle aren't reachable from a root, the component doesn't allow cycles
+	check(SlotSectionIndices.Num() == NumSections);
+
+	//The subtree of a slot ends where the next slot that isn't one of its descendants starts, the children are after their parent so we go backwards
+	for (int32 Slot = 0; Slot < NumSections; Slot++)
+	{
+		SlotSubtreeEnds[Slot] = Slot + 1;
+	}
+	for (int32 Slot = NumSections - 1; Slot >= 0; Slot--)
+	{
+		const int32 ParentSlot = SlotParents[Slot];
+		if (ParentSlot != INDEX_NONE)
+		{
+			SlotSubtreeEnds[ParentSlot] = FMath::Max(SlotSubtreeEnds[ParentSlot], SlotSubtreeEnds[Slot]);
+		}
+	}
+
+	LocalMatrices.SetNumUninitialized(NumSections);
+	DeformMatrices.SetNumUninitialized(NumSections);
+	for (int32 Slot = 0; Slot < NumSections; Slot++)
+	{
+		LocalMatrices[Slot] = LocalTransforms[SlotSectionIndices[Slot]].ToMatrixWithScale();
+	}
+
+	DirtySlots.Init(true, NumSections);
+	DirtyRoots.Init(true, RootSlots.Num());
+	NumDirtySlots = NumSections;
+}
+
+void FDeformMeshHierarchy::Reset()
+{
+	SlotSectionIndices.Reset();
+	SlotParents.Reset();
+	SlotSubtreeEnds.Reset();
+	SlotRoots.Reset();
+	LocalMatrices.Reset();
+	DeformMatrices.Reset();
+	DirtySlots.Init(false, 0);
+	RootSlots.Reset();
+	DirtyRoots.Init(false, 0);
+	SectionSlots.Reset();
+	NumDirtySlots = 0;
+}
+
+void FDeformMeshHierarchy::SetLocalTransform(int32 SectionIndex, const FTransform& LocalTransform)
+{
+	if (SectionSlots.IsValidIndex(SectionIndex))
+	{
+		const int32 Slot = SectionSlots[SectionIndex];
+		LocalMatrices[Slot] = LocalTransform.ToMatrixWithScale();
+		MarkDirty(Slot, SlotSubtreeEnds[Slot]);
+	}
+}
+
+void FDeformMeshHierarchy::SetRootDeformMatrix(int32 SectionIndex, const FMatrix& DeformMatrix)
+{
+	if (SectionSlots.IsValidIndex(SectionIndex))
+	{
+		const int32 Slot = SectionSlots[SectionIndex];
+		if (SlotParents[Slot] == INDEX_NONE)
+		{
+			LocalMatrices[Slot] = DeformMatrix;
+			DeformMatrices[Slot] = DeformMatrix;
+			MarkDirty(Slot + 1, SlotSubtreeEnds[Slot]);
+		}
+	}
+}
+
+void FDeformMeshHierarchy::MarkDirty(int32 FirstSlot, int32 EndSlot)
+{
+	if (FirstSlot >= EndSlot)
+	{
+		return;
+	}
+
+	for (int32 Slot = FirstSlot; Slot < EndSlot; Slot++)
+	{
+		if (!DirtySlots[Slot])
+		{
+			DirtySlots[Slot] = true;
+			NumDirtySlots++;
+		}
+	}
+	DirtyRoots[SlotRoots[FirstSlot]] = true;
+}
+
+void FDeformMeshHierarchy::EvaluateSubtree(int32 RootNumber)
+{
+	const int32 RootSlot = RootSlots[RootNumber];
+	const int32 EndSlot = SlotSubtreeEnds[RootSlot];
+
+	//The parents come first, so their deform matrix is up to date when we reach their children
+	for (int32 Slot = RootSlot; Slot < EndSlot; Slot++)
+	{
+		if (DirtySlots[Slot])
+		{
+			const int32 ParentSlot = SlotParents[Slot];
+			DeformMatrices[Slot] = ParentSlot == INDEX_NONE ? LocalMatrices[Slot] : LocalMatrices[Slot] * DeformMatrices[ParentSlot];
+		}
+	}
+}
+
+void FDeformMeshHierarchy::Evaluate(TArray<int32>& OutSectionIndices, TArray<FMatrix>& OutDeformMatrices)
+{
+	OutSectionIndices.Reset();
+	OutDeformMatrices.Reset();
+	if (NumDirtySlots == 0)
+	{
+		return;
+	}
+
+	TArray<int32> RootsToEvaluate;
+	for (TConstSetBitIterator<> It(DirtyRoots); It; ++It)
+	{
+		RootsToEvaluate.Add(It.GetIndex());
+	}
+
+	//Each task evaluates whole root subtrees, they write to different slots
+	ParallelFor(RootsToEvaluate.Num(), [this, &RootsToEvaluate](int32 Index)
+	{
+		EvaluateSubtree(RootsToEvaluate[Index]);
+	}, NumDirtySlots < DeformMeshHierarchyMinParallelSlots);
+
+	OutSectionIndices.Reserve(NumDirtySlots);
+	OutDeformMatrices.Reserve(NumDirtySlots);
+	for (TConstSetBitIterator<> It(DirtySlots); It; ++It)
+	{
+		OutSectionIndices.Add(SlotSectionIndices[It.GetIndex()]);
+		OutDeformMatrices.Add(DeformMatrices[It.GetIndex()]);
+	}
+
+	DirtySlots.Init(false, DirtySlots.Num());
+	DirtyRoots.Init(false, DirtyRoots.Num());
+	NumDirtySlots = 0;
+}
+
+SIZE_T FDeformMeshHierarchy::GetAllocatedSize() const
+{
+	return SlotSectionIndices.GetAllocatedSize() + SlotParents.GetAllocatedSize() + SlotSubtreeEnds.GetAllocatedSize() + SlotRoots.GetAllocatedSize()
+		+ LocalMatrices.GetAllocatedSize() + DeformMatrices.GetAllocatedSize() + DirtySlots.GetAllocatedSize()
+		+ RootSlots.GetAllocatedSize() + DirtyRoots.GetAllocatedSize() + SectionSlots.GetAllocatedSize();
+}
@@ -0,0 +1,68 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+/**
+ *	The parent / child relations of the sections of a DeformMesh, with their local and deform matrices stored in flat arrays (one entry per slot).
+ *	The sections are sorted depth first, so a parent always comes before its children and each subtree is a contiguous range of slots.
+ *	The evaluation is one linear pass over the dirty slots, the subtrees of different roots are independent and evaluated in parallel.
+ *	The matrices are regular (non transposed) matrices, in the local space of the component for the deform matrices. Game thread only.
+ */
+class DEFORMMESH_API FDeformMeshHierarchy
+{
+public:
+
+	/** Build the hierarchy, ParentIndices[i] is the parent section of the section i or INDEX_NONE, without cycles. All the sections are dirty after this */
+	void Build(TArrayView<const int32> ParentIndices, TArrayView<const FTransform> LocalTransforms);
+
+	/** Remove all the sections */
+	void Reset();
+
+	bool IsEmpty() const { return SectionSlots.Num() == 0; }
+
+	bool HasDirtySections() const { return NumDirtySlots > 0; }
+
+	/** Set the transform of a section relative to its parent, the section and its children are evaluated on the next Evaluate() */
+	void SetLocalTransform(int32 SectionIndex, const FTransform& LocalTransform);
+
+	/** The deform matrix of a root section was set directly, only its children need to be evaluated. Does nothing for the sections that have a parent */
+	void SetRootDeformMatrix(int32 SectionIndex, const FMatrix& DeformMatrix);
+
+	/** Compute the deform matrices of the dirty sections, and return them with their section indices */
+	void Evaluate(TArray<int32>& OutSectionIndices, TArray<FMatrix>& OutDeformMatrices);
+
+	SIZE_T GetAllocatedSize() const;
+
+private:
+
+	/** Mark the slots [First, End) as dirty, and the root subtree that contains them */
+	void MarkDirty(int32 FirstSlot, int32 EndSlot);
+
+	/** Evaluate the dirty slots of one root subtree, RootNumber indexes RootSlots */
+	void EvaluateSubtree(int32 RootNumber);
+
+	/* Per slot arrays, in depth first order*/
+	TArray<int32> SlotSectionIndices;
+	/* Slot of the parent, INDEX_NONE for the roots*/
+	TArray<int32> SlotParents;
+	/* End of the subtree of the slot (exclusive), the subtree starts at the slot itself*/
+	TArray<int32> SlotSubtreeEnds;
+	/* Index of the root subtree that contains the slot, in RootSlots*/
+	TArray<int32> SlotRoots;
+	TArray<FMatrix> LocalMatrices;
+	TArray<FMatrix> DeformMatrices;
+	TBitArray<> DirtySlots;
+
+	/* Per root arrays*/
+	TArray<int32> RootSlots;
+	TBitArray<> DirtyRoots;
+
+	/* Slot of each section*/
+	TArray<int32> SectionSlots;
+
+	/* Number of dirty slots, the evaluation is parallel when there's enough of them*/
+	int32 NumDirtySlots = 0;
+};
@@ -0,0 +1,228 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "DeformMeshLattice.h"
+#include "DeformMesh.h"
+#include "Async/ParallelFor.h"
+#include "Misc/AutomationTest.h"
+
+/* Number of vertices that each task of the lattice deformation processes*/
+static constexpr int32 LatticePositionsChunkSize = 4096;
+
+
+FIntVector FDeformMeshLattice::ClampResolution(const FIntVector& Resolution)
+{
+	return FIntVector(
+		FMath::Clamp(Resolution.X, 2, MaxResolution),
+		FMath::Clamp(Resolution.Y, 2, MaxResolution),
+		FMath::Clamp(Resolution.Z, 2, MaxResolution));
+}
+
+FVector FDeformMeshLattice::GetInvSize(const FBox& Box)
+{
+	const FVector Size = Box.GetSize();
+	return FVector(Size.X > SMALL_NUMBER ? 1.f / Size.X : 0.f, Size.Y > SMALL_NUMBER ? 1.f / Size.Y : 0.f, Size.Z > SMALL_NUMBER ? 1.f / Size.Z : 0.f);
+}
+
+void FDeformMeshLattice::MakeRestPoints(const FBox& Box, const FIntVector& Resolution, TArray<FVector>& OutPoints)
+{
+	OutPoints.SetNumUninitialized(Resolution.X * Resolution.Y * Resolution.Z);
+	const FVector Step = Box.GetSize() / FVector(Resolution.X - 1, Resolution.Y - 1, Resolution.Z - 1);
+	int32 PointIndex = 0;
+	for (int32 Z = 0; Z < Resolution.Z; Z++)
+	{
+		for (int32 Y = 0; Y < Resolution.Y; Y++)
+		{
+			for (int32 X = 0; X < Resolution.X; X++)
+			{
+				OutPoints[PointIndex++] = Box.Min + Step * FVector(X, Y, Z);
+			}
+		}
+	}
+}
+
+/* The Bernstein basis of degree NumPoints - 1 at T, the weights of the control points on one axis*/
+static void ComputeBernsteinWeights(float T, int32 NumPoints, float* OutWeights)
+{
+	//De Casteljau style, the basis of degree d + 1 is built from the one of degree d
+	OutWeights[0] = 1.f;
+	const float OneMinusT = 1.f - T;
+	for (int32 Degree = 1; Degree < NumPoints; Degree++)
+	{
+		float Previous = 0.f;
+		for (int32 Idx = 0; Idx < Degree; Idx++)
+		{
+			const float Weight = OutWeights[Idx];
+			OutWeights[Idx] = Previous + OneMinusT * Weight;
+			Previous = T * Weight;
+		}
+		OutWeights[Degree] = Previous;
+	}
+}
+
+static void DeformPositionsTrilinearRange(const FVector& Min, const FVector& InvSize, const FIntVector& Resolution, const FVector4* RESTRICT ControlPoints, const FVector* RESTRICT InPositions, FVector* RESTRICT OutPositions, int32 NumPositions)
+{
+	const FVector MaxCell(Resolution.X - 1, Resolution.Y - 1, Resolution.Z - 1);
+	const int32 StrideY = Resolution.X;
+	const int32 StrideZ = Resolution.X * Resolution.Y;
+
+	for (int32 Index = 0; Index < NumPositions; Index++)
+	{
+		//Position in the lattice, in cells
+		const FVector Lattice = (((InPositions[Index] - Min) * InvSize).BoundToBox(FVector::ZeroVector, FVector::OneVector)) * MaxCell;
+		const int32 CellX = FMath::Min((int32)Lattice.X, Resolution.X - 2);
+		const int32 CellY = FMath::Min((int32)Lattice.Y, Resolution.Y - 2);
+		const int32 CellZ = FMath::Min((int32)Lattice.Z, Resolution.Z - 2);
+		const float TX = Lattice.X - CellX;
+		const float TY = Lattice.Y - CellY;
+		const float TZ = Lattice.Z - CellZ;
+
+		//The 8 corners of the cell, accumulated 4 components at a time
+		const FVector4* Corner = ControlPoints + CellX + CellY * StrideY + CellZ * StrideZ;
+		VectorRegister Result = VectorZero();
+		for (int32 DZ = 0; DZ < 2; DZ++)
+		{
+			const float WZ = DZ ? TZ : 1.f - TZ;
+			for (int32 DY = 0; DY < 2; DY++)
+			{
+				const float WYZ = (DY ? TY : 1.f - TY) * WZ;
+				const FVector4* Row = Corner + DY * StrideY + DZ * StrideZ;
+				Result = VectorMultiplyAdd(VectorLoad(&Row[0]), VectorSetFloat1((1.f - TX) * WYZ), Result);
+				Result = VectorMultiplyAdd(VectorLoad(&Row[1]), VectorSetFloat1(TX * WYZ), Result);
+			}
+		}
+		VectorStoreFloat3(Result, &OutPositions[Index]);
+	}
+}
+
+static void DeformPositionsBernsteinRange(const FVector& Min, const FVector& InvSize, const FIntVector& Resolution, const FVector4* RESTRICT ControlPoints, const FVector* RESTRICT InPositions, FVector* RESTRICT OutPositions, int32 NumPositions)
+{
+	float WeightsX[FDeformMeshLattice::MaxResolution];
+	float WeightsY[FDeformMeshLattice::MaxResolution];
+	float WeightsZ[FDeformMeshLattice::MaxResolution];
+
+	for (int32 Index = 0; Index < NumPositions; Index++)
+	{
+		const FVector T = ((InPositions[Index] - Min) * InvSize).BoundToBox(FVector::ZeroVector, FVector::OneVector);
+		ComputeBernsteinWeights(T.X, Resolution.X, WeightsX);
+		ComputeBernsteinWeights(T.Y, Resolution.Y, WeightsY);
+		ComputeBernsteinWeights(T.Z, Resolution.Z, WeightsZ);
+
+		//Every control point contributes, the rows along X are contiguous
+		VectorRegister Result = VectorZero();
+		const FVector4* Point = ControlPoints;
+		for (int32 Z = 0; Z < Resolution.Z; Z++)
+		{
+			for (int32 Y = 0; Y < Resolution.Y; Y++)
+			{
+				const float WYZ = WeightsY[Y] * WeightsZ[Z];
+				for (int32 X = 0; X < Resolution.X; X++, Point++)
+				{
+					Result = VectorMultiplyAdd(VectorLoad(Point), VectorSetFloat1(WeightsX[X] * WYZ), Result);
+				}
+			}
+		}
+		VectorStoreFloat3(Result, &OutPositions[Index]);
+	}
+}
+
+void FDeformMeshLattice::DeformPositions(bool bBernstein, const FBox& Box, const FIntVector& Resolution, TArrayView<const FVector4> ControlPoints, TArrayView<const FVector> InPositions, TArrayView<FVector> OutPositions)
+{
+	check(InPositions.Num() == OutPositions.Num());
+	check(Resolution == ClampResolution(Resolution) && ControlPoints.Num() == Resolution.X * Resolution.Y * Resolution.Z);
+
+	//A flat box has no extent on one axis, every position is at 0 on it
+	const FVector InvSize = GetInvSize(Box);
+
+	const int32 NumPositions = InPositions.Num();
+	const int32 NumTasks = FMath::DivideAndRoundUp(NumPositions, LatticePositionsChunkSize);
+	ParallelFor(NumTasks, [&](int32 TaskIndex)
+	{
+		const int32 First = TaskIndex * LatticePositionsChunkSize;
+		const int32 Count = FMath::Min(LatticePositionsChunkSize, NumPositions - First);
+		if (bBernstein)
+		{
+			DeformPositionsBernsteinRange(Box.Min, InvSize, Resolution, ControlPoints.GetData(), &InPositions[First], &OutPositions[First], Count);
+		}
+		else
+		{
+			DeformPositionsTrilinearRange(Box.Min, InvSize, Resolution, ControlPoints.GetData(), &InPositions[First], &OutPositions[First], Count);
+		}
+	}, NumTasks <= 1);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Automation tests
+///////////////////////////////////////////////////////////////////////
+#if WITH_DEV_AUTOMATION_TESTS
+
+/* Deform random positions inside a 4x3x5 lattice: the rest points from MakeRestPoints() leave them in place, and translating every point translates them, with both interpolations*/
+/* Moving the corner point pins down the locality of the trilinear mode, the positions outside of the first cell stay where they are (the Bernstein mode would move all of them)*/
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDeformMeshLatticeTest, "DeformMesh.Lattice", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FDeformMeshLatticeTest::RunTest(const FString& Parameters)
+{
+	const FBox Box(FVector(-50.f, -20.f, 0.f), FVector(50.f, 20.f, 80.f));
+	const FIntVector Resolution(4, 3, 5);
+	TArray<FVector> RestPoints;
+	FDeformMeshLattice::MakeRestPoints(Box, Resolution, RestPoints);
+
+	FRandomStream Random(7);
+	TArray<FVector> Positions;
+	for (int32 PositionIdx = 0; PositionIdx < 256; PositionIdx++)
+	{
+		Positions.Add(FVector(Random.FRandRange(Box.Min.X, Box.Max.X), Random.FRandRange(Box.Min.Y, Box.Max.Y), Random.FRandRange(Box.Min.Z, Box.Max.Z)));
+	}
+	TArray<FVector> Deformed;
+	Deformed.SetNumUninitialized(Positions.Num());
+
+	auto ArePositionsMoved = [&](const FVector& Offset)
+	{
+		bool bAllMoved = true;
+		for (int32 PositionIdx = 0; PositionIdx < Positions.Num(); PositionIdx++)
+		{
+			bAllMoved &= Deformed[PositionIdx].Equals(Positions[PositionIdx] + Offset, 0.01f);
+		}
+		return bAllMoved;
+	};
+
+	const FVector Offset(10.f, -5.f, 3.f);
+	for (int32 Bernstein = 0; Bernstein < 2; Bernstein++)
+	{
+		TArray<FVector4> Points;
+		for (const FVector& RestPoint : RestPoints)
+		{
+			Points.Add(FVector4(RestPoint, 0.f));
+		}
+		FDeformMeshLattice::DeformPositions(Bernstein != 0, Box, Resolution, Points, Positions, Deformed);
+		TestTrue(Bernstein ? TEXT("Bernstein, rest lattice") : TEXT("Trilinear, rest lattice"), ArePositionsMoved(FVector::ZeroVector));
+
+		for (FVector4& Point : Points)
+		{
+			Point += FVector4(Offset, 0.f);
+		}
+		FDeformMeshLattice::DeformPositions(Bernstein != 0, Box, Resolution, Points, Positions, Deformed);
+		TestTrue(Bernstein ? TEXT("Bernstein, translated lattice") : TEXT("Trilinear, translated lattice"), ArePositionsMoved(Offset));
+	}
+
+	//Move the corner point (0, 0, 0), only the positions of the first cell can move
+	TArray<FVector4> Points;
+	for (const FVector& RestPoint : RestPoints)
+	{
+		Points.Add(FVector4(RestPoint, 0.f));
+	}
+	Points[0] += FVector4(Offset, 0.f);
+	FDeformMeshLattice::DeformPositions(false, Box, Resolution, Points, Positions, Deformed);
+	const FVector CellSize = Box.GetSize() / FVector(Resolution.X - 1, Resolution.Y - 1, Resolution.Z - 1);
+	bool bLocal = true;
+	for (int32 PositionIdx = 0; PositionIdx < Positions.Num(); PositionIdx++)
+	{
+		const FVector Cell = (Positions[PositionIdx] - Box.Min) / CellSize;
+		const bool bInFirstCell = Cell.X < 1.f && Cell.Y < 1.f && Cell.Z < 1.f;
+		bLocal &= bInFirstCell || Deformed[PositionIdx].Equals(Positions[PositionIdx], 0.01f);
+	}
+	TestTrue(TEXT("Trilinear, one point only moves its cells"), bLocal);
+
+	return true;
+}
+
+#endif //WITH_DEV_AUTOMATION_TESTS
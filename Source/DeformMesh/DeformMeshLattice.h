@@ -0,0 +1,36 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+/**
+ *	Free form deformation of the vertices of a section by a lattice of control points around its static mesh.
+ *	The lattice covers a box of the undeformed mesh space with Resolution.X * Resolution.Y * Resolution.Z control points,
+ *	the point (X, Y, Z) is at index X + Resolution.X * (Y + Resolution.Y * Z). At rest, the points are a regular grid over the box and the mesh doesn't move.
+ *	The vertices are interpolated from the points of their cell (trilinear) or from all the points (Bernstein polynomials, smoother but slower).
+ *	Both are weighted averages of the points, so the deformed mesh stays inside the bounding box of the points.
+ */
+class DEFORMMESH_API FDeformMeshLattice
+{
+public:
+
+	/** The largest number of control points on each axis */
+	static constexpr int32 MaxResolution = 16;
+
+	/** Clamp a resolution between 2 and MaxResolution on each axis */
+	static FIntVector ClampResolution(const FIntVector& Resolution);
+
+	/** The scale from the box to the [0, 1] lattice space on each axis, 0 on the axes where the box is flat (a plane mesh) */
+	static FVector GetInvSize(const FBox& Box);
+
+	/** Fill OutPoints with the rest positions of the control points, a regular grid over Box */
+	static void MakeRestPoints(const FBox& Box, const FIntVector& Resolution, TArray<FVector>& OutPoints);
+
+	/**
+	 *	Reference kernel of the lattice deformation, the vertex shader does the same interpolation on the GPU.
+	 *	The positions outside of Box are clamped to it. The points are float4 like in the structured buffer, the W component isn't used.
+	 */
+	static void DeformPositions(bool bBernstein, const FBox& Box, const FIntVector& Resolution, TArrayView<const FVector4> ControlPoints, TArrayView<const FVector> InPositions, TArrayView<FVector> OutPositions);
+};
@@ -0,0 +1,249 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "DeformMeshSkinning.h"
+#include "DeformMesh.h"
+#include "Async/ParallelFor.h"
+#include "Misc/AutomationTest.h"
+
+/* Number of vertices that each task of the skinning processes*/
+static constexpr int32 SkinPositionsChunkSize = 4096;
+
+
+FDeformMeshSkinWeights::FDeformMeshSkinWeights(TArray<FDeformMeshSkinInfluence>&& InInfluences)
+	: Influences(MoveTemp(InInfluences))
+{
+	TSet<int32> UsedIndices;
+	for (const FDeformMeshSkinInfluence& Influence : Influences)
+	{
+		for (int32 InfluenceIdx = 0; InfluenceIdx < MaxInfluences; InfluenceIdx++)
+		{
+			if (Influence.Weights[InfluenceIdx] > 0)
+			{
+				UsedIndices.Add(Influence.TransformIndices[InfluenceIdx]);
+			}
+		}
+	}
+	UsedTransformIndices = UsedIndices.Array();
+	UsedTransformIndices.Sort();
+}
+
+FDeformMeshSkinInfluence FDeformMeshSkinWeights::MakeInfluence(TArrayView<const int32> TransformIndices, TArrayView<const float> Weights)
+{
+	check(TransformIndices.Num() == Weights.Num());
+
+	//Keep the heaviest influences
+	TArray<int32, TInlineAllocator<8>> Order;
+	for (int32 Idx = 0; Idx < Weights.Num(); Idx++)
+	{
+		if (Weights[Idx] > 0.f && TransformIndices[Idx] >= 0 && TransformIndices[Idx] <= MAX_uint16)
+		{
+			Order.Add(Idx);
+		}
+	}
+	Order.Sort([&Weights](int32 A, int32 B) { return Weights[A] > Weights[B]; });
+	Order.SetNum(FMath::Min(Order.Num(), MaxInfluences), false);
+
+	FDeformMeshSkinInfluence Influence;
+	FMemory::Memzero(Influence);
+	float TotalWeight = 0.f;
+	for (int32 Idx : Order)
+	{
+		TotalWeight += Weights[Idx];
+	}
+	if (Order.Num() == 0 || TotalWeight <= 0.f)
+	{
+		return Influence;
+	}
+
+	//Quantize the normalized weights, the rounding error goes to the heaviest one so they add up to 255
+	int32 QuantizedTotal = 0;
+	for (int32 InfluenceIdx = 0; InfluenceIdx < Order.Num(); InfluenceIdx++)
+	{
+		Influence.TransformIndices[InfluenceIdx] = (uint16)TransformIndices[Order[InfluenceIdx]];
+		Influence.Weights[InfluenceIdx] = (uint8)FMath::Clamp(FMath::RoundToInt(Weights[Order[InfluenceIdx]] / TotalWeight * 255.f), 0, 255);
+		QuantizedTotal += Influence.Weights[InfluenceIdx];
+	}
+	Influence.Weights[0] = (uint8)FMath::Clamp((int32)Influence.Weights[0] + 255 - QuantizedTotal, 0, 255);
+	return Influence;
+}
+
+/* A deform transform as a dual quaternion, and its scale that can't be part of it*/
+struct FDeformMeshDualQuat
+{
+	FQuat Real;
+	FQuat Dual;
+	FVector Scale;
+
+	explicit FDeformMeshDualQuat(const FMatrix& Matrix)
+	{
+		const FTransform Transform(Matrix);
+		const FVector Translation = Transform.GetTranslation();
+		Real = Transform.GetRotation();
+		Dual = (FQuat(Translation.X, Translation.Y, Translation.Z, 0.f) * Real) * 0.5f;
+		Scale = Transform.GetScale3D();
+	}
+};
+
+static void SkinPositionsLinearRange(TArrayView<const FMatrix> DeformMatrices, const FDeformMeshSkinInfluence* Influences, const FVector* InPositions, FVector* OutPositions, int32 NumPositions)
+{
+	for (int32 Index = 0; Index < NumPositions; Index++)
+	{
+		const FDeformMeshSkinInfluence& Influence = Influences[Index];
+		FMatrix Blended;
+		FMemory::Memzero(Blended);
+		for (int32 InfluenceIdx = 0; InfluenceIdx < FDeformMeshSkinWeights::MaxInfluences; InfluenceIdx++)
+		{
+			if (Influence.Weights[InfluenceIdx] > 0)
+			{
+				Blended += DeformMatrices[Influence.TransformIndices[InfluenceIdx]] * (Influence.Weights[InfluenceIdx] / 255.f);
+			}
+		}
+		OutPositions[Index] = Blended.TransformPosition(InPositions[Index]);
+	}
+}
+
+static void SkinPositionsDualQuatRange(TArrayView<const FDeformMeshDualQuat> DualQuats, const FDeformMeshSkinInfluence* Influences, const FVector* InPositions, FVector* OutPositions, int32 NumPositions)
+{
+	for (int32 Index = 0; Index < NumPositions; Index++)
+	{
+		const FDeformMeshSkinInfluence& Influence = Influences[Index];
+		FQuat Real(0.f, 0.f, 0.f, 0.f);
+		FQuat Dual(0.f, 0.f, 0.f, 0.f);
+		FVector Scale = FVector::ZeroVector;
+		const FQuat& Pivot = DualQuats[Influence.TransformIndices[0]].Real;
+		for (int32 InfluenceIdx = 0; InfluenceIdx < FDeformMeshSkinWeights::MaxInfluences; InfluenceIdx++)
+		{
+			if (Influence.Weights[InfluenceIdx] > 0)
+			{
+				const FDeformMeshDualQuat& DualQuat = DualQuats[Influence.TransformIndices[InfluenceIdx]];
+				//q and -q are the same rotation, we blend the ones on the same side as the first influence so they don't cancel out
+				const float Weight = (Influence.Weights[InfluenceIdx] / 255.f) * ((Pivot | DualQuat.Real) < 0.f ? -1.f : 1.f);
+				Real = Real + DualQuat.Real * Weight;
+				Dual = Dual + DualQuat.Dual * Weight;
+				Scale += DualQuat.Scale * FMath::Abs(Weight);
+			}
+		}
+
+		const float Length = Real.Size();
+		if (Length < KINDA_SMALL_NUMBER)
+		{
+			OutPositions[Index] = InPositions[Index];
+			continue;
+		}
+		Real = Real * (1.f / Length);
+		Dual = Dual * (1.f / Length);
+		const FQuat Translation = (Dual * Real.Inverse()) * 2.f;
+		OutPositions[Index] = Real.RotateVector(InPositions[Index] * Scale) + FVector(Translation.X, Translation.Y, Translation.Z);
+	}
+}
+
+void FDeformMeshSkinWeights::SkinPositions(bool bDualQuaternion, TArrayView<const FMatrix> DeformMatrices, TArrayView<const FDeformMeshSkinInfluence> Influences, TArrayView<const FVector> InPositions, TArrayView<FVector> OutPositions)
+{
+	check(InPositions.Num() == OutPositions.Num() && Influences.Num() == InPositions.Num());
+	const int32 NumPositions = InPositions.Num();
+	const int32 NumTasks = FMath::DivideAndRoundUp(NumPositions, SkinPositionsChunkSize);
+
+	//The dual quaternions are computed once per transform, not once per vertex
+	TArray<FDeformMeshDualQuat> DualQuats;
+	if (bDualQuaternion)
+	{
+		DualQuats.Reserve(DeformMatrices.Num());
+		for (const FMatrix& Matrix : DeformMatrices)
+		{
+			DualQuats.Emplace(Matrix);
+		}
+	}
+
+	ParallelFor(NumTasks, [&](int32 TaskIndex)
+	{
+		const int32 First = TaskIndex * SkinPositionsChunkSize;
+		const int32 Count = FMath::Min(SkinPositionsChunkSize, NumPositions - First);
+		if (bDualQuaternion)
+		{
+			SkinPositionsDualQuatRange(DualQuats, &Influences[First], &InPositions[First], &OutPositions[First], Count);
+		}
+		else
+		{
+			SkinPositionsLinearRange(DeformMatrices, &Influences[First], &InPositions[First], &OutPositions[First], Count);
+		}
+	}, NumTasks <= 1);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Automation tests
+///////////////////////////////////////////////////////////////////////
+#if WITH_DEV_AUTOMATION_TESTS
+
+/* Blending a transform with itself has to give it back: random positions with one influence, or four weighted influences on the same transform, move like that transform in both modes*/
+/* Then the case that tells the modes apart: a vertex twisted half way between -90 and +90 degrees around Z falls on the axis with the linear blend, and stays at its radius with the dual quaternions*/
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDeformMeshSkinningTest, "DeformMesh.Skinning", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FDeformMeshSkinningTest::RunTest(const FString& Parameters)
+{
+	FRandomStream Random(42);
+	TArray<FMatrix> Matrices;
+	for (int32 MatrixIdx = 0; MatrixIdx < 8; MatrixIdx++)
+	{
+		Matrices.Add(FTransform(FRotator(Random.FRandRange(-180.f, 180.f), Random.FRandRange(-180.f, 180.f), Random.FRandRange(-180.f, 180.f)), Random.GetUnitVector() * 100.f, FVector(Random.FRandRange(0.5f, 2.f))).ToMatrixWithScale());
+	}
+	TArray<FVector> Positions;
+	for (int32 PositionIdx = 0; PositionIdx < 64; PositionIdx++)
+	{
+		Positions.Add(Random.GetUnitVector() * 50.f);
+	}
+	TArray<FVector> Skinned;
+	Skinned.SetNumUninitialized(Positions.Num());
+	TArray<FDeformMeshSkinInfluence> Influences;
+	Influences.SetNumUninitialized(Positions.Num());
+
+	for (int32 DualQuaternion = 0; DualQuaternion < 2; DualQuaternion++)
+	{
+		//One influence per vertex
+		for (int32 PositionIdx = 0; PositionIdx < Positions.Num(); PositionIdx++)
+		{
+			const int32 Index = PositionIdx % Matrices.Num();
+			const float Weight = 1.f;
+			Influences[PositionIdx] = FDeformMeshSkinWeights::MakeInfluence(MakeArrayView(&Index, 1), MakeArrayView(&Weight, 1));
+		}
+		FDeformMeshSkinWeights::SkinPositions(DualQuaternion != 0, Matrices, Influences, Positions, Skinned);
+		bool bSingleInfluence = true;
+		for (int32 PositionIdx = 0; PositionIdx < Positions.Num(); PositionIdx++)
+		{
+			bSingleInfluence &= Skinned[PositionIdx].Equals(Matrices[PositionIdx % Matrices.Num()].TransformPosition(Positions[PositionIdx]), 0.01f);
+		}
+		TestTrue(DualQuaternion ? TEXT("Dual quaternion, single influence") : TEXT("Linear blend, single influence"), bSingleInfluence);
+
+		//Four influences that are all the same transform
+		for (int32 PositionIdx = 0; PositionIdx < Positions.Num(); PositionIdx++)
+		{
+			const int32 Index = PositionIdx % Matrices.Num();
+			const int32 Indices[] = { Index, Index, Index, Index };
+			const float Weights[] = { Random.FRand() + 0.1f, Random.FRand(), Random.FRand(), Random.FRand() };
+			Influences[PositionIdx] = FDeformMeshSkinWeights::MakeInfluence(Indices, Weights);
+		}
+		FDeformMeshSkinWeights::SkinPositions(DualQuaternion != 0, Matrices, Influences, Positions, Skinned);
+		bool bSameTransform = true;
+		for (int32 PositionIdx = 0; PositionIdx < Positions.Num(); PositionIdx++)
+		{
+			bSameTransform &= Skinned[PositionIdx].Equals(Matrices[PositionIdx % Matrices.Num()].TransformPosition(Positions[PositionIdx]), 0.01f);
+		}
+		TestTrue(DualQuaternion ? TEXT("Dual quaternion, same transform") : TEXT("Linear blend, same transform"), bSameTransform);
+	}
+
+	//A vertex at 10 units from the Z axis, weighted equally between a rotation of -90 and +90 degrees around it
+	const TArray<FMatrix> Twist = { FRotationMatrix(FRotator(0.f, -90.f, 0.f)), FRotationMatrix(FRotator(0.f, 90.f, 0.f)) };
+	const int32 TwistIndices[] = { 0, 1 };
+	const float TwistWeights[] = { 0.5f, 0.5f };
+	const FDeformMeshSkinInfluence TwistInfluence = FDeformMeshSkinWeights::MakeInfluence(TwistIndices, TwistWeights);
+	const FVector TwistPosition(10.f, 0.f, 0.f);
+	FVector LinearPosition;
+	FVector DualQuatPosition;
+	FDeformMeshSkinWeights::SkinPositions(false, Twist, MakeArrayView(&TwistInfluence, 1), MakeArrayView(&TwistPosition, 1), MakeArrayView(&LinearPosition, 1));
+	FDeformMeshSkinWeights::SkinPositions(true, Twist, MakeArrayView(&TwistInfluence, 1), MakeArrayView(&TwistPosition, 1), MakeArrayView(&DualQuatPosition, 1));
+	TestTrue(TEXT("Linear blend collapses a 180 degrees twist"), LinearPosition.Size2D() < 1.f);
+	TestTrue(TEXT("Dual quaternion keeps the volume of a 180 degrees twist"), FMath::IsNearlyEqual(DualQuatPosition.Size2D(), 10.f, 0.1f));
+
+	return true;
+}
+
+#endif //WITH_DEV_AUTOMATION_TESTS
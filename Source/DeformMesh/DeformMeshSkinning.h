@@ -0,0 +1,58 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+/** The transforms blending a vertex of a skinned section, and their weights. The unused influences have a weight of 0 */
+struct FDeformMeshSkinInfluence
+{
+	/** Indices of the sections whose deform transforms are blended */
+	uint16 TransformIndices[4];
+
+	/** Weights of the transforms, they add up to 255 */
+	uint8 Weights[4];
+};
+
+/**
+ *	The influences of each vertex of a skinned section, for the vertices of the first LOD of its static mesh.
+ *	The data is immutable once built, so it can be shared by several sections and read by the render thread.
+ */
+class DEFORMMESH_API FDeformMeshSkinWeights
+{
+public:
+
+	/** The maximum number of transforms blended per vertex */
+	static constexpr int32 MaxInfluences = 4;
+
+	FDeformMeshSkinWeights(TArray<FDeformMeshSkinInfluence>&& InInfluences);
+
+	/**
+	 *	Make the influence of one vertex from any number of weighted transforms.
+	 *	The MaxInfluences heaviest ones are kept and their weights are normalized and quantized, so they add up to exactly 255.
+	 */
+	static FDeformMeshSkinInfluence MakeInfluence(TArrayView<const int32> TransformIndices, TArrayView<const float> Weights);
+
+	const TArray<FDeformMeshSkinInfluence>& GetInfluences() const { return Influences; }
+
+	int32 GetNumVertices() const { return Influences.Num(); }
+
+	/** The sections referenced by at least one influence, sorted. The bounds of a skinned section are computed from their transforms */
+	const TArray<int32>& GetUsedTransformIndices() const { return UsedTransformIndices; }
+
+	SIZE_T GetAllocatedSize() const { return Influences.GetAllocatedSize() + UsedTransformIndices.GetAllocatedSize(); }
+
+	/**
+	 *	Reference kernel of the skinning, the vertex shader does the same blending on the GPU.
+	 *	DeformMatrices are indexed by the transform indices of the influences, they're regular (non transposed) matrices.
+	 *	The linear blend averages the matrices. The dual quaternion blend averages the rotations and translations as dual quaternions,
+	 *	so twisted vertices keep their distance to the axis, and the scales are averaged linearly and applied first.
+	 */
+	static void SkinPositions(bool bDualQuaternion, TArrayView<const FMatrix> DeformMatrices, TArrayView<const FDeformMeshSkinInfluence> Influences, TArrayView<const FVector> InPositions, TArrayView<FVector> OutPositions);
+
+private:
+
+	TArray<FDeformMeshSkinInfluence> Influences;
+	TArray<int32> UsedTransformIndices;
+};
@@ -0,0 +1,106 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "DeformMeshSubsystem.h"
+#include "DeformMeshComponent.h"
+#include "Engine/World.h"
+
+
+void UDeformMeshSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	//The delegate is broadcast for every world, we only flush for ours
+	PostActorTickHandle = FWorldDelegates::OnWorldPostActorTick.AddUObject(this, &UDeformMeshSubsystem::OnWorldPostActorTick);
+}
+
+void UDeformMeshSubsystem::Deinitialize()
+{
+	FWorldDelegates::OnWorldPostActorTick.Remove(PostActorTickHandle);
+	PostActorTickHandle.Reset();
+
+	//Don't leave the components marked as queued
+	Flush();
+
+	Super::Deinitialize();
+}
+
+void UDeformMeshSubsystem::QueueComponent(UDeformMeshComponent* Component)
+{
+	QueuedComponents.Add(Component);
+}
+
+void UDeformMeshSubsystem::Flush()
+{
+	TArray<UDeformMeshComponent*, TInlineAllocator<64>> Components;
+	GatherQueuedComponents(Components);
+	if (Components.Num() > 0)
+	{
+		UDeformMeshComponent::FlushPendingTransforms(Components);
+	}
+}
+
+void UDeformMeshSubsystem::GatherQueuedComponents(TArray<UDeformMeshComponent*, TInlineAllocator<64>>& OutComponents)
+{
+	OutComponents.Reserve(QueuedComponents.Num());
+	for (const TWeakObjectPtr<UDeformMeshComponent>& QueuedComponent : QueuedComponents)
+	{
+		if (UDeformMeshComponent* Component = QueuedComponent.Get())
+		{
+			OutComponents.Add(Component);
+			//The new transforms are reached over the next ticks
+			if (Component->bInterpolateTransforms)
+			{
+				InterpolatingComponents.Add(Component);
+			}
+		}
+	}
+	QueuedComponents.Reset();
+}
+
+void UDeformMeshSubsystem::OnWorldPostActorTick(UWorld* World, ELevelTick TickType, float DeltaSeconds)
+{
+	if (World == GetWorld())
+	{
+		const bool bSendTransforms = QueuedComponents.Num() > 0 || InterpolatingComponents.Num() > 0;
+
+		//The interpolations are gathered first, a component queued again this tick is added back with its new flush time
+		const float Time = World->GetTimeSeconds();
+		TArray<UDeformMeshComponent*, TInlineAllocator<64>> InterpolatedComponents;
+		GatherInterpolatingComponents(Time, InterpolatedComponents);
+		TArray<UDeformMeshComponent*, TInlineAllocator<64>> Components;
+		GatherQueuedComponents(Components);
+
+		//One render command applies the new transforms, then moves the interpolations
+		if (bSendTransforms)
+		{
+			UDeformMeshComponent::FlushPendingTransforms(Components, InterpolatedComponents, Time);
+		}
+
+		//Nothing moved this tick, but the previous transforms still are the ones before the last changes
+		if (!bSendTransforms && bSentTransformsLastTick)
+		{
+			UDeformMeshComponent::FlushTransformsPool(World);
+		}
+		bSentTransformsLastTick = bSendTransforms;
+	}
+}
+
+void UDeformMeshSubsystem::GatherInterpolatingComponents(float Time, TArray<UDeformMeshComponent*, TInlineAllocator<64>>& OutComponents)
+{
+	for (auto It = InterpolatingComponents.CreateIterator(); It; ++It)
+	{
+		UDeformMeshComponent* Component = It->Get();
+		if (Component == nullptr)
+		{
+			It.RemoveCurrent();
+			continue;
+		}
+
+		OutComponents.Add(Component);
+		//The interpolations last at most MaxInterpolationInterval, this is the last tick that moves the sections of this component
+		if (Time - Component->LastTransformsFlushTime >= Component->MaxInterpolationInterval)
+		{
+			It.RemoveCurrent();
+		}
+	}
+}
@@ -0,0 +1,56 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "DeformMeshSubsystem.generated.h"
+
+//Forward declarations
+class UDeformMeshComponent;
+
+/**
+ *	Batches the deform transform updates of all the DeformMesh components of a world.
+ *	The components queue their new transforms during the frame, and the subsystem sends all of them to the render thread with a single render command
+ *	at the end of the world tick. The scene proxies of the world's scene share one pooled structured buffer, so the render thread uploads them with a few locks.
+ *	It also moves the interpolated transforms of the components with bInterpolateTransforms every tick, until they reach their last update, in that same render command.
+ */
+UCLASS()
+class DEFORMMESH_API UDeformMeshSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+public:
+
+	//~ Begin USubsystem Interface.
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	//~ End USubsystem Interface.
+
+	/** Add a component with pending transforms to the queue, it's flushed at the end of the world tick */
+	void QueueComponent(UDeformMeshComponent* Component);
+
+	/** Send the pending transforms of all the queued components now, instead of waiting for the end of the world tick */
+	void Flush();
+
+private:
+
+	/** Flush at the end of the tick of our world */
+	void OnWorldPostActorTick(UWorld* World, ELevelTick TickType, float DeltaSeconds);
+
+	/** Take the live components out of the queue, the ones with bInterpolateTransforms start interpolating */
+	void GatherQueuedComponents(TArray<UDeformMeshComponent*, TInlineAllocator<64>>& OutComponents);
+
+	/** Get the components that received an update recently, their transforms are interpolated to Time. The ones whose interpolation ends at Time leave the set */
+	void GatherInterpolatingComponents(float Time, TArray<UDeformMeshComponent*, TInlineAllocator<64>>& OutComponents);
+
+	/** The components with pending transforms, they can be destroyed while they're queued */
+	TArray<TWeakObjectPtr<UDeformMeshComponent>> QueuedComponents;
+
+	/** The components whose transforms are being interpolated */
+	TSet<TWeakObjectPtr<UDeformMeshComponent>> InterpolatingComponents;
+
+	/** Whether transforms were sent during the last tick, the previous transforms of the velocity pass need one more flush after that */
+	bool bSentTransformsLastTick = false;
+
+	FDelegateHandle PostActorTickHandle;
+};